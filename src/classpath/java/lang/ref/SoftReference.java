@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+package java.lang.ref;
+
+import jelatine.VMPointer;
+
+/**
+ * A soft reference is cleared only when its referent is softly reachable and
+ * the garbage collector could not otherwise satisfy an allocation. The
+ * references which were used least recently are cleared first, this makes
+ * them well suited for implementing memory-sensitive caches.
+ */
+public class SoftReference extends Reference
+{
+    /**
+     * Next object in the soft reference list, this field is handled in a
+     * special way by the garbage-collector
+     */
+    private VMPointer next;
+
+    /**
+     * Value of the collection counter when this reference was last accessed,
+     * used by the garbage-collector to pick the references to clear
+     */
+    private int timestamp;
+
+    /**
+     * Adds a soft reference to the internal list
+     * @param ref A reference
+     */
+    native static void addToSoftReferenceList(SoftReference ref);
+
+    /**
+     * Returns the number of garbage collections which happened so far
+     * @return the current value of the collection counter
+     */
+    native static int collections();
+
+    /**
+     * Create a new soft reference, that is not registered to any queue.
+     * @param referent the object we refer to.
+     */
+    public SoftReference(Object referent)
+    {
+        super(referent);
+        timestamp = SoftReference.collections();
+        SoftReference.addToSoftReferenceList(this);
+    }
+
+    /**
+     * Returns the object this reference refers to and records the access.
+     * @return the object, this reference refers to, or null if the
+     * reference was cleared.
+     */
+    public Object get()
+    {
+        timestamp = SoftReference.collections();
+        return super.get();
+    }
+}
@@ -0,0 +1,48 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+package jelatine;
+
+import java.lang.Runnable;
+
+/**
+ * Internal VM class used for running the concurrent garbage collector.
+ * The collector thread sleeps until the VM requests a new marking cycle, it
+ * then traces the heap while the other threads keep running.
+ */
+public final class VMCollector implements Runnable
+{
+    /**
+     * Waits for a marking cycle to be requested and runs it
+     */
+    public native static void collect();
+
+    /**
+     * Implements the java.lang.Runnable.run() method
+     */
+    public void run()
+    {
+        while (true) {
+            // The collector thread never quits by itself, when execution
+            // stops it is terminated abruptly
+            VMCollector.collect();
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+package jelatine.util;
+
+import java.lang.ref.SoftReference;
+import java.util.Hashtable;
+
+/**
+ * A memory-sensitive cache mapping keys to values. The values are held through
+ * soft references so they are dropped by the garbage collector when memory
+ * runs low, starting from those which were used least recently. Looking up a
+ * dropped value behaves as if it had never been stored.
+ */
+public class SoftCache
+{
+    /** Maps every key to a soft reference to its value */
+    private Hashtable table;
+
+    /**
+     * Creates a new empty cache
+     */
+    public SoftCache()
+    {
+        table = new Hashtable();
+    }
+
+    /**
+     * Returns the value associated with a key
+     * @param key the key
+     * @return the value or null if the key is not in the cache or its value
+     * was dropped by the garbage collector
+     */
+    public synchronized Object get(Object key)
+    {
+        SoftReference ref = (SoftReference) table.get(key);
+        Object value;
+
+        if (ref == null) {
+            return null;
+        }
+
+        value = ref.get();
+
+        if (value == null) {
+            table.remove(key);
+        }
+
+        return value;
+    }
+
+    /**
+     * Associates a value with a key replacing the previous one, if any
+     * @param key the key
+     * @param value the value, must not be null
+     * @throws NullPointerException if the key or the value are null
+     */
+    public synchronized void put(Object key, Object value)
+    {
+        if (value == null) {
+            throw new NullPointerException();
+        }
+
+        table.put(key, new SoftReference(value));
+    }
+
+    /**
+     * Removes a key and its value from the cache
+     * @param key the key
+     * @return the value previously associated with the key, or null
+     */
+    public synchronized Object remove(Object key)
+    {
+        SoftReference ref = (SoftReference) table.remove(key);
+
+        return (ref != null) ? ref.get() : null;
+    }
+
+    /**
+     * Removes all the entries from the cache
+     */
+    public synchronized void clear()
+    {
+        table.clear();
+    }
+
+    /**
+     * Returns the number of entries in the cache, the entries whose values
+     * were dropped by the garbage collector are counted until they are looked
+     * up or removed
+     * @return the number of entries in the cache
+     */
+    public synchronized int size()
+    {
+        return table.size();
+    }
+}
@@ -137,8 +137,8 @@ void arraycopy_ref(array_t *src, int32_t src_offset, array_t *dest,
 {
     class_t *src_cl;
     class_t *dest_cl = header_get_class(&(dest->header))->elem_class;
-    uintptr_t *src_data = array_ref_get_data(src) - src_offset;
-    uintptr_t *dest_data = array_ref_get_data(dest) - dest_offset;
+    jref_t *src_data = array_ref_get_data(src) - src_offset;
+    jref_t *dest_data = array_ref_get_data(dest) - dest_offset;
     uintptr_t ref;
     int32_t i;
 
@@ -146,7 +146,7 @@ void arraycopy_ref(array_t *src, int32_t src_offset, array_t *dest,
         /* An intermediary copy is needed to ensure that the specification of
          * java.lang.System.arraycopy() is perfectly implemented */
         array_t *temp;
-        uintptr_t *temp_data;
+        jref_t *temp_data;
 
         temp = (array_t *) gc_new_array_ref(dest_cl, length);
         temp_data = array_ref_get_data(temp);
@@ -159,11 +159,12 @@ void arraycopy_ref(array_t *src, int32_t src_offset, array_t *dest,
     }
 
     for (i = 0; i < length; i++) {
-        ref = src_data[-i];
+        ref = gc_ref_load(src_data - i);
         src_cl = header_get_class((header_t *) ref);
 
         if ((src_cl == dest_cl) || bcl_is_assignable(src_cl, dest_cl)) {
-            dest_data[-i] = ref;
+            gc_write_barrier(dest_data - i);
+            gc_ref_store(dest_data - i, ref);
         } else {
             KNI_ThrowNew("java/lang/ArrayStoreException", NULL);
             return;
@@ -35,7 +35,11 @@
  ******************************************************************************/
 
 /** Dummy constant pool used by array classes */
+#if JEL_PRECISE_GC
+static const_pool_t dummy_cp = { 0, NULL, NULL, { 0 } };
+#else
 static const_pool_t dummy_cp = { 0, NULL, { 0 } };
+#endif // JEL_PRECISE_GC
 
 /******************************************************************************
  * Constant pool implementation                                               *
@@ -95,6 +99,9 @@ const_pool_t *cp_create(class_t *cl, class_file_t *cf)
     cp = gc_palloc(sizeof(const_pool_t) + sizeof(jword_t) * entries);
     cp->entries = entries;
     cp->tags = gc_palloc(size_div_inf(entries, 2));
+#if JEL_PRECISE_GC
+    cp->name_and_types = gc_palloc(entries * sizeof(uint16_t));
+#endif // JEL_PRECISE_GC
 
     tags = cp->tags;
     data = cp->data;
@@ -180,6 +187,9 @@ const_pool_t *cp_create(class_t *cl, class_file_t *cf)
                 cp_data_set_fieldref_class(data, i, u2_data);
                 u2_data = cf_load_u2(cf);
                 cp_data_set_fieldref_name_and_type(data, i, u2_data);
+#if JEL_PRECISE_GC
+                cp->name_and_types[i] = u2_data;
+#endif // JEL_PRECISE_GC
                 break;
 
             case CONSTANT_NameAndType:
@@ -607,6 +617,34 @@ char *cp_get_interfacemethodref_descriptor(const_pool_t *cp, uint16_t entry)
     return cp_get_name_and_type_type(cp, name_and_type_index);
 } // cp_get_interfacemethodref_descriptor()
 
+#if JEL_PRECISE_GC
+
+/** Gets the descriptor from a CONSTANT_Fieldref, CONSTANT_Methodref or
+ * CONSTANT_InterfaceMethodref structure. Contrary to the other accessors this
+ * works also on entries which have already been resolved
+ * \param cp A pointer to a valid constant pool object
+ * \param entry The constant pool entry number
+ * \returns The descriptor of the field or method */
+
+char *cp_get_ref_descriptor(const_pool_t *cp, uint16_t entry)
+{
+    switch (cp_get_tag(cp, entry)) {
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref:
+        case CONSTANT_Fieldref_resolved:
+        case CONSTANT_Methodref_resolved:
+        case CONSTANT_InterfaceMethodref_resolved:
+            return cp_get_name_and_type_type(cp, cp->name_and_types[entry]);
+
+        default:
+            c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                    "Not a field or method reference entry");
+    }
+} // cp_get_ref_descriptor()
+
+#endif // JEL_PRECISE_GC
+
 /** Gets the class index from a CONSTANT_InterfaceMethodref
  * \param cp A pointer to a valid constant pool object
  * \param entry The constant pool entry number
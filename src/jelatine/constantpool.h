@@ -74,6 +74,9 @@ typedef struct name_and_type_t name_and_type_t;
 struct const_pool_t {
     uint16_t entries; ///< Number of entries in the costant-pool
     uint8_t *tags; ///< Tags array
+#if JEL_PRECISE_GC
+    uint16_t *name_and_types; ///< Name-and-type indexes of the references
+#endif // JEL_PRECISE_GC
     jword_t data[]; ///< Data array
 };
 
@@ -104,6 +107,9 @@ extern char *cp_get_methodref_descriptor(const_pool_t *, uint16_t);
 extern uint16_t cp_get_interfacemethodref_class(const_pool_t *, uint16_t);
 extern char *cp_get_interfacemethodref_name(const_pool_t *, uint16_t);
 extern char *cp_get_interfacemethodref_descriptor(const_pool_t *, uint16_t);
+#if JEL_PRECISE_GC
+extern char *cp_get_ref_descriptor(const_pool_t *, uint16_t);
+#endif // JEL_PRECISE_GC
 #if JEL_FP_SUPPORT
 extern float cp_get_float(const_pool_t *, uint16_t);
 extern double cp_get_double(const_pool_t *, uint16_t);
@@ -38,7 +38,8 @@ void header_create_gc_counter(header_t *header)
 
     *header = (header_get_class(header)->id << 16)
               | (1 << HEADER_JAVA_OBJECT_SHIFT)
-              | (1 << HEADER_MARK_SHIFT);
+              | (1 << HEADER_MARK_SHIFT)
+              | (*header & HEADER_LOCK_MASK);
 
     // Reference arrays have an external counter
     if (class_is_array(cl) && cl->elem_type == PT_REFERENCE) {
@@ -53,7 +54,8 @@ void header_create_gc_counter(header_t *header)
 
 void header_restore(header_t *header, class_t *cl)
 {
-    *header = (uintptr_t) cl | (1 << HEADER_JAVA_OBJECT_SHIFT);
+    *header = (uintptr_t) cl | (1 << HEADER_JAVA_OBJECT_SHIFT)
+              | (*header & HEADER_LOCK_MASK);
 
     if (class_is_array(cl) && cl->elem_type == PT_REFERENCE) {
         ((ref_array_t *) header)->count = 0;
@@ -83,7 +85,8 @@ uint32_t header_get_count(const header_t *header, bool array)
 
 void header_set_count(header_t *header, uint32_t count, bool array)
 {
-    const header_t mask = ((1 << HEADER_RESERVED) - 1) | 0xffff0000;
+    const header_t mask = ((1 << HEADER_RESERVED) - 1) | 0xffff0000
+                          | HEADER_LOCK_MASK;
 
     if (array) {
         ((ref_array_t *) header)->count = count;
@@ -99,7 +102,7 @@ void header_set_count(header_t *header, uint32_t count, bool array)
 
 uint32_t header_get_class_index(const header_t *header)
 {
-    return *header >> 16;
+    return (*header & ~HEADER_LOCK_MASK) >> 16;
 } // header_get_class_index()
 
 #endif // JEL_POINTER_REVERSAL
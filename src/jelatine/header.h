@@ -55,7 +55,27 @@ struct class_t;
  * +------------------------------------------------------------+-+-+
  *
  * Note that the header format is the same for 64-bit architectures, the field
- * is just larger and bits 62 and 63 are used instead of 30 and 31. */
+ * is just larger and bits 62 and 63 are used instead of 30 and 31.
+ *
+ * When thin locks are enabled, which is possible only on 64-bit hosts, bits 0
+ * to 15 of a Java header hold the lock state of the object. Those bits are
+ * never used by class pointers in user space:
+ *
+ *  0      5 6        15 16                                            63
+ * +--------+----------+----------------------------------------------+-+-+
+ * | count  |  owner   |              packed class pointer            |1|M|
+ * +--------+----------+----------------------------------------------+-+-+
+ *
+ * An owner of 0 means the object is unlocked, otherwise it is the lock
+ * identifier of the thread holding it and count is the number of recursive
+ * acquisitions minus one. The all-ones owner marks an inflated lock whose
+ * state is held in a monitor of the thread manager.
+ *
+ * With biased locking the owner field is never cleared once set: the object
+ * stays biased toward the first thread which locked it and count is the number
+ * of times that thread currently holds the lock, 0 meaning it was released.
+ * Only the biased thread modifies these bits, which it does with plain 16-bit
+ * stores, other threads must stop the world and inflate the lock first. */
 
 /** Represents the meta-data added to an object including the object
  * description and the extra fields used by the gc */
@@ -76,8 +96,40 @@ typedef uintptr_t header_t;
 /** Shift value used to obtain the C object bit */
 #define HEADER_JAVA_OBJECT_SHIFT (1)
 
+#if JEL_THIN_LOCKS
+
+#if SIZEOF_VOID_P != 8
+#   error "Thin locks require a 64-bit host."
+#endif // SIZEOF_VOID_P != 8
+
+/** Shift value used to obtain the owner of a thin lock */
+#define HEADER_LOCK_OWNER_SHIFT (48)
+
+/** Number of bits holding the owner of a thin lock */
+#define HEADER_LOCK_OWNER_BITS (10)
+
+/** Shift value used to obtain the recursion count of a thin lock */
+#define HEADER_LOCK_COUNT_SHIFT (58)
+
+/** Largest recursion count which can be stored in a thin lock */
+#define HEADER_LOCK_COUNT_MAX (63)
+
+/** Owner value denoting an inflated lock */
+#define HEADER_LOCK_INFLATED ((1 << HEADER_LOCK_OWNER_BITS) - 1)
+
+/** Mask used to extract the lock state from the header */
+#define HEADER_LOCK_MASK (~(uintptr_t) 0 << HEADER_LOCK_OWNER_SHIFT)
+
+#else
+
+/** No bits hold the lock state when thin locks are disabled */
+#define HEADER_LOCK_MASK ((uintptr_t) 0)
+
+#endif // JEL_THIN_LOCKS
+
 /** Mask used to extract the packed class pointer from the header */
-#define HEADER_PCP_MASK (~(((uintptr_t) 1 << HEADER_RESERVED) - 1))
+#define HEADER_PCP_MASK (~(((uintptr_t) 1 << HEADER_RESERVED) - 1) \
+                         & ~HEADER_LOCK_MASK)
 
 /** Mask used to extract the size of an allocation from the header */
 #define HEADER_SIZE_MASK HEADER_PCP_MASK
@@ -115,6 +167,7 @@ static inline bool header_is_object(header_t *header)
 static inline header_t header_create_object(struct class_t *cl)
 {
     assert(((uintptr_t) cl & ((1 << HEADER_RESERVED) - 1)) == 0);
+    assert(((uintptr_t) cl & HEADER_LOCK_MASK) == 0);
     return (uintptr_t) cl | (1 << HEADER_JAVA_OBJECT_SHIFT);
 } // header_create_object()
 
@@ -162,7 +215,13 @@ static inline bool header_is_marked(header_t *header)
 
 static inline void header_set_mark(header_t *header)
 {
+#if JEL_THIN_LOCKS && JEL_INCREMENTAL_GC
+    /* Incremental marking runs alongside threads which may be updating the
+     * lock state stored in the same word */
+    __sync_fetch_and_or(header, 1 << HEADER_MARK_SHIFT);
+#else
     *header |= 1 << HEADER_MARK_SHIFT;
+#endif // JEL_THIN_LOCKS && JEL_INCREMENTAL_GC
 } // header_set_mark()
 
 /** Clears the mark bit of an object's header
@@ -173,4 +232,83 @@ static inline void header_clear_mark(header_t *header)
     *header &= ~((uintptr_t) 1 << HEADER_MARK_SHIFT);
 } // header_clear_mark()
 
+#if JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+/** Atomically sets the mark bit of an object's header, used when multiple
+ * threads may try marking the same object
+ * \param header A pointer to an object header
+ * \returns true if the object was marked by this call, false if it was already
+ * marked */
+
+static inline bool header_try_mark(header_t *header)
+{
+    header_t old = __sync_fetch_and_or(header, 1 << HEADER_MARK_SHIFT);
+
+    return !((old >> HEADER_MARK_SHIFT) & 1);
+} // header_try_mark()
+
+#endif // JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+#if JEL_THIN_LOCKS
+
+/** Extracts the owner of the thin lock from a header value
+ * \param value The value of an object header
+ * \returns The lock identifier of the owner thread, 0 if the object is
+ * unlocked or ::HEADER_LOCK_INFLATED if the lock is inflated */
+
+static inline uint32_t header_lock_owner(header_t value)
+{
+    return (value >> HEADER_LOCK_OWNER_SHIFT) & HEADER_LOCK_INFLATED;
+} // header_lock_owner()
+
+/** Extracts the recursion count of the thin lock from a header value
+ * \param value The value of an object header
+ * \returns The number of recursive acquisitions of the lock minus one, or the
+ * number of acquisitions of a biased lock */
+
+static inline uint32_t header_lock_count(header_t value)
+{
+    return value >> HEADER_LOCK_COUNT_SHIFT;
+} // header_lock_count()
+
+/** Returns how many times the owner of a lock which is not inflated holds it
+ * \param value The value of an object header
+ * \returns The number of acquisitions of the lock, 0 if it is not held */
+
+static inline uint32_t header_lock_holds(header_t value)
+{
+#if JEL_BIASED_LOCKING
+    return header_lock_count(value);
+#else
+    return (header_lock_owner(value) != 0) ? header_lock_count(value) + 1 : 0;
+#endif // JEL_BIASED_LOCKING
+} // header_lock_holds()
+
+#if JEL_BIASED_LOCKING
+
+/** Type used to access the lock state of a header with a 16-bit store without
+ * breaking aliasing rules */
+typedef uint16_t __attribute__((__may_alias__)) header_lock_t;
+
+/** Sets the number of acquisitions of a biased lock, only the thread the lock
+ * is biased toward may call this function. The lock bits are written without
+ * touching the rest of the header so concurrent updates of the mark bit are
+ * never lost
+ * \param header A pointer to an object header
+ * \param holds The new number of acquisitions */
+
+static inline void header_lock_set_holds(header_t *header, uint32_t holds)
+{
+    volatile header_lock_t *lock = (volatile header_lock_t *) header
+                                   + (WORDS_BIGENDIAN ? 0 : 3);
+
+    assert(holds <= HEADER_LOCK_COUNT_MAX);
+    *lock = (*lock & HEADER_LOCK_INFLATED)
+            | (holds << (HEADER_LOCK_COUNT_SHIFT - HEADER_LOCK_OWNER_SHIFT));
+} // header_lock_set_holds()
+
+#endif // JEL_BIASED_LOCKING
+
+#endif // JEL_THIN_LOCKS
+
 #endif // !JELATINE_HEADER_H
@@ -52,6 +52,110 @@
         thread->fp = fp; \
     } while (0)
 
+/** Polls for a pending stop-the-world. The interpreter polls on backward
+ * branches and method returns so that a thread running a loop which neither
+ * allocates nor blocks still reaches a safepoint in bounded time */
+
+#if JEL_GREEN_THREADS
+#   define SAFEPOINT \
+    do { \
+        if (thread_must_stop(thread)) { \
+            SAVE_STATE; \
+            if (thread_safepoint()) { \
+                goto unmount; \
+            } \
+        } \
+    } while (0)
+#elif !JEL_THREAD_NONE
+#   define SAFEPOINT \
+    do { \
+        if (thread_must_stop(thread)) { \
+            SAVE_STATE; \
+            thread_safepoint(); \
+        } \
+    } while (0)
+#else
+#   define SAFEPOINT
+#endif // !JEL_THREAD_NONE
+
+/** Enters the monitor of \a ref. A virtual thread which has to park for
+ * acquiring the monitor is unmounted from its carrier by the UNMOUNT_POINT
+ * following the instruction, it owns the monitor once it has been resumed */
+
+#if JEL_GREEN_THREADS
+#   define MONITOR_ENTER(ref) \
+    do { \
+        thread->green.unmountable = thread_can_unmount(thread); \
+        monitor_enter(thread, (ref)); \
+        thread->green.unmountable = false; \
+    } while (0)
+#   define UNMOUNT_POINT \
+    do { \
+        if (thread->green.unmount) { \
+            SAVE_STATE; \
+            goto unmount; \
+        } \
+    } while (0)
+#else
+#   define MONITOR_ENTER(ref) monitor_enter(thread, (ref))
+#   define UNMOUNT_POINT
+#endif // JEL_GREEN_THREADS
+
+/** Polls for a pending stop-the-world if a branch with the specified \a offset
+ * jumps backwards */
+
+#define SAFEPOINT_BRANCH(offset) \
+    do { \
+        if ((offset) <= 0) { \
+            SAFEPOINT; \
+        } \
+    } while (0)
+
+/** Invokes the write barrier before overwriting the reference stored in
+ * \a slot, the state is saved first as the barrier may block */
+
+#if JEL_INCREMENTAL_GC
+#   define WRITE_BARRIER(slot) \
+    do { \
+        if (gc_marking) { \
+            SAVE_STATE; \
+            gc_write_barrier(slot); \
+        } \
+    } while (0)
+#else
+#   define WRITE_BARRIER(slot)
+#endif // JEL_INCREMENTAL_GC
+
+/** Checks that the frame of \a method fits on the stack. With segmented stacks
+ * a call which does not fit continues in a new segment where its \a args words
+ * of arguments are moved, otherwise a VirtualMachineError is thrown */
+
+#if JEL_SEGMENTED_STACKS
+#   define STACK_CHECK(method, args) \
+    do { \
+        if ((locals + (method)->max_locals + (method)->max_stack) \
+            > (jword_t *) (fp - 1)) \
+        { \
+            SAVE_STATE; \
+            fp = thread_stack_grow(thread, locals, (args), \
+                                   (method)->max_locals \
+                                   + (method)->max_stack); \
+            locals = fp->locals; \
+        } \
+    } while (0)
+#else
+#   define STACK_CHECK(method, args) \
+    do { \
+        if ((locals + (method)->max_locals + (method)->max_stack) \
+            > (jword_t *) (fp - 1)) \
+        { \
+            c_throw(JAVA_LANG_VIRTUALMACHINEERROR, \
+                    "Stack overflow, try using a larger stack with the " \
+                    "--stack-size parameter"); \
+        } \
+    } while (0)
+#endif // JEL_SEGMENTED_STACKS
+
 /******************************************************************************
  * Interpreter implementation                                                 *
  ******************************************************************************/
@@ -64,13 +168,30 @@ static void prepare_for_call(thread_t *thread, method_t *method)
 {
     stack_frame_t *fp;
 
+#if JEL_PRECISE_GC
+    /* Remember where the interrupted frame, if any, was stopped so that it can
+     * still be scanned precisely while the nested call is running */
+    if (thread->fp != thread_stack_end(thread)) {
+        thread->fp->pc = thread->pc;
+    }
+#endif // JEL_PRECISE_GC
+
     // Check if we are not overflowing the stack
     if ((thread->sp + method->max_locals + method->max_stack)
         > (jword_t *) (thread->fp - 2))
     {
+#if JEL_SEGMENTED_STACKS
+        /* Run the call in a new segment, the arguments are kept below the
+         * stack pointer so that the collector sees them while it is allocated */
+        thread->sp += method->args_size;
+        thread_stack_grow(thread, thread->sp - method->args_size,
+                          method->args_size,
+                          method->max_locals + method->max_stack);
+#else
         c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
                 "Stack overflow, try using a larger stack with the --stack-size"
                 " parameter");
+#endif // JEL_SEGMENTED_STACKS
     }
 
     // Prepare the first, fake stack-frame
@@ -90,6 +211,9 @@ static void prepare_for_call(thread_t *thread, method_t *method)
     // Prepare the thread state
     thread->sp += method->max_locals;
     thread->fp -= 2;
+#if JEL_PRECISE_GC
+    thread->pc = NULL; // Not stopped at any instruction yet
+#endif // JEL_PRECISE_GC
 } // prepare_for_call()
 
 /** Launches the interpreter
@@ -515,16 +639,31 @@ void interpreter(method_t *main_method)
     };
 #endif // JEL_THREADED_INTERPRETER
 
-    // Set the runtime state from the main method
     thread = thread_self();
-    prepare_for_call(thread, main_method);
-    pc = main_method->code;
-    sp = thread->sp;
-    fp = (stack_frame_t *) thread->fp;
-    locals = fp->locals;
-    cp = main_method->cp->data;
 
-    print_method_call(thread, main_method);
+#if JEL_GREEN_THREADS
+    thread->green.depth++;
+
+    if (main_method == NULL) {
+        // Resume a virtual thread where it was unmounted
+        pc = thread->pc;
+        sp = thread->sp;
+        fp = thread->fp;
+        locals = fp->locals;
+        cp = fp->method->cp->data;
+    } else
+#endif // JEL_GREEN_THREADS
+    {
+        // Set the runtime state from the main method
+        prepare_for_call(thread, main_method);
+        pc = main_method->code;
+        sp = thread->sp;
+        fp = (stack_frame_t *) thread->fp;
+        locals = fp->locals;
+        cp = main_method->cp->data;
+
+        print_method_call(thread, main_method);
+    }
 
     INTERPRETER_PROLOG
 
@@ -894,7 +1033,7 @@ void interpreter(method_t *main_method)
     OPCODE(AALOAD) {
         uint32_t index = *((uint32_t *) (sp - 1));
         array_t *array = (array_t *) *((uintptr_t *) (sp - 2));
-        uintptr_t *data = array_ref_get_data(array);
+        jref_t *data = array_ref_get_data(array);
 
         if (array == NULL) {
             goto throw_nullpointerexception;
@@ -903,7 +1042,7 @@ void interpreter(method_t *main_method)
         }
 
         // Reference arrays grow backwards!
-        *((uintptr_t *) (sp - 2)) = *(data - index);
+        *((uintptr_t *) (sp - 2)) = gc_ref_load(data - index);
         sp--;
         pc++;
         DISPATCH;
@@ -1216,7 +1355,7 @@ void interpreter(method_t *main_method)
         class_t *src;
         class_t *dest;
         array_t *array = (array_t *) *((uintptr_t *) (sp - 3));
-        uintptr_t *data = array_ref_get_data(array);
+        jref_t *data = array_ref_get_data(array);
         uint32_t index = *((uint32_t *) (sp - 2));
         uintptr_t value;
 
@@ -1227,9 +1366,10 @@ void interpreter(method_t *main_method)
         }
 
         value = *((uintptr_t *) (sp - 1));
+        WRITE_BARRIER(data - index);
 
         if (value == JNULL) {
-            *(data - index) = JNULL;
+            gc_ref_store(data - index, JNULL);
         } else {
             header_t *header = (header_t *) value;
 
@@ -1237,7 +1377,7 @@ void interpreter(method_t *main_method)
             dest = header_get_class(&(array->header))->elem_class;
 
             if ((src == dest) || bcl_is_assignable(src, dest)) {
-                *(data - index) = value;
+                gc_ref_store(data - index, value);
             } else {
                 goto throw_arraystoreexception;
             }
@@ -1882,6 +2022,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value == 0) ? offset : 3;
         DISPATCH;
@@ -1891,6 +2032,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value != 0) ? offset : 3;
         DISPATCH;
@@ -1900,6 +2042,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value < 0) ? offset : 3;
         DISPATCH;
@@ -1909,6 +2052,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value >= 0) ? offset : 3;
         DISPATCH;
@@ -1918,6 +2062,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value > 0) ? offset : 3;
         DISPATCH;
@@ -1927,6 +2072,7 @@ void interpreter(method_t *main_method)
         int32_t value = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (value <= 0) ? offset : 3;
         DISPATCH;
@@ -1937,6 +2083,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 == value2) ? offset : 3;
         DISPATCH;
@@ -1947,6 +2094,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 != value2) ? offset : 3;
         DISPATCH;
@@ -1957,6 +2105,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 < value2) ? offset : 3;
         DISPATCH;
@@ -1967,6 +2116,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 >= value2) ? offset : 3;
         DISPATCH;
@@ -1977,6 +2127,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 > value2) ? offset : 3;
         DISPATCH;
@@ -1987,6 +2138,7 @@ void interpreter(method_t *main_method)
         int32_t value2 = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 <= value2) ? offset : 3;
         DISPATCH;
@@ -1997,6 +2149,7 @@ void interpreter(method_t *main_method)
         uintptr_t value2 = *((uintptr_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 == value2) ? offset : 3;
         DISPATCH;
@@ -2007,6 +2160,7 @@ void interpreter(method_t *main_method)
         uintptr_t value2 = *((uintptr_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp -= 2;
         pc += (value1 != value2) ? offset : 3;
         DISPATCH;
@@ -2015,6 +2169,7 @@ void interpreter(method_t *main_method)
     OPCODE(GOTO) {
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         pc += offset;
         DISPATCH;
     }
@@ -2044,6 +2199,7 @@ void interpreter(method_t *main_method)
         int32_t high = aligned_ptr[2];
         int32_t index = *((int32_t *) (sp - 1));
 
+        SAFEPOINT;
         aligned_ptr += 3;
         sp--;
 
@@ -2063,6 +2219,7 @@ void interpreter(method_t *main_method)
         int32_t key = *((int32_t *) (sp - 1));
         int32_t i;
 
+        SAFEPOINT;
         aligned_ptr += 2;
         sp--;
 
@@ -2079,6 +2236,7 @@ void interpreter(method_t *main_method)
     OPCODE(IRETURN) {
         int32_t ret_value = *((int32_t *) (sp - 1)); // Pop the return value
 
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2096,6 +2254,7 @@ void interpreter(method_t *main_method)
     OPCODE(LRETURN) {
         int64_t ret_value = *((int64_t *) (sp - 2)); // Pop the return value
 
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2115,6 +2274,7 @@ void interpreter(method_t *main_method)
     OPCODE(FRETURN) {
         float ret_value = *((float *) (sp - 1)); // Pop the return value
 
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2132,6 +2292,7 @@ void interpreter(method_t *main_method)
     OPCODE(DRETURN) {
         double ret_value = *((double *) (sp - 2)); // Pop the return value
 
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2152,6 +2313,7 @@ void interpreter(method_t *main_method)
         // Pop the return value
         uintptr_t ret_value = *((uintptr_t *) (sp - 1));
 
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2167,6 +2329,7 @@ void interpreter(method_t *main_method)
     }
 
     OPCODE(RETURN) {
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         // Pop the current frame
@@ -2201,17 +2364,9 @@ void interpreter(method_t *main_method)
 
         print_method_call(thread, new_method);
 
-        // Check if we are not overflowing the stack
-        if ((locals + new_method->max_locals + new_method->max_stack)
-            > (jword_t *) (fp - 1))
-        {
-            c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
-                    "Stack overflow, try using a larger stack with the "
-                    "--stack-size parameter");
-        }
-
         // Push a new stack frame
         fp->pc = pc + 3;
+        STACK_CHECK(new_method, offset);
         fp--;
         fp->cl = new_cl;
         fp->method = new_method;
@@ -2242,17 +2397,9 @@ void interpreter(method_t *main_method)
 
         print_method_call(thread, new_method);
 
-        // Check if we are not overflowing the stack
-        if ((locals + new_method->max_locals + new_method->max_stack)
-            > (jword_t *) (fp - 1))
-        {
-            c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
-                    "Stack overflow, try using a larger stack with the "
-                    "--stack-size parameter\n");
-        }
-
         // Push a new stack frame
         fp->pc = pc + 3;
+        STACK_CHECK(new_method, offset);
         fp--;
         fp->cl = cp_get_class(new_method->cp);
         fp->method = new_method;
@@ -2276,17 +2423,9 @@ void interpreter(method_t *main_method)
 
         print_method_call(thread, new_method);
 
-        // Check if we are not overflowing the stack
-        if ((locals + new_method->max_locals + new_method->max_stack)
-            > (jword_t *) (fp - 1))
-        {
-            c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
-                    "Stack overflow, try using a larger stack with the "
-                    "--stack-size parameter");
-        }
-
         // Push a new stack frame
         fp->pc = pc + 3;
+        STACK_CHECK(new_method, offset);
         fp--;
         fp->cl = cp_get_class(new_method->cp);
         fp->method = new_method;
@@ -2338,17 +2477,9 @@ void interpreter(method_t *main_method)
         new_method = new_cl->itable[mid];
         print_method_call(thread, new_method);
 
-        // Check if we are not overflowing the stack
-        if ((locals + new_method->max_locals + new_method->max_stack)
-            > (jword_t *) (fp - 1))
-        {
-            c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
-                    "Stack overflow, try using a larger stack with the "
-                    "--stack-size parameter");
-        }
-
         // Push a new stack frame
         fp->pc = pc + 3;
+        STACK_CHECK(new_method, offset);
         fp--;
         fp->cl = new_cl;
         fp->method = new_method;
@@ -2384,17 +2515,9 @@ void interpreter(method_t *main_method)
 
         print_method_call(thread, new_method);
 
-        // Check if we are not overflowing the stack
-        if ((locals + new_method->max_locals + new_method->max_stack)
-            > (jword_t *) (fp - 1))
-        {
-            c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
-                    "Stack overflow, try using a larger stack with the "
-                    "--stack-size parameter");
-        }
-
         // Push a new stack frame
         fp->pc = pc + 3;
+        STACK_CHECK(new_method, offset);
         fp--;
         fp->cl = new_cl;
         fp->method = new_method;
@@ -2529,10 +2652,11 @@ void interpreter(method_t *main_method)
         }
 
         SAVE_STATE;
-        monitor_enter(thread, ref);
+        MONITOR_ENTER(ref);
 
         sp--;
         pc++;
+        UNMOUNT_POINT;
         DISPATCH;
     }
 
@@ -2740,6 +2864,23 @@ void interpreter(method_t *main_method)
                     fp->locals++;
                 }
 
+#if JEL_GREEN_THREADS
+                thread->green.restartable = false;
+
+                if (thread->green.unmount) {
+                    /* The native method parked the thread, it is invoked
+                     * again from the state saved above once the thread has
+                     * been resumed */
+                    assert(native->return_type == RET_VOID);
+
+                    if (sync) {
+                        monitor_exit(thread, ref);
+                    }
+
+                    goto unmount;
+                }
+#endif // JEL_GREEN_THREADS
+
                 // Release the monitor if this method was synchronized
                 if (sync) {
                     if (!monitor_exit(thread, ref)) {
@@ -2773,8 +2914,37 @@ void interpreter(method_t *main_method)
                  * the thread structure will point to the uncaught exception.
                  * We also destroy the current stack frame as it is fake. */
                 thread->fp = fp + 1;
+#if JEL_SEGMENTED_STACKS
+                if ((thread->fp != thread_stack_end(thread))
+                    && (thread->fp->method == &segment_method))
+                {
+                    // The call was started in its own segment, release it
+                    thread_stack_shrink(thread, thread->fp->locals);
+                }
+#endif // JEL_SEGMENTED_STACKS
+#if JEL_PRECISE_GC
+                /* The saved PC belongs to the frame we are leaving, the caller
+                 * will save a fresh one before it can be stopped again */
+                thread->pc = NULL;
+#endif // JEL_PRECISE_GC
+#if JEL_GREEN_THREADS
+                thread->green.depth--;
+#endif // JEL_GREEN_THREADS
                 return;
 
+#if JEL_SEGMENTED_STACKS
+            case SEGMENT_RETURN:
+                /* The method called at the beginning of the current segment has
+                 * returned, move its return value back to the caller and
+                 * release the segment */
+                fp = thread_stack_shrink(thread, sp);
+                sp = thread->sp;
+                cp = fp->method->cp->data;
+                pc = fp->pc;
+                locals = fp->locals;
+                DISPATCH;
+#endif // JEL_SEGMENTED_STACKS
+
             default:
                 dbg_unreachable();
         }
@@ -2798,6 +2968,7 @@ void interpreter(method_t *main_method)
         uintptr_t ref = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (ref == JNULL) ? offset : 3;
         DISPATCH;
@@ -2807,6 +2978,7 @@ void interpreter(method_t *main_method)
         uintptr_t ref = *((int32_t *) (sp - 1));
         int16_t offset = load_int16_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         sp--;
         pc += (ref != JNULL) ? offset : 3;
         DISPATCH;
@@ -2815,6 +2987,7 @@ void interpreter(method_t *main_method)
     OPCODE(GOTO_W) {
         int32_t offset = load_int32_un(pc + 1);
 
+        SAFEPOINT_BRANCH(offset);
         pc += offset;
         DISPATCH;
     }
@@ -3107,7 +3280,18 @@ void interpreter(method_t *main_method)
             goto throw_nullpointerexception;
         }
 
-        *((uintptr_t *) (sp - 1)) = *((uintptr_t *) (ref + offset));
+        *((uintptr_t *) (sp - 1)) = gc_ref_load((jref_t *) (ref + offset));
+
+#if JEL_INCREMENTAL_GC
+        /* The only reference field laid out after the header is the referent
+         * of java.lang.ref.Reference, which is not traced by the collector. It
+         * must be shaded when read during a marking cycle */
+        if (gc_marking && (offset > 0)) {
+            SAVE_STATE;
+            gc_shade(*((uintptr_t *) (sp - 1)));
+        }
+#endif // JEL_INCREMENTAL_GC
+
         pc += 3;
         DISPATCH;
     }
@@ -3232,7 +3416,8 @@ void interpreter(method_t *main_method)
             goto throw_nullpointerexception;
         }
 
-        *((uintptr_t *) (ref + offset)) = *((uintptr_t *) (sp - 1));
+        WRITE_BARRIER((jref_t *) (ref + offset));
+        gc_ref_store((jref_t *) (ref + offset), *((uintptr_t *) (sp - 1)));
         sp -= 2;
         pc += 3;
         DISPATCH;
@@ -3275,8 +3460,9 @@ void interpreter(method_t *main_method)
         uintptr_t ref = *((uintptr_t *) locals);
 
         SAVE_STATE;
-        monitor_enter(thread, ref);
+        MONITOR_ENTER(ref);
         pc++;
+        UNMOUNT_POINT;
         DISPATCH;
     }
 
@@ -3285,8 +3471,9 @@ void interpreter(method_t *main_method)
         uintptr_t ref = class_get_object(cl);
 
         SAVE_STATE;
-        monitor_enter(thread, ref);
+        MONITOR_ENTER(ref);
         pc++;
+        UNMOUNT_POINT;
         DISPATCH;
     }
 
@@ -3295,6 +3482,7 @@ void interpreter(method_t *main_method)
         int32_t ret_value;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3332,6 +3520,7 @@ void interpreter(method_t *main_method)
         int64_t ret_value;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3371,6 +3560,7 @@ void interpreter(method_t *main_method)
         float ret_value;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3408,6 +3598,7 @@ void interpreter(method_t *main_method)
         double ret_value;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3447,6 +3638,7 @@ void interpreter(method_t *main_method)
         uintptr_t ret_value;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3483,6 +3675,7 @@ void interpreter(method_t *main_method)
         bool res;
 
         SAVE_STATE;
+        SAFEPOINT;
         print_method_ret(thread, fp->method);
 
         if (method_is_static(fp->method)) {
@@ -3588,6 +3781,16 @@ throw_exception:
     goto exception_handler;
 
 exception_handler:
+#if JEL_SEGMENTED_STACKS
+    if (fp->method == &segment_method) {
+        /* The exception leaves the current segment, release it and look for a
+         * handler in the caller */
+        fp = thread_stack_shrink(thread, fp->locals);
+        cp = fp->method->cp->data;
+        pc = fp->pc - 1;
+        locals = fp->locals;
+    }
+#endif // JEL_SEGMENTED_STACKS
     {
         class_t *catch_type;
         class_t *exception_type;
@@ -3666,5 +3869,13 @@ exception_handler:
         }
     }
 
+#if JEL_GREEN_THREADS
+unmount:
+    /* The virtual thread gives up its carrier, its state has been saved and
+     * the carrier resumes it later by calling interpreter() again */
+    thread->green.depth--;
+    return;
+#endif // JEL_GREEN_THREADS
+
     INTERPRETER_EPILOG
 } // interpreter()
@@ -35,7 +35,11 @@
 /** java.lang.Class instance layout */
 
 struct java_lang_Class_t {
-    uintptr_t name; ///< Java name
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    /** Padding needed to align the header to a word */
+    jref_t padding_ref[SIZEOF_JWORD_T / SIZEOF_JREF_T - 1];
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
+    jref_t name; ///< Java name
     header_t header; ///< Object header
     int32_t id; ///< Id in the class table corresponding to this class
     int8_t is_array; ///< true if this class is an array
@@ -38,7 +38,11 @@
  * collector */
 
 struct java_lang_String_t {
-    array_t *value; ///< Chars of the string
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    /** Padding needed to align the header to a word */
+    jref_t padding_ref[SIZEOF_JWORD_T / SIZEOF_JREF_T - 1];
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
+    jref_t value; ///< Chars of the string
 
     header_t header; ///< Embedded header
     struct java_lang_String_t *next; ///< Next string in the bucket
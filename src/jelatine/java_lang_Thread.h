@@ -34,8 +34,12 @@
 /** C structure mirroring java.lang.Thread */
 
 struct java_lang_Thread_t {
-    uintptr_t name; ///< Reference to the thread's name
-    uintptr_t runnable; ///< Reference to the thread's Runnable object
+#if 2 * SIZEOF_JREF_T < SIZEOF_JWORD_T
+    /** Padding needed to align the header to a word */
+    jref_t padding_ref[SIZEOF_JWORD_T / SIZEOF_JREF_T - 2];
+#endif // 2 * SIZEOF_JREF_T < SIZEOF_JWORD_T
+    jref_t name; ///< Reference to the thread's name
+    jref_t runnable; ///< Reference to the thread's Runnable object
     header_t header; ///< Header of the object
     uintptr_t vmThread; ///< Reference to an internal representation
 #if (SIZEOF_VOID_P == 2)
@@ -31,7 +31,11 @@
 
 /** Structure mirroring an instance of the java.lang.Throwable class */
 struct java_lang_Throwable_t {
-    uintptr_t detailMessage; ///< Detailed message
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    /** Padding needed to align the header to a word */
+    jref_t padding_ref[SIZEOF_JWORD_T / SIZEOF_JREF_T - 1];
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
+    jref_t detailMessage; ///< Detailed message
     header_t header; ///< Object header
 };
 
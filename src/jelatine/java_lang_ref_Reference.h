@@ -33,7 +33,7 @@
 
 struct java_lang_ref_Reference_t {
     header_t header; ///< Parent class instance
-    uintptr_t referent; ///< Referent of this reference
+    jref_t referent; ///< Referent of this reference
 };
 
 /** Typedef for struct java_lang_ref_Reference_t */
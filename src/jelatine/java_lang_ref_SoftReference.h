@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+/** \file java_lang_ref_SoftReference.h
+ * Java Class 'java.lang.ref.SoftReference' declaration */
+
+/** \def JELATINE_JAVA_LANG_REF_SOFTREFERENCE_H
+ * java_lang_ref_SoftReference.h inclusion macro */
+
+#ifndef JELATINE_JAVA_LANG_REF_SOFTREFERENCE_H
+#   define JELATINE_JAVA_LANG_REF_SOFTREFERENCE_H (1)
+
+#include "wrappers.h"
+
+/** java.lang.ref.SoftReference instance layout */
+
+struct java_lang_ref_SoftReference_t {
+    header_t header; ///< Parent class instance
+    jref_t referent; ///< Referent of this soft reference
+#if SIZEOF_VOID_P == 2
+    uint16_t padding; ///< Padding needed on machines with 16-bit pointers
+#endif // SIZEOF_VOID_P == 2
+    struct java_lang_ref_SoftReference_t *next; ///< Next in the list
+    uint32_t timestamp; ///< Collection count at the time of the last access
+};
+
+/** Typedef for struct java_lang_ref_SoftReference */
+typedef struct java_lang_ref_SoftReference_t java_lang_ref_SoftReference_t;
+
+/** Turns a reference to a Java SoftReference object into a C pointer */
+#define JAVA_LANG_REF_SOFTREFERENCE_REF2PTR(r) \
+        ((java_lang_ref_SoftReference_t *) \
+         ((r) - offsetof(java_lang_ref_SoftReference_t, header)))
+
+/** Turns a C pointer into a reference to a Java SoftReference object */
+#define JAVA_LANG_REF_SOFTREFERENCE_PTR2REF(p) \
+        ((uintptr_t) (p) + offsetof(java_lang_ref_SoftReference_t, header))
+
+#endif // !JELATINE_JAVA_LANG_REF_SOFTREFERENCE_H
@@ -33,7 +33,7 @@
 
 struct java_lang_ref_WeakReference_t {
     header_t header; ///< Parent class instance
-    uintptr_t referent; ///< Referent of this weak reference
+    jref_t referent; ///< Referent of this weak reference
 #if SIZEOF_VOID_P == 2
     uint16_t padding; ///< Padding needed on machines with 16-bit pointers
 #endif // SIZEOF_VOID_P == 2
@@ -41,7 +41,11 @@
 /** Structure mirroring an instance of the jelatine.VMResourceStream class */
 
 struct jelatine_VMResourceStream_t {
-    uintptr_t resource; ///< A Java String holding the name of the resource
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    /** Padding needed to align the header to a word */
+    jref_t padding_ref[SIZEOF_JWORD_T / SIZEOF_JREF_T - 1];
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
+    jref_t resource; ///< A Java String holding the name of the resource
     header_t header; ///< The object header
     ZZIP_FILE *handle; ///< A pointer to the JAR (ZIP) file structure
 #if SIZEOF_VOID_P == 2
@@ -70,6 +70,10 @@ static jstring_manager_t jsm;
 static void jsm_rehash(uint32_t);
 static void jsm_rehash_literals(uint32_t);
 
+static java_lang_String_t *jsm_lookup(java_lang_String_t **volatile *,
+                                      volatile uint32_t *, const uint16_t *,
+                                      uint32_t, uint32_t);
+
 static uint32_t jstring_hash(const uint16_t *, uint32_t, uint32_t);
 static bool jstring_equals(const java_lang_String_t *,
                            const java_lang_String_t *);
@@ -117,14 +121,17 @@ void jsm_set_classes(class_t *str_cl, class_t *char_array_cl)
 
 /** Marks the Java literals present in the manager. This function doesn't
  * acquire the VM lock as it can be called only when all the threads have
- * been stopped */
+ * been stopped. The literal table can be split in several partitions which
+ * are marked independently
+ * \param part The index of the partition to be marked
+ * \param parts The number of partitions */
 
-void jsm_mark( void )
+void jsm_mark(size_t part, size_t parts)
 {
     java_lang_String_t *str;
     uint32_t i;
 
-    for (i = 0; i < jsm.lit_capacity; i++) {
+    for (i = part; i < jsm.lit_capacity; i += parts) {
         str = jsm.lit_buckets[i];
 
         while (str != NULL) {
@@ -151,7 +158,7 @@ void jsm_purge( void )
         curr = (java_lang_String_t *) jsm.buckets[i];
 
         while (curr != NULL) {
-            if (header_is_marked(&(curr->header))) {
+            if (gc_is_marked(JAVA_LANG_STRING_PTR2REF(curr))) {
                 prev = curr;
                 used++;
             } else {
@@ -167,8 +174,7 @@ void jsm_purge( void )
     jsm.entries = used;
 } // jsm_purge()
 
-/** Rehashes the Java string manager. This function doesn't acquire the
- * VM lock as it can be called only when all the threads have been stopped
+/** Rehashes the Java string manager, the caller must hold the VM lock
  * \param capacity The new capacity */
 
 static void jsm_rehash(uint32_t capacity)
@@ -197,14 +203,29 @@ static void jsm_rehash(uint32_t capacity)
         }
     }
 
-    gc_free(jsm.buckets);
-    jsm.buckets = buckets;
-    jsm.capacity = capacity;
+    /* Lock-free readers must never index the buckets array past its end:
+     * when growing publish the array before the capacity, when shrinking do
+     * the opposite. The old array might still be in use and is released at
+     * the next collection */
+    memory_barrier();
+
+    if (capacity > jsm.capacity) {
+        gc_retire(jsm.buckets);
+        jsm.buckets = buckets;
+        memory_barrier();
+        jsm.capacity = capacity;
+    } else {
+        jsm.capacity = capacity;
+        memory_barrier();
+        gc_retire(jsm.buckets);
+        jsm.buckets = buckets;
+    }
+
+    memory_barrier();
 } // jsm_rehash()
 
-/** Rehashes the Java string manager literals hash-table. This function doesn't
- * acquire the VM lock as it can be called only when all the threads have been
- * stopped
+/** Rehashes the Java string manager literals hash-table, the caller must hold
+ * the VM lock
  * \param capacity The new capacity */
 
 static void jsm_rehash_literals(uint32_t capacity)
@@ -234,11 +255,62 @@ static void jsm_rehash_literals(uint32_t capacity)
         }
     }
 
-    gc_free(jsm.lit_buckets);
+    // The literal table only grows, see jsm_rehash() for the ordering
+    memory_barrier();
+    gc_retire(jsm.lit_buckets);
     jsm.lit_buckets = buckets;
+    memory_barrier();
     jsm.lit_capacity = capacity;
 } // jsm_rehash_literals()
 
+/** Looks up a string in one of the manager's hash-tables without holding the
+ * VM lock. Writers publish new entries and tables with the appropriate
+ * barriers so the lookup can only fail spuriously if it races with a rehash,
+ * in which case the caller falls back to the locked path
+ * \param buckets A pointer to the buckets array of the table
+ * \param capacity A pointer to the capacity of the table
+ * \param data A pointer to the characters of the string
+ * \param count The length of the string
+ * \param hash The hash of the string
+ * \returns A pointer to the matching string or NULL if none was found */
+
+static java_lang_String_t *jsm_lookup(java_lang_String_t **volatile *buckets,
+                                      volatile uint32_t *capacity,
+                                      const uint16_t *data, uint32_t count,
+                                      uint32_t hash)
+{
+    java_lang_String_t **table = *buckets;
+    java_lang_String_t *curr;
+    const uint16_t *curr_data;
+    uint32_t mask;
+
+    memory_barrier();
+    mask = *capacity - 1;
+    memory_barrier();
+
+    if (table != *buckets) {
+        return NULL; // A rehash is in progress
+    }
+
+    curr = ((java_lang_String_t *volatile *) table)[hash & mask];
+
+    while (curr != NULL) {
+        if (curr->count == count) {
+            curr_data = array_get_data((array_t *) gc_ref_load(&curr->value));
+
+            if (memcmp(data, curr_data + curr->offset,
+                       count * sizeof(uint16_t)) == 0)
+            {
+                return curr;
+            }
+        }
+
+        curr = ((volatile java_lang_String_t *) curr)->next;
+    }
+
+    return NULL;
+} // jsm_lookup()
+
 /** Interns a java.lang.String object, helper function used for implementing
  * java.lang.String.intern()
  * \param jstr A pointer to a java.lang.String object
@@ -247,7 +319,7 @@ static void jsm_rehash_literals(uint32_t capacity)
 java_lang_String_t *jstring_intern(java_lang_String_t *jstr)
 {
     java_lang_String_t *curr;
-    uint16_t *data = array_get_data(jstr->value);
+    uint16_t *data = array_get_data((array_t *) gc_ref_load(&jstr->value));
     uint32_t count = jstr->count;
     uint32_t offset = jstr->offset;
     uint32_t hash;
@@ -256,6 +328,29 @@ java_lang_String_t *jstring_intern(java_lang_String_t *jstr)
         jstr->cachedHashCode = jstring_hash(data, offset, count);
     }
 
+    // Literals are permanent, look for a match without taking the VM lock
+    curr = jsm_lookup(&jsm.lit_buckets, &jsm.lit_capacity, data + offset,
+                      count, jstr->cachedHashCode);
+
+    if (curr != NULL) {
+        return curr;
+    }
+
+#if JEL_INCREMENTAL_GC
+    /* Interned strings are weakly held, while marking they must be shaded
+     * under the VM lock before being handed out. Marking can start only once
+     * all threads are stopped so it cannot begin until we have returned */
+    if (!gc_marking)
+#endif // JEL_INCREMENTAL_GC
+    {
+        curr = jsm_lookup(&jsm.buckets, &jsm.capacity, data + offset, count,
+                          jstr->cachedHashCode);
+
+        if (curr != NULL) {
+            return curr;
+        }
+    }
+
     tm_lock();
 
     // Check in the literal table
@@ -279,6 +374,8 @@ java_lang_String_t *jstring_intern(java_lang_String_t *jstr)
 
     while (curr != NULL) {
         if (jstring_equals(jstr, curr)) {
+            // Interned strings are weakly held, shade it before handing it out
+            gc_shade(JAVA_LANG_STRING_PTR2REF(curr));
             tm_unlock();
             return curr;
         } else {
@@ -291,6 +388,7 @@ java_lang_String_t *jstring_intern(java_lang_String_t *jstr)
     hash &= jsm.capacity - 1;
 
     jstr->next = jsm.buckets[hash];
+    memory_barrier(); // Publish the string only once it is fully linked
     jsm.buckets[hash] = jstr;
     jsm.entries++;
 
@@ -332,6 +430,12 @@ java_lang_String_t *jstring_create_literal(const char *src)
     data = array_get_data((array_t *) value);
     utf8_to_java(data, src);
     cached_hash_code = jstring_hash(data, 0, len);
+    str = jsm_lookup(&jsm.lit_buckets, &jsm.lit_capacity, data, len,
+                     cached_hash_code);
+
+    if (str != NULL) {
+        return str;
+    }
 
     tm_lock();
     hash = cached_hash_code & (jsm.lit_capacity - 1);
@@ -342,7 +446,7 @@ java_lang_String_t *jstring_create_literal(const char *src)
     while (str != NULL) {
         // Note that the interned string must be a literal, thus permanenent
         if (str->count == len) {
-            str_data = array_get_data(str->value);
+            str_data = array_get_data((array_t *) gc_ref_load(&str->value));
 
             if (memcmp(data, str_data, len * sizeof(uint16_t)) == 0) {
                 // This literal is already present, just return it
@@ -360,13 +464,14 @@ java_lang_String_t *jstring_create_literal(const char *src)
     str = JAVA_LANG_STRING_REF2PTR(ref);
     thread_pop_root();
 
-    str->value = (array_t *) value;
+    gc_ref_store(&str->value, value);
     str->count = len;
     str->offset = 0;
     str->cachedHashCode = cached_hash_code;
 
     // Add the string to the literal hash-table
     str->next = jsm.lit_buckets[hash];
+    memory_barrier(); // Publish the string only once it is fully initialized
     jsm.lit_buckets[hash] = str;
     jsm.lit_entries++;
 
@@ -412,7 +517,7 @@ java_lang_String_t *jstring_create_from_utf8(const char *src)
         thread_pop_root();
     }
 
-    str->value = (array_t *) value;
+    gc_ref_store(&str->value, value);
     str->count = len;
     str->offset = 0;
     str->cachedHashCode = 0;
@@ -446,7 +551,7 @@ java_lang_String_t *jstring_create_from_unicode(const uint16_t *uchar,
         thread_pop_root();
     }
 
-    str->value = (array_t *) value;
+    gc_ref_store(&str->value, value);
     str->count = length;
     str->offset = 0;
     str->cachedHashCode = 0;
@@ -488,8 +593,8 @@ static bool jstring_equals(const java_lang_String_t *str1,
     }
 
     if (str1->count == str2->count) {
-        data1 = array_get_data(str1->value);
-        data2 = array_get_data(str2->value);
+        data1 = array_get_data((array_t *) gc_ref_load(&str1->value));
+        data2 = array_get_data((array_t *) gc_ref_load(&str2->value));
 
         if (memcmp(data1 + str1->offset, data2 + str2->offset,
                     str1->count * sizeof(uint16_t)) == 0)
@@ -508,7 +613,7 @@ static bool jstring_equals(const java_lang_String_t *str1,
 
 void jstring_print(java_lang_String_t *str)
 {
-    uint16_t *data = array_get_data(str->value);
+    uint16_t *data = array_get_data((array_t *) gc_ref_load(&str->value));
     char *tmp = java_to_utf8(data + str->offset, str->count);
 
     printf(tmp);
@@ -43,7 +43,7 @@ struct class_t;
 
 extern void jsm_init(uint32_t, uint32_t);
 extern void jsm_set_classes(struct class_t *, struct class_t *);
-extern void jsm_mark( void );
+extern void jsm_mark(size_t, size_t);
 extern void jsm_purge( void );
 
 extern java_lang_String_t *jstring_intern(java_lang_String_t *);
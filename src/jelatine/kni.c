@@ -64,7 +64,7 @@ jint KNI_ThrowNew(const char *name, const char *message)
     if (message) {
         str = jstring_create_from_utf8(message);
         ptr = JAVA_LANG_THROWABLE_REF2PTR(thread->exception);
-        ptr->detailMessage = JAVA_LANG_STRING_PTR2REF(str);
+        gc_ref_store(&ptr->detailMessage, JAVA_LANG_STRING_PTR2REF(str));
     }
 
     return KNI_OK;
@@ -165,7 +165,7 @@ void KNI_GetStringRegion(jstring stringHandle, jsize offset, jsize n,
                          jchar *jcharbuf)
 {
     java_lang_String_t *string = JAVA_LANG_STRING_REF2PTR(*stringHandle);
-    uint16_t *data = array_get_data(string->value);
+    uint16_t *data = array_get_data((array_t *) gc_ref_load(&string->value));
 
     memcpy(jcharbuf, data + offset, n * sizeof(int16_t));
 } // KNI_GetStringRegion()
@@ -32,6 +32,7 @@
 #include "array.h"
 #include "class.h"
 #include "loader.h"
+#include "memory.h"
 #include "thread.h"
 
 #include "java_lang_String.h"
@@ -425,7 +426,7 @@ static inline jdouble KNI_GetDoubleField(jobject objectHandle, jfieldID fieldID)
 static inline void KNI_GetObjectField(jobject objectHandle, jfieldID fieldID,
                                       jobject toHandle)
 {
-    *toHandle = *((uintptr_t *) (*objectHandle + fieldID));
+    *toHandle = gc_ref_load((jref_t *) (*objectHandle + fieldID));
 } // KNI_GetObjectField()
 
 /** Sets the value of an instance field of boolean type. The field to modify is
@@ -552,7 +553,8 @@ static inline void KNI_SetDoubleField(jobject objectHandle, jfieldID fieldID,
 static inline void KNI_SetObjectField(jobject objectHandle, jfieldID fieldID,
                                       jobject fromHandle)
 {
-    *((uintptr_t *) (*objectHandle + fieldID)) = *fromHandle;
+    gc_write_barrier((jref_t *) (*objectHandle + fieldID));
+    gc_ref_store((jref_t *) (*objectHandle + fieldID), *fromHandle);
 } // KNI_SetObjectField()
 
 /******************************************************************************
@@ -1024,9 +1026,9 @@ static inline void KNI_GetObjectArrayElement(jobjectArray arrayHandle,
                                              jint index, jobject toHandle)
 {
     array_t *array = (array_t *) *arrayHandle;
-    uintptr_t *data = array_ref_get_data(array);
+    jref_t *data = array_ref_get_data(array);
 
-    *toHandle = *(data - index);
+    *toHandle = gc_ref_load(data - index);
 } // KNI_GetObjectArrayElement()
 
 /** Sets an element of an array of booleans. The given array handle must not be
@@ -1177,9 +1179,10 @@ static inline void KNI_SetObjectArrayElement(jobjectArray arrayHandle,
                                              jint index, jobject fromHandle)
 {
     array_t *array = (array_t *) *arrayHandle;
-    uintptr_t *data = array_ref_get_data(array);
+    jref_t *data = array_ref_get_data(array);
 
-    *(data - index) = *fromHandle;
+    gc_write_barrier(data - index);
+    gc_ref_store(data - index, *fromHandle);
 } // KNI_SetObjectArrayElement()
 
 /** Gets a region of \a n bytes of an array of a primitive type. The given
@@ -34,6 +34,7 @@
 #include "memory.h"
 #include "method.h"
 #include "opcodes.h"
+#include "stackmap.h"
 #include "utf8_string.h"
 #include "util.h"
 #include "verifier.h"
@@ -93,6 +94,7 @@ static void derive_class(class_t *, class_file_t *);
 static void load_interfaces(class_t *, class_file_t *);
 static void load_attributes(class_t *, class_file_t *);
 static void grow_class_table( void );
+static class_t *find_class(const char *);
 
 /******************************************************************************
  * Method related local function prototypes                                   *
@@ -151,24 +153,26 @@ void bcl_init( void )
     bcl.interface_methods = 0;
 } // bcl_init()
 
-/** Returns a pointer to the class corresponding to the given id
+/** Returns a pointer to the class corresponding to the given id. This function
+ * doesn't acquire the VM lock, the class table is replaced atomically when it
+ * grows and the old one is released only during the next collection
  * \param id The id of the class
  * \returns A pointer to the class corresponding to \a id */
 
 class_t *bcl_get_class_by_id(uint32_t id)
 {
-    class_t *cl;
+    class_t *volatile *class_table = ((volatile loader_t *) &bcl)->class_table;
 
-    tm_lock();
-    cl = bcl.class_table[id];
-    tm_unlock();
-    return cl;
+    return class_table[id];
 } // bcl_get_class_by_id()
 
 /** Asks the class loader to mark all its internal structures allocated on the
- * Java heap or holding Java references */
+ * Java heap or holding Java references. The class table can be split in
+ * several partitions which are marked independently
+ * \param part The index of the partition to be marked
+ * \param parts The number of partitions */
 
-void bcl_mark( void )
+void bcl_mark(size_t part, size_t parts)
 {
     field_iterator_t itr;
     uint32_t count = bcl.used;
@@ -177,7 +181,7 @@ void bcl_mark( void )
     field_t *field;
     static_field_t *static_field;
 
-    for (size_t i = 0; i < count; i++) {
+    for (size_t i = part; i < count; i += parts) {
         cl = ct[i];
 
         if (cl) {
@@ -414,7 +418,8 @@ static void load_class(class_t *cl)
     jcl->is_array = class_is_array(cl) ? 1 : 0;
     jcl->is_interface = class_is_interface(cl) ? 1 : 0;
 
-    // Put the class in the linked state
+    // Put the class in the linked state, lock-free readers rely on this order
+    memory_barrier();
     class_set_state(cl, CS_LINKED);
 } // load_class()
 
@@ -545,8 +550,9 @@ class_t *bcl_resolve_class(class_t *orig, const char *name)
             id = get_new_class_id();
 
             cl->id = id;
-            bcl.class_table[id] = cl;
             cl->name = utf8_intern(name, strlen(name));
+            memory_barrier(); // The name must be visible to lock-free readers
+            bcl.class_table[id] = cl;
 
             load_class(cl);
         }
@@ -948,44 +954,73 @@ static void load_attributes(class_t *cl ATTRIBUTE_UNUSED, class_file_t *cf)
     }
 } // load_attributes()
 
-/** Finds a class by its name
+/** Finds a class by its name. Linked classes are looked up without acquiring
+ * the VM lock, if the class is not found or is still being loaded the lookup
+ * is repeated with the lock held so that the caller waits for the thread
+ * loading it
  * \param name The class' name
  * \returns A pointer to the class or NULL if none is found */
 
 class_t *bcl_find_class(const char *name)
 {
-    class_t *res = NULL;
+    class_t *res = find_class(name);
 
-    tm_lock();
-
-    for (size_t i = 0; i < bcl.used; i++) {
-        if (bcl.class_table[i] != NULL) {
-            if (strcmp(name, bcl.class_table[i]->name) == 0) {
-                res = bcl.class_table[i];
-                break;
-            }
-        }
+    if ((res == NULL) || (res->state < CS_LINKED)) {
+        tm_lock();
+        res = find_class(name);
+        tm_unlock();
     }
 
-    tm_unlock();
     return res;
 } // bcl_find_class()
 
-/** Grows the class, dispatch and interface dispatch table and updates all the
- * threads cached table pointers */
+/** Scans the class table for a class, this function can be called without
+ * holding the VM lock
+ * \param name The class' name
+ * \returns A pointer to the class or NULL if none is found */
+
+static class_t *find_class(const char *name)
+{
+    volatile loader_t *vbcl = &bcl;
+    class_t *volatile *class_table;
+    class_t *cl;
+    uint32_t used;
+
+    /* Slots are reserved before being filled and the table is published before
+     * being used so read the counter first */
+    used = vbcl->used;
+    memory_barrier();
+    class_table = vbcl->class_table;
+
+    for (size_t i = 0; i < used; i++) {
+        cl = class_table[i];
+
+        if ((cl != NULL) && (strcmp(name, cl->name) == 0)) {
+            return cl;
+        }
+    }
+
+    return NULL;
+} // find_class()
+
+/** Grows the class table, the new table is fully initialized before being
+ * published so that lock-free readers always see a consistent table. The old
+ * one is retired and will be freed during the next collection when no reader
+ * can be using it anymore */
 
 static void grow_class_table( void )
 {
     class_t **new_ct;
 
-    bcl.capacity += CLASS_TABLE_INC;
-
     // Allocate a new class table and fill it
-    new_ct = gc_malloc(bcl.capacity * sizeof(class_t *));
+    new_ct = gc_malloc((bcl.capacity + CLASS_TABLE_INC) * sizeof(class_t *));
     memcpy(new_ct, bcl.class_table, bcl.used * sizeof(class_t *));
+    memory_barrier();
 
-    gc_free(bcl.class_table); // Free the old table
+    gc_retire(bcl.class_table); // Free the old table once no one can use it
     bcl.class_table = new_ct; // Update the table pointer
+    bcl.capacity += CLASS_TABLE_INC;
+    memory_barrier();
 } // grow_class_table()
 
 /******************************************************************************
@@ -1869,7 +1904,7 @@ static void layout_fields(class_t *cl)
     {
         c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
                 "Number of non-reference fields exceed the VM limits");
-    } else if (new_ref_n * sizeof(uintptr_t) > 32768) {
+    } else if (new_ref_n * sizeof(jref_t) > 32768) {
         c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
                 "Number of reference fields exceed the VM limits");
     }
@@ -1898,7 +1933,7 @@ static void layout_fields(class_t *cl)
                     int_offset += 4;
 #endif // SIZEOF_VOID_P == 8
                 } else {
-                    field->offset = -((ref_offset + 1) * sizeof(uintptr_t));
+                    field->offset = -((ref_offset + 1) * sizeof(jref_t));
                     ref_offset++;
                 }
 
@@ -2089,6 +2124,9 @@ void bcl_link_method(class_t *cl, method_t *method)
         handlers = load_exception_handlers(cl, method, code);
         // Translate the method's bytecode and eventually do verification
         translate_bytecode(cl, method, code, handlers);
+#if JEL_PRECISE_GC
+        method->stack_map = stack_map_create(method, code, handlers);
+#endif // JEL_PRECISE_GC
 
         method->data.handlers = handlers;
 
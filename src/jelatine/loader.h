@@ -46,7 +46,7 @@ extern class_t *array_classes[];
 
 extern void bcl_init( void );
 extern class_t *bcl_get_class_by_id(uint32_t);
-extern void bcl_mark( void );
+extern void bcl_mark(size_t, size_t);
 extern bool bcl_is_assignable(class_t *, class_t *);
 extern void bcl_preload_bootstrap_classes( void );
 extern class_t *bcl_resolve_class(class_t *, const char *);
@@ -54,7 +54,27 @@ int main(int argc, char *argv[])
                "    -b, --bootclasspath <single directory or JAR>\n"
                "    -c, --classpath <colon separated list of directories and JARs>\n"
                "    -s, --size <size of the heap in bytes>\n"
+#if JEL_SEGMENTED_STACKS
+               "    --stack-size <maximum size of a thread's stack in bytes>\n"
+               "    --stack-segment-size <size of a thread's stack segments in bytes>\n"
+#else
                "    --stack-size <size of a thread's stack in bytes>\n"
+#endif // JEL_SEGMENTED_STACKS
+#if HAVE_MADVISE
+               "    --huge-pages    back the heap with transparent huge pages\n"
+#endif // HAVE_MADVISE
+#if JEL_INCREMENTAL_GC
+               "    --gc-pause-target <references traced per marking step>\n"
+#endif // JEL_INCREMENTAL_GC
+#if JEL_PARALLEL_GC
+               "    --gc-threads <number of threads used for marking>\n"
+#endif // JEL_PARALLEL_GC
+#if JEL_GREEN_THREADS
+               "    --carriers <number of threads running virtual threads>\n"
+#endif // JEL_GREEN_THREADS
+#if JEL_THREAD_POOL
+               "    --thread-idle-timeout <milliseconds an idle pooled thread is kept>\n"
+#endif // JEL_THREAD_POOL
                "\n"
                "    -h, --help      display this help and exit\n"
                "    --version       output version information and exit\n"
@@ -125,6 +145,49 @@ static void parse_command_line_args(int argc, char *argv[])
 
             opts_set_stack_size(size_ceil(stack_size, sizeof(jword_t)));
             i += 2;
+#if JEL_SEGMENTED_STACKS
+        } else if ((strcmp("--stack-segment-size", argv[i]) == 0)
+                   && (i + 1 < argc))
+        {
+            size_t segment_size = atoi(argv[i + 1]);
+
+            if (segment_size < sizeof(stack_frame_t)) {
+                segment_size = sizeof(stack_frame_t);
+            }
+
+            opts_set_stack_segment_size(size_ceil(segment_size,
+                                                  sizeof(stack_frame_t)));
+            i += 2;
+#endif // JEL_SEGMENTED_STACKS
+#if HAVE_MADVISE
+        } else if (strcmp("--huge-pages", argv[i]) == 0) {
+            opts_set_huge_pages(true);
+            i++;
+#endif // HAVE_MADVISE
+#if JEL_INCREMENTAL_GC
+        } else if ((strcmp("--gc-pause-target", argv[i]) == 0)
+                   && (i + 1 < argc))
+        {
+            opts_set_gc_pause_target(atoi(argv[i + 1]));
+            i += 2;
+#endif // JEL_INCREMENTAL_GC
+#if JEL_PARALLEL_GC
+        } else if ((strcmp("--gc-threads", argv[i]) == 0) && (i + 1 < argc)) {
+            opts_set_gc_threads(atoi(argv[i + 1]));
+            i += 2;
+#endif // JEL_PARALLEL_GC
+#if JEL_GREEN_THREADS
+        } else if ((strcmp("--carriers", argv[i]) == 0) && (i + 1 < argc)) {
+            opts_set_carriers(atoi(argv[i + 1]));
+            i += 2;
+#endif // JEL_GREEN_THREADS
+#if JEL_THREAD_POOL
+        } else if ((strcmp("--thread-idle-timeout", argv[i]) == 0)
+                   && (i + 1 < argc))
+        {
+            opts_set_thread_idle_timeout(atoi(argv[i + 1]));
+            i += 2;
+#endif // JEL_THREAD_POOL
         } else if ((strcmp("-h", argv[i]) == 0)
                    || (strcmp("--help", argv[i]) == 0))
         {
@@ -31,8 +31,59 @@
 #include "util.h"
 #include "vm.h"
 
+#include "java_lang_ref_SoftReference.h"
 #include "java_lang_ref_WeakReference.h"
 
+#if JEL_PARALLEL_GC
+#   include <sched.h>
+#endif // JEL_PARALLEL_GC
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+/** Defined if large areas are cleared using non-temporal stores */
+#   define HEAP_ZERO_STREAM (1)
+#endif // defined(__SSE2__)
+
+#if HAVE_SYS_MMAN_H && HAVE_MMAP && HAVE_MUNMAP
+#   include <sys/mman.h>
+/** Defined if the heap is reserved with mmap() */
+#   define HEAP_MMAP (1)
+#   if HAVE_MADVISE
+/** Defined if unused heap pages can be returned to the operating system */
+#       define HEAP_RELEASE (1)
+#   endif // HAVE_MADVISE
+#   if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#       define MAP_ANONYMOUS MAP_ANON
+#   endif // !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#   ifndef MAP_NORESERVE
+#       define MAP_NORESERVE (0)
+#   endif // MAP_NORESERVE
+#endif // HAVE_SYS_MMAN_H && HAVE_MMAP && HAVE_MUNMAP
+
+#if JEL_PARALLEL_GC || HEAP_MMAP
+#   include <unistd.h>
+#endif // JEL_PARALLEL_GC || HEAP_MMAP
+
+#if JEL_INCREMENTAL_GC && JEL_POINTER_REVERSAL
+#   error "Incremental marking is not compatible with pointer reversal."
+#endif // JEL_INCREMENTAL_GC && JEL_POINTER_REVERSAL
+
+#if JEL_PARALLEL_GC && (JEL_POINTER_REVERSAL || !JEL_THREAD_POSIX)
+#   error "Parallel marking requires POSIX threads and no pointer reversal."
+#endif // JEL_PARALLEL_GC && (JEL_POINTER_REVERSAL || !JEL_THREAD_POSIX)
+
+#if JEL_MARK_BITMAP && JEL_POINTER_REVERSAL
+#   error "The mark bitmap is not compatible with pointer reversal."
+#endif // JEL_MARK_BITMAP && JEL_POINTER_REVERSAL
+
+#if JEL_LARGE_OBJECTS && !HEAP_MMAP
+#   error "The large-object space requires mmap()."
+#endif // JEL_LARGE_OBJECTS && !HEAP_MMAP
+
+#if JEL_COMPRESSED_REFS && (JEL_POINTER_REVERSAL || JEL_LARGE_OBJECTS)
+#   error "Compressed references need no pointer reversal and no large objects."
+#endif // JEL_COMPRESSED_REFS && (JEL_POINTER_REVERSAL || JEL_LARGE_OBJECTS)
+
 /******************************************************************************
  * Type definitions                                                           *
  ******************************************************************************/
@@ -47,6 +98,29 @@ struct finalizable_t {
 /** Typedef for the struct finalizable_t */
 typedef struct finalizable_t finalizable_t;
 
+/** A C object waiting to be freed at the next collection */
+
+struct retired_t {
+    struct retired_t *next; ///< Next object in the list
+    void *ptr; ///< Pointer to the retired object
+};
+
+/** Typedef for the struct retired_t */
+typedef struct retired_t retired_t;
+
+/** Policy used for the referents of soft references which are not otherwise
+ * reachable, soft references are cleared only when a regular collection did
+ * not free enough memory */
+
+enum soft_policy_t {
+    SOFT_KEEP = 0, ///< Keep all the softly reachable objects alive
+    SOFT_CLEAR_LRU = 1, ///< Clear the least recently used soft references
+    SOFT_CLEAR_ALL = 2 ///< Clear all the soft references
+};
+
+/** Typedef for enum soft_policy_t */
+typedef enum soft_policy_t soft_policy_t;
+
 /** Represents a free chunk of memory belonging to the small bin */
 
 struct small_chunk_t {
@@ -66,6 +140,122 @@ struct large_chunk_t {
 /** Typedef for the struct large_chunk_t */
 typedef struct large_chunk_t large_chunk_t;
 
+#if JEL_METADATA_ARENA
+
+/** Size of the regions the metadata arena obtains from the system */
+#define ARENA_REGION_SIZE (64 * 1024)
+
+/** Number of size classes of the metadata arena, class n holds the blocks
+ * made of n + 1 jwords including their header. Larger blocks are allocated
+ * directly from the system */
+#define ARENA_CLASSES (64)
+
+/** Permanent allocations larger than this are not carved from a region */
+#define ARENA_CARVE_MAX (ARENA_REGION_SIZE / 4)
+
+/** Arena holding the C structures of the VM outside of the Java heap. The
+ * permanent allocations are carved from the current region, the other ones
+ * are rounded up to a size class and recycled through per-class free lists
+ * so that both allocating and freeing them take constant time */
+
+struct arena_t {
+    uintptr_t region; ///< Current region, linked to the previous ones
+    uintptr_t top; ///< First free byte of the current region
+    uintptr_t limit; ///< First byte past the end of the current region
+    small_chunk_t *free[ARENA_CLASSES]; ///< Free blocks of each size class
+    size_t size; ///< Memory obtained for the regions (in bytes)
+};
+
+/** Typedef for the struct arena_t */
+typedef struct arena_t arena_t;
+
+#endif // JEL_METADATA_ARENA
+
+#if JEL_LARGE_OBJECTS
+
+/** Header of a block of the large-object space, every block is mapped
+ * separately and holds a single object laid out right after this structure */
+
+struct large_object_t {
+    size_t size; ///< Size of the block in bytes, a multiple of the page size
+    size_t object_size; ///< Size of the object in bytes
+    uintptr_t ref; ///< Reference to the object
+};
+
+/** Typedef for the struct large_object_t */
+typedef struct large_object_t large_object_t;
+
+/** Offset of the object from the beginning of a large-object block */
+#define LARGE_OBJECT_OFFSET \
+    size_ceil(sizeof(large_object_t), sizeof(jword_t))
+
+/** The large-object space */
+
+struct large_space_t {
+    large_object_t **objects; ///< Blocks sorted by address
+    size_t used; ///< Number of blocks
+    size_t capacity; ///< Capacity of the block table
+    size_t size; ///< Memory currently mapped (in bytes)
+    size_t allocated; ///< Memory mapped since the last collection (in bytes)
+#if JEL_PRINT
+    size_t live; ///< Size of the objects currently allocated (in bytes)
+    size_t total_objects; ///< Number of objects allocated so far
+    uint64_t total_size; ///< Size of the objects allocated so far (in bytes)
+    size_t peak; ///< Largest amount of memory mapped at once (in bytes)
+#endif // JEL_PRINT
+};
+
+/** Typedef for the struct large_space_t */
+typedef struct large_space_t large_space_t;
+
+#endif // JEL_LARGE_OBJECTS
+
+/** Initial number of slots of the identity hash table, a power of two */
+#define IDHASH_INITIAL_CAPACITY (64)
+
+/** Seed of the identity hash code generator, must not be zero */
+#define IDHASH_SEED (2463534242U)
+
+/** Multipliers used for mixing the address of an object before placing its
+ * entry in the identity hash table, taken from MurmurHash3's finalizer */
+#define IDHASH_MIX1 (0xff51afd7ed558ccdULL)
+#define IDHASH_MIX2 (0xc4ceb9fe1a85ec53ULL)
+
+/** An entry of the identity hash table */
+
+struct idhash_entry_t {
+    uintptr_t ref; ///< Reference to the object, JNULL if the slot is empty
+    int32_t hash; ///< Identity hash code of the object
+};
+
+/** Typedef for the struct idhash_entry_t */
+typedef struct idhash_entry_t idhash_entry_t;
+
+/** Slots of the identity hash table, they are replaced as a whole when the
+ * table is resized so that lock-free lookups always see a capacity matching
+ * the slots they are probing */
+
+struct idhash_slots_t {
+    size_t capacity; ///< Number of slots, a power of two
+    idhash_entry_t entry[]; ///< The slots
+};
+
+/** Typedef for the struct idhash_slots_t */
+typedef struct idhash_slots_t idhash_slots_t;
+
+/** Identity hash codes of the objects which have been hashed so far. The
+ * codes are generated when an object is first hashed and do not depend on its
+ * address, the table uses open addressing with linear probing */
+
+struct idhash_table_t {
+    idhash_slots_t *slots; ///< Slots of the table, NULL if none were needed
+    size_t used; ///< Number of used slots
+    uint32_t state; ///< State of the hash code generator
+};
+
+/** Typedef for the struct idhash_table_t */
+typedef struct idhash_table_t idhash_table_t;
+
 /** Defines the number of entries in the chunk-bin */
 #define BIN_ENTRIES (16)
 
@@ -78,6 +268,160 @@ typedef struct large_chunk_t large_chunk_t;
 /** Number of slots to add to the temporary root stack when growing it */
 #define TEMP_ROOT_INC (4)
 
+#if JEL_MARK_BITMAP
+/** Number of bitmaps covering the heap, the allocation and mark bitmaps */
+#   define HEAP_BITMAPS (2)
+#else
+/** Number of bitmaps covering the heap, only the allocation bitmap */
+#   define HEAP_BITMAPS (1)
+#endif // JEL_MARK_BITMAP
+
+#if JEL_LARGE_OBJECTS
+
+/** Objects spanning at least this number of pages are allocated in the
+ * large-object space */
+#define LARGE_OBJECT_PAGES (4)
+
+/** Number of entries to add to the large-object table when growing it */
+#define LARGE_OBJECT_INC (16)
+
+#endif // JEL_LARGE_OBJECTS
+
+#if HEAP_ZERO_STREAM
+/** Areas at least this large are cleared with non-temporal stores, bypassing
+ * the caches instead of filling them with zeroes */
+#   define ZERO_STREAM_SIZE (16384)
+#endif // HEAP_ZERO_STREAM
+
+#if JEL_COMPRESSED_REFS
+/** Largest unified heap which can be addressed by compressed references, the
+ * first value is reserved for JNULL */
+#   define HEAP_COMPRESSED_MAX \
+           ((size_t) ((((uint64_t) 1 << JEL_COMPRESSED_REFS) - 2) \
+                      * sizeof(jword_t)))
+#endif // JEL_COMPRESSED_REFS
+
+#if HEAP_RELEASE
+
+/** The heap is underused when less than this fraction of it is in use */
+#define HEAP_SHRINK_FRACTION (4)
+
+/** Number of consecutive collections leaving the heap underused after which
+ * it is shrunk */
+#define HEAP_SHRINK_COLLECTIONS (4)
+
+#endif // HEAP_RELEASE
+
+#if !JEL_POINTER_REVERSAL
+
+/** Fraction of the provided heap used for the mark stacks */
+#define MARK_STACK_FRACTION (32)
+
+/** Minimum number of entries of a mark stack */
+#define MARK_STACK_MIN_ENTRIES (256)
+
+/** Number of references looked ahead when greying the children of an object,
+ * their headers are prefetched so that the cache misses overlap */
+#define MARK_PREFETCH_DISTANCE (8)
+
+#if HAVE___BUILTIN_PREFETCH
+/** Prefetches the header of an object which is about to be marked */
+#   define mark_prefetch(ref) __builtin_prefetch((const void *) (ref), 1)
+#else
+#   define mark_prefetch(ref) ((void) (ref))
+#endif // HAVE___BUILTIN_PREFETCH
+
+#endif // !JEL_POINTER_REVERSAL
+
+#if JEL_PARALLEL_GC
+
+/** Maximum number of marking threads */
+#define GC_MAX_WORKERS (64)
+
+/** Number of entries of the private mark stack of a marking thread */
+#define GC_WORKER_LOCAL (64)
+
+/** A marking thread, the grey objects it has to scan are held in a small
+ * private stack and a larger deque shared with the other workers which steal
+ * from it when they run out of work */
+
+struct gc_worker_t {
+    size_t id; ///< Index of this worker, the first one is the collector
+    pthread_t thread; ///< Native thread running this worker
+    pthread_mutex_t lock; ///< Protects the shared deque
+    uintptr_t local[GC_WORKER_LOCAL]; ///< Private stack of grey objects
+    size_t local_used; ///< Used entries of the private stack
+    uintptr_t *deque; ///< Circular deque of grey objects
+    size_t capacity; ///< Capacity of the deque (in entries)
+    size_t head; ///< Oldest entry of the deque, thieves steal from here
+    volatile size_t count; ///< Number of entries in the deque
+};
+
+/** Typedef for the struct gc_worker_t */
+typedef struct gc_worker_t gc_worker_t;
+
+/** State shared by the marking threads */
+
+struct gc_workers_t {
+    gc_worker_t *worker; ///< Array of workers
+    size_t n; ///< Number of workers
+    pthread_mutex_t lock; ///< Protects the fields used for synchronization
+    pthread_cond_t start; ///< Signaled when a new marking phase starts
+    pthread_cond_t done; ///< Signaled when the last worker is done
+    unsigned int phase; ///< Incremented at the beginning of each phase
+    bool roots; ///< True if the workers must scan the roots
+    size_t running; ///< Workers still running in the current phase
+    volatile size_t idle; ///< Workers which are looking for work
+};
+
+/** Typedef for the struct gc_workers_t */
+typedef struct gc_workers_t gc_workers_t;
+
+#endif // JEL_PARALLEL_GC
+
+#if JEL_CONCURRENT_GC
+
+/** Number of references held by an SATB buffer */
+#define SATB_BUFFER_ENTRIES (256)
+
+/** References overwritten by a thread during a concurrent marking cycle, they
+ * preserve the snapshot of the heap taken when the cycle started. A thread
+ * fills its own buffer without any synchronization and hands it over to the
+ * collector once it is full or when the world is stopped */
+
+struct satb_buffer_t {
+    struct satb_buffer_t *next; ///< Next buffer in the full or free list
+    size_t used; ///< Used entries
+    uintptr_t refs[SATB_BUFFER_ENTRIES]; ///< Overwritten references
+};
+
+/** Typedef for the struct satb_buffer_t */
+typedef struct satb_buffer_t satb_buffer_t;
+
+#endif // JEL_CONCURRENT_GC
+
+#if JEL_PRINT
+
+/** Number of buckets of the pause-time histogram, bucket n holds the pauses
+ * shorter than 2^n microseconds */
+#define PAUSE_BUCKETS (24)
+
+/** Pause-time statistics */
+
+struct pause_stats_t {
+    size_t count; ///< Number of pauses
+    uint64_t total; ///< Total time spent in pauses (in microseconds)
+    uint64_t max; ///< Longest pause (in microseconds)
+    uint64_t ttsp_total; ///< Total time-to-safepoint (in microseconds)
+    uint64_t ttsp_max; ///< Longest time-to-safepoint (in microseconds)
+    size_t histogram[PAUSE_BUCKETS]; ///< Pause-time distribution
+};
+
+/** Typedef for the struct pause_stats_t */
+typedef struct pause_stats_t pause_stats_t;
+
+#endif // JEL_PRINT
+
 /** Structure representing the heap object
  *
  * Note that the last field not only points to the last word in the Java-heap
@@ -88,15 +432,38 @@ struct heap_t {
     bool collect; ///< True if the collector can run
     size_t size; ///< Current heap size (in bytes)
     size_t max_size; ///< Maximum heap size (in bytes)
+#if HEAP_RELEASE
+    size_t min_size; ///< Initial heap size, the heap never shrinks below it
+    uint32_t underused; ///< Consecutive collections leaving the heap underused
+#endif // HEAP_RELEASE
 
     void *memory; ///< Generic heap used by the VM
+#if HEAP_MMAP
+    size_t reserved; ///< Size of the address range reserved for the heap
+    size_t page_size; ///< Size of a page of memory
+#endif // HEAP_MMAP
     uintptr_t start; ///< First word of the heap
     uintptr_t end; ///< First word after the end of the heap
     uintptr_t perm; ///< First word of the permanent allocation area
 
     uint8_t *bitmap; ///< Memory bitmap
+#if JEL_MARK_BITMAP
+    uint8_t *markmap; ///< Mark bitmap, parallel to the memory bitmap
+#endif // JEL_MARK_BITMAP
 
     java_lang_ref_WeakReference_t *weakref_list; ///< Weak references list
+    java_lang_ref_SoftReference_t *softref_list; ///< Soft references list
+    idhash_table_t idhash; ///< Identity hash codes
+    retired_t *retired; ///< C objects to be freed at the next collection
+    uint32_t collections; ///< Number of collections, used for aging softrefs
+
+#if JEL_LARGE_OBJECTS
+    large_space_t los; ///< Large-object space
+#endif // JEL_LARGE_OBJECTS
+
+#if JEL_METADATA_ARENA
+    arena_t arena; ///< Arena holding the C structures of the VM
+#endif // JEL_METADATA_ARENA
 
     large_chunk_t *large_bin; ///< Bin used for storing large free chunks
     small_chunk_t *bin[BIN_ENTRIES]; ///< Bin used for storing small free chunks
@@ -106,6 +473,36 @@ struct heap_t {
     finalizable_t *finalizable; ///< List of finalizer objects still alive
     finalizable_t *finalizing; ///< Objects waiting to be finalized
 #endif // JEL_FINALIZER
+
+#if !JEL_POINTER_REVERSAL
+    bool mark_overflow; ///< True if grey objects didn't fit in the stack
+#endif // !JEL_POINTER_REVERSAL
+
+#if !JEL_POINTER_REVERSAL && !JEL_PARALLEL_GC
+    uintptr_t *mark_stack; ///< Stack holding the grey objects
+    size_t mark_stack_size; ///< Capacity of the mark stack (in entries)
+    size_t mark_stack_used; ///< Used entries of the mark stack
+#endif // !JEL_POINTER_REVERSAL && !JEL_PARALLEL_GC
+
+#if JEL_INCREMENTAL_GC
+    size_t live; ///< Memory in use after the last collection (in bytes)
+    size_t allocated; ///< Memory allocated since the last collection
+    size_t trigger; ///< Allocation volume which starts a marking cycle
+#if JEL_CONCURRENT_GC
+    bool cycle_requested; ///< True if the collector thread has been woken up
+    pthread_mutex_t mark_lock; ///< Held while tracing, taken after the VM lock
+    pthread_mutex_t satb_lock; ///< Protects the lists of SATB buffers
+    satb_buffer_t *satb_full; ///< Buffers waiting to be traced
+    satb_buffer_t *satb_free; ///< Empty buffers ready for reuse
+#else
+    size_t step_quantum; ///< Allocation volume between two marking steps
+    size_t step_allocated; ///< Memory allocated since the last marking step
+#endif // JEL_CONCURRENT_GC
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_PRINT
+    pause_stats_t pauses; ///< Pause-time statistics
+#endif // JEL_PRINT
 };
 
 /** Typedef for the struct heap_t */
@@ -116,18 +513,126 @@ typedef struct heap_t heap_t;
  ******************************************************************************/
 
 static uintptr_t gc_alloc(size_t);
+static uintptr_t gc_alloc_object(size_t, size_t);
 static void gc_purge_bin( void );
+static void gc_zero(uintptr_t, uintptr_t);
+#if !JEL_PARALLEL_GC
 static void gc_mark( void );
+#endif // !JEL_PARALLEL_GC
 static void gc_mark_finalizable( void );
 static void gc_sweep(size_t);
+static void gc_collect_soft(size_t, soft_policy_t);
+static bool gc_mark_soft_refs(soft_policy_t);
+static void gc_free_retired( void );
 static void gc_purge_weakref_list( void );
+static void gc_purge_softref_list( void );
+static void gc_purge_identity_hashes( void );
 static void gc_grow(uintptr_t, size_t);
+#if HEAP_RELEASE
+static size_t gc_shrink(uintptr_t, size_t, size_t);
+static void gc_release(uintptr_t, uintptr_t);
+#endif // HEAP_RELEASE
+
+#if JEL_LARGE_OBJECTS
+
+// Large-object space functions
+
+static uintptr_t los_alloc(size_t, size_t);
+static large_object_t *los_find(uintptr_t);
+static void los_sweep( void );
+#if JEL_PRINT
+static void los_log_stats( void );
+#endif // JEL_PRINT
+
+#endif // JEL_LARGE_OBJECTS
+
+#if JEL_METADATA_ARENA
+
+// Metadata arena functions
+
+static void arena_region( void );
+static uintptr_t arena_carve(size_t);
+static uintptr_t arena_alloc(size_t);
+static void arena_free(uintptr_t);
+
+#endif // JEL_METADATA_ARENA
+
+// Identity hash table functions
+
+static inline size_t idhash_slot(uintptr_t);
+static idhash_entry_t *idhash_lookup(idhash_slots_t *, uintptr_t);
+static void idhash_rehash(size_t);
+static void idhash_remove(size_t);
+
+#if JEL_INCREMENTAL_GC
+
+// Incremental marking functions
+
+static void gc_increment(size_t);
+static void gc_start_marking( void );
+#if JEL_CONCURRENT_GC
+static satb_buffer_t *gc_satb_swap(thread_t *);
+static size_t gc_satb_drain( void );
+static bool gc_trace(size_t);
+#else
+static void gc_step(size_t);
+#endif // JEL_CONCURRENT_GC
+
+#endif // JEL_INCREMENTAL_GC
+
+#if !JEL_POINTER_REVERSAL
+
+// Mark stack functions
+
+static void gc_grey(uintptr_t);
+static size_t gc_scan(uintptr_t);
+static size_t gc_rescan( void );
+#if !JEL_PARALLEL_GC
+static bool gc_drain(size_t);
+#endif // !JEL_PARALLEL_GC
+
+#endif // !JEL_POINTER_REVERSAL
+
+#if JEL_PARALLEL_GC
+
+// Parallel marking functions
+
+static void gc_workers_init(size_t);
+static void *gc_worker_main(void *);
+static void gc_worker_mark(gc_worker_t *);
+static gc_worker_t *gc_worker_self( void );
+static void gc_worker_push(gc_worker_t *, uintptr_t);
+static bool gc_worker_pop(gc_worker_t *, uintptr_t *);
+static bool gc_worker_steal(gc_worker_t *);
+static bool gc_worker_terminate( void );
+static void gc_mark_parallel(bool);
+
+#endif // JEL_PARALLEL_GC
+
+#if JEL_PRINT
+
+// Pause-time statistics
+
+static void gc_log_pause(const char *, uint64_t);
+static void gc_log_pauses( void );
+
+#endif // JEL_PRINT
 
 // Bitmap management functions
 
 static inline void bitmap_set(uintptr_t);
 static inline void bitmap_clear(uintptr_t);
 static inline bool bitmap_get(uintptr_t);
+static inline jword_t bitmap_load(size_t);
+static uintptr_t bitmap_next(uintptr_t, uintptr_t);
+
+// Mark bit management functions
+
+static inline bool mark_get(uintptr_t);
+static inline void mark_set(uintptr_t);
+#if JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+static inline bool mark_try_set(uintptr_t);
+#endif // JEL_PARALLEL_GC || JEL_CONCURRENT_GC
 
 // Chunk management functions
 
@@ -145,6 +650,35 @@ void print_bin( void );
 /** The virtual machine heap */
 static heap_t heap;
 
+#if JEL_PARALLEL_GC
+
+/** The marking threads */
+static gc_workers_t workers;
+
+/** Worker associated with the current thread, NULL for the collector */
+static JEL_TLS native_key_t gc_worker_key;
+
+#endif // JEL_PARALLEL_GC
+
+/******************************************************************************
+ * Globals                                                                    *
+ ******************************************************************************/
+
+#if JEL_INCREMENTAL_GC
+
+/** True while an incremental marking cycle is in progress */
+bool gc_marking = false;
+
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_COMPRESSED_REFS
+
+/** Base address of compressed references, one word below the start of the
+ * heap so that no object is ever encoded as 0 which represents JNULL */
+uintptr_t gc_ref_base;
+
+#endif // JEL_COMPRESSED_REFS
+
 /******************************************************************************
  * Heap implementation                                                        *
  ******************************************************************************/
@@ -166,36 +700,92 @@ void gc_init(size_t size)
     uint8_t *bitmap;
     size_t init_size;
     size_t heap_size; // Actual size of the heap in jwords
+    size_t bitmap_size; // Size of a bitmap in bytes
 
     // Grow the heap size if it is smaller than the canonical 32KiB CLDC heap
     size = (size < 32768) ? 32768 : size;
 
+#if JEL_COMPRESSED_REFS
+    // Shrink it if compressed references cannot address all of it
+    size = (size > HEAP_COMPRESSED_MAX) ? HEAP_COMPRESSED_MAX : size;
+#endif // JEL_COMPRESSED_REFS
+
     /* Truncate the size to a multiple of 4 or 8 bytes, so we won't bother about
      * alignment problems, we assume that malloc() will already return a
      * properly aligned block */
     size = size_ceil(size, sizeof(jword_t));
-    heap_size = (size * sizeof(jword_t) * 8) / ((sizeof(jword_t) * 8) + 1);
+    heap_size = (size * sizeof(jword_t) * 8)
+                / ((sizeof(jword_t) * 8) + HEAP_BITMAPS);
     heap_size = size_floor(heap_size, sizeof(jword_t));
     init_size = size_ceil(heap_size / HEAP_INIT_FRACTION, sizeof(jword_t));
+    bitmap_size = size_ceil(size_div_inf(heap_size, sizeof(jword_t) * 8),
+                            sizeof(jword_t));
 
+    // Add some padding for reading the bitmaps a word at a time
+    size = heap_size + bitmap_size * HEAP_BITMAPS + sizeof(jword_t);
+
+#if HEAP_MMAP
+    /* Only reserve the address range, the pages are committed and zeroed by
+     * the operating system the first time they are touched */
+    unified_heap = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (unified_heap == MAP_FAILED) {
+        unified_heap = NULL;
+    }
+#else
     unified_heap = malloc(size);
-    memset(unified_heap, 0, size);
-    bitmap = (uint8_t *) unified_heap + heap_size;
+#endif // HEAP_MMAP
 
     if (unified_heap == NULL) {
         dbg_error("Out of memory, cannot allocate the unified heap.");
         vm_fail();
     }
 
+#if HEAP_MMAP
+    heap.reserved = size;
+
+#   if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+    if (opts_get_huge_pages()) {
+        madvise(unified_heap, size, MADV_HUGEPAGE);
+    }
+#   endif // HAVE_MADVISE && defined(MADV_HUGEPAGE)
+#else
+    memset(unified_heap, 0, size);
+#endif // HEAP_MMAP
+
+    bitmap = (uint8_t *) unified_heap + heap_size;
+
     // Initialize the heap structure
     heap.size = init_size;
     heap.max_size = heap_size;
+#if HEAP_RELEASE
+    heap.min_size = init_size;
+    heap.underused = 0;
+#endif // HEAP_RELEASE
+#if HEAP_MMAP
+    heap.page_size = sysconf(_SC_PAGESIZE);
+#endif // HEAP_MMAP
     heap.memory = unified_heap;
     heap.start = (uintptr_t) unified_heap;
     heap.end = (uintptr_t) unified_heap + init_size;
+#if JEL_COMPRESSED_REFS
+    gc_ref_base = heap.start - sizeof(jword_t);
+#endif // JEL_COMPRESSED_REFS
     heap.perm = heap.start + heap_size;
     heap.weakref_list = NULL;
+    heap.softref_list = NULL;
+    heap.retired = NULL;
+    heap.collections = 0;
+    memset(&heap.idhash, 0, sizeof(idhash_table_t));
+    heap.idhash.state = IDHASH_SEED;
+#if JEL_LARGE_OBJECTS
+    memset(&heap.los, 0, sizeof(large_space_t));
+#endif // JEL_LARGE_OBJECTS
     heap.bitmap = bitmap;
+#if JEL_MARK_BITMAP
+    heap.markmap = bitmap + bitmap_size;
+#endif // JEL_MARK_BITMAP
     heap.large_bin = NULL;
 
     memset(heap.bin, 0, sizeof(small_chunk_t *) * BIN_ENTRIES);
@@ -212,13 +802,82 @@ void gc_init(size_t size)
     heap.finalizable = NULL;
     heap.finalizing = NULL;
 #endif // JEL_FINALIZER
+
+#if !JEL_POINTER_REVERSAL && !JEL_PARALLEL_GC
+    // Carve the mark stack from the permanent allocation area
+    heap.mark_stack_size = size_max(heap_size / MARK_STACK_FRACTION
+                                    / sizeof(uintptr_t),
+                                    MARK_STACK_MIN_ENTRIES);
+    heap.perm -= size_ceil(heap.mark_stack_size * sizeof(uintptr_t),
+                           sizeof(jword_t));
+    heap.mark_stack = (uintptr_t *) heap.perm;
+    heap.mark_stack_used = 0;
+#endif // !JEL_POINTER_REVERSAL && !JEL_PARALLEL_GC
+
+#if JEL_INCREMENTAL_GC
+    heap.live = 0;
+    heap.allocated = 0;
+    heap.trigger = init_size / 2;
+#if JEL_CONCURRENT_GC
+    heap.cycle_requested = false;
+    pthread_mutex_init(&heap.mark_lock, NULL);
+    pthread_mutex_init(&heap.satb_lock, NULL);
+    heap.satb_full = NULL;
+    heap.satb_free = NULL;
+#else
+    heap.step_quantum = 0;
+    heap.step_allocated = 0;
+#endif // JEL_CONCURRENT_GC
+#endif // JEL_INCREMENTAL_GC
+
+#if !JEL_POINTER_REVERSAL
+    heap.mark_overflow = false;
+#endif // !JEL_POINTER_REVERSAL
+
+#if JEL_PARALLEL_GC
+    gc_workers_init(heap_size);
+#endif // JEL_PARALLEL_GC
+
+#if JEL_PRINT
+    memset(&heap.pauses, 0, sizeof(pause_stats_t));
+#endif // JEL_PRINT
 } // gc_init()
 
 /** Disposes the unified heap */
 
 void gc_teardown( void )
 {
+#if JEL_LARGE_OBJECTS
+    for (size_t i = 0; i < heap.los.used; i++) {
+        munmap(heap.los.objects[i], heap.los.objects[i]->size);
+    }
+
+    free(heap.los.objects);
+#endif // JEL_LARGE_OBJECTS
+
+#if JEL_CONCURRENT_GC
+    while (heap.satb_free != NULL) {
+        satb_buffer_t *next = heap.satb_free->next;
+
+        free(heap.satb_free);
+        heap.satb_free = next;
+    }
+#endif // JEL_CONCURRENT_GC
+
+#if JEL_METADATA_ARENA
+    while (heap.arena.region != 0) {
+        uintptr_t prev = *((uintptr_t *) heap.arena.region);
+
+        free((void *) heap.arena.region);
+        heap.arena.region = prev;
+    }
+#endif // JEL_METADATA_ARENA
+
+#if HEAP_MMAP
+    munmap(heap.memory, heap.reserved);
+#else
     free(heap.memory);
+#endif // HEAP_MMAP
 } // gc_teardown()
 
 /** Enables or disables the collector
@@ -248,23 +907,28 @@ uintptr_t gc_new(class_t *cl)
 
     tm_lock();
 
-#if SIZEOF_VOID_P == (SIZEOF_JWORD_T / 2)
-    ref_n = size_ceil(class_get_ref_n(cl), 2);
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    ref_n = size_ceil(class_get_ref_n(cl), SIZEOF_JWORD_T / SIZEOF_JREF_T);
 #else
     ref_n = class_get_ref_n(cl);
-#endif
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
 
-    size = (ref_n * sizeof(uintptr_t)) + sizeof(header_t)
+    size = (ref_n * sizeof(jref_t)) + sizeof(header_t)
            + size_ceil(class_get_nref_size(cl), sizeof(jword_t));
 
     assert((size >= sizeof(jword_t)) && (size % sizeof(jword_t) == 0));
 
-    ptr = gc_alloc(size);
-    ptr += ref_n * sizeof(uintptr_t); // Point to the header
-    bitmap_set(ptr);
+    ptr = gc_alloc_object(size, ref_n * sizeof(jref_t));
     header = (header_t *) ptr;
     *header = header_create_object(cl);
 
+#if JEL_INCREMENTAL_GC
+    // Objects allocated during a marking cycle are black
+    if (gc_marking) {
+        mark_set(ptr);
+    }
+#endif // JEL_INCREMENTAL_GC
+
 #if JEL_PRINT
     if (opts_get_print_memory()) {
         fprintf(stderr, "NEW PTR: %p SIZE: %zu\n", (void *) ptr, size);
@@ -296,11 +960,17 @@ uintptr_t gc_new_array_nonref(array_type_t type, int32_t count)
 
     size = size_ceil(sizeof(array_t) + size, sizeof(jword_t));
     tm_lock();
-    ptr = gc_alloc(size);
-    bitmap_set(ptr);
+    ptr = gc_alloc_object(size, 0);
     array = (array_t *) ptr;
     array->header = header_create_object(cl);
     array->length = count;
+
+#if JEL_INCREMENTAL_GC
+    if (gc_marking) {
+        mark_set(ptr);
+    }
+#endif // JEL_INCREMENTAL_GC
+
     tm_unlock();
 
 #if JEL_PRINT
@@ -323,19 +993,24 @@ uintptr_t gc_new_array_ref(class_t *cl, int32_t count)
     uintptr_t ptr;
     size_t size;
 
-#if SIZEOF_VOID_P == (SIZEOF_JWORD_T / 2)
-    size = size_ceil(count, 2) * sizeof(uintptr_t);
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+    size = size_ceil(count, SIZEOF_JWORD_T / SIZEOF_JREF_T) * sizeof(jref_t);
 #else
-    size = count * sizeof(uintptr_t);
-#endif // SIZEOF_VOID_P == (SIZEOF_JWORD_T / 2)
+    size = count * sizeof(jref_t);
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
 
     tm_lock();
-    ptr = gc_alloc(sizeof(ref_array_t) + size);
-    ptr += size;
-    bitmap_set(ptr);
+    ptr = gc_alloc_object(sizeof(ref_array_t) + size, size);
     array = (ref_array_t *) ptr;
     array->header = header_create_object(cl);
     array->length = count;
+
+#if JEL_INCREMENTAL_GC
+    if (gc_marking) {
+        mark_set(ptr);
+    }
+#endif // JEL_INCREMENTAL_GC
+
     tm_unlock();
 
 #if JEL_PRINT
@@ -356,7 +1031,7 @@ uintptr_t gc_new_array_ref(class_t *cl, int32_t count)
 
 uintptr_t gc_new_multiarray(class_t *cl, uint8_t dimensions, jword_t *counts)
 {
-    uintptr_t *references;
+    jref_t *references;
     uintptr_t ref;
     int32_t count = *((int32_t *) counts);
     int32_t i;
@@ -379,8 +1054,9 @@ uintptr_t gc_new_multiarray(class_t *cl, uint8_t dimensions, jword_t *counts)
         thread_push_root(&ref);
 
         for (i = 0; i < count; i++) {
-            references[-i] = gc_new_multiarray(cl->elem_class, dimensions - 1,
-                                               counts + 1);
+            gc_ref_store(references - i,
+                         gc_new_multiarray(cl->elem_class, dimensions - 1,
+                                           counts + 1));
         }
 
         thread_pop_root();
@@ -457,18 +1133,50 @@ void gc_register_weak_ref(java_lang_ref_WeakReference_t *ref)
     tm_unlock();
 } // gc_register_weak_ref()
 
+/** Adds a new object to the soft reference list
+ * \param ref A reference to the object to be added to the soft reference list
+ */
+
+void gc_register_soft_ref(java_lang_ref_SoftReference_t *ref)
+{
+    tm_lock();
+    ref->next = heap.softref_list;
+    heap.softref_list = ref;
+    tm_unlock();
+} // gc_register_soft_ref()
+
+/** Returns the number of collections which happened so far, soft references
+ * record it when they are accessed so that the least recently used ones can
+ * be cleared first
+ * \returns The number of collections */
+
+uint32_t gc_collections( void )
+{
+    return heap.collections;
+} // gc_collections()
+
 /** Grow the heap by size bytes (if possible).
  *
  * A new chunk will be added to the chunk bin holding the new memory area
  * starting from \a end. \a end might be different from the current heap end so
- * that the last free chunk can be grown directly
+ * that the last free chunk can be grown directly. The memory past the end of
+ * the heap is always clear: it was never used, released to the operating system
+ * or cleared by the sweep before the heap was shrunk
  * \param end A pointer to the last free chunk of memory
  * \param size The amount of bytes to be added to the heap */
 
 void gc_grow(uintptr_t end, size_t size)
 {
-    if (heap.end + size > heap.perm) {
-        heap.end = heap.perm;
+    uintptr_t limit = heap.perm;
+
+#if JEL_LARGE_OBJECTS
+    // The large objects take their share of the maximum heap size
+    limit = (heap.perm - heap.end > heap.los.size)
+            ? heap.perm - heap.los.size : heap.end;
+#endif // JEL_LARGE_OBJECTS
+
+    if (heap.end + size > limit) {
+        heap.end = limit;
     } else {
         heap.end += size;
     }
@@ -477,6 +1185,95 @@ void gc_grow(uintptr_t end, size_t size)
     put_chunk(end, heap.end - end);
 } // gc_grow()
 
+#if HEAP_RELEASE
+
+/** Shrinks the heap if it has been underused for several collections in a row
+ * and returns the pages past its new end to the operating system. The heap is
+ * left twice as large as the live data so that it doesn't have to be grown
+ * again right away
+ * \param end The end of the last live object in the heap
+ * \param in_use The amount of memory in use
+ * \param size The size of the allocation which triggered the collection, the
+ * free space left at the end of the heap will be larger than this
+ * \returns The number of bytes removed from the heap */
+
+static size_t gc_shrink(uintptr_t end, size_t in_use, size_t size)
+{
+    uintptr_t new_end;
+    size_t released;
+
+    if (in_use >= heap.size / HEAP_SHRINK_FRACTION) {
+        heap.underused = 0;
+        return 0;
+    } else if (++heap.underused < HEAP_SHRINK_COLLECTIONS) {
+        return 0;
+    }
+
+    heap.underused = 0;
+    new_end = size_max(end + size + sizeof(jword_t),
+                       heap.start + size_max(in_use * 2, heap.min_size));
+    new_end = heap.start + size_ceil(new_end - heap.start, heap.page_size);
+
+    if (new_end >= heap.end) {
+        return 0;
+    }
+
+    released = heap.end - new_end;
+    gc_release(new_end, heap.end);
+    heap.end = new_end;
+    heap.size = heap.end - heap.start;
+
+#if JEL_PRINT
+    if (opts_get_print_memory()) {
+       fprintf(stderr, "GC HEAP SHRUNK size = %zu released = %zu\n",
+               heap.size, released);
+    }
+#endif // JEL_PRINT
+
+    return released;
+} // gc_shrink()
+
+/** Returns the pages of a free area of the heap and the corresponding part of
+ * the bitmaps to the operating system. The area must not hold any object, the
+ * pages will be committed again when they are touched
+ * \param start The first byte of the area
+ * \param end The first byte after the area */
+
+static void gc_release(uintptr_t start, uintptr_t end)
+{
+    uint8_t *bitmaps[HEAP_BITMAPS];
+    uintptr_t mask = heap.page_size - 1;
+    uintptr_t first, last;
+    size_t words = sizeof(jword_t) * 8; // Words covered by a bitmap byte
+    size_t i = 0;
+
+    first = (start + mask) & ~mask;
+    last = end & ~mask;
+
+    if (first < last) {
+        madvise((void *) first, last - first, MADV_DONTNEED);
+    }
+
+    bitmaps[i++] = heap.bitmap;
+#if JEL_MARK_BITMAP
+    bitmaps[i++] = heap.markmap;
+#endif // JEL_MARK_BITMAP
+
+    while (i-- > 0) {
+        first = (uintptr_t) bitmaps[i]
+                + size_ceil(start - heap.start, words) / words;
+        last = (uintptr_t) bitmaps[i] + (end - heap.start) / words;
+        first = (first + mask) & ~mask;
+        last &= ~mask;
+
+        if (first < last) {
+            madvise((void *) first, last - first, MADV_DONTNEED);
+        }
+    }
+} // gc_release()
+
+#endif // HEAP_RELEASE
+
 /** Launches the garbage collector on the provided heap structure
  * \param grow If non null, specifies the amount of bytes of the next
  * allocation, the heap will be grown after the collection to accomodate it if
@@ -484,35 +1281,117 @@ void gc_grow(uintptr_t end, size_t size)
 
 void gc_collect(size_t grow)
 {
+    gc_collect_soft(grow, SOFT_KEEP);
+} // gc_collect()
+
+/** Launches the garbage collector clearing the soft references according to
+ * the given policy, softly reachable objects are otherwise kept alive
+ * \param grow If non null, specifies the amount of bytes of the next
+ * allocation, see gc_collect()
+ * \param policy The policy used for clearing soft references */
+
+static void gc_collect_soft(size_t grow, soft_policy_t policy)
+{
+#if JEL_PRINT
+    uint64_t start;
+#endif // JEL_PRINT
+
     tm_lock();
 
 #if JEL_PRINT
     if (opts_get_print_memory()) {
        fprintf(stderr, "GARBAGE COLLECTION\n");
     }
+
+    start = get_time_usec();
 #endif // JEL_PRINT
 
     if (heap.collect != false) {
         tm_stop_the_world(); // Wait for all threads to stop
+#if JEL_CONCURRENT_GC
+        // The collector thread may be in the middle of a tracing slice
+        pthread_mutex_lock(&heap.mark_lock);
+#endif // JEL_CONCURRENT_GC
+        gc_free_retired();
 
         // Mark garbage collected objects
+#if JEL_INCREMENTAL_GC
+        /* Completes the current marking cycle if one is in progress, the roots
+         * are scanned again as they are not protected by the write barrier */
+        gc_marking = true;
         gc_mark();
+#   if JEL_CONCURRENT_GC
+        // The threads' SATB buffers have been flushed while marking the roots
+        gc_satb_drain();
+#   endif // JEL_CONCURRENT_GC
+        gc_drain(SIZE_MAX);
+
+        while (gc_mark_soft_refs(policy)) {
+            gc_drain(SIZE_MAX);
+        }
+
         gc_mark_finalizable();
+        gc_drain(SIZE_MAX);
+        gc_marking = false;
+#elif JEL_PARALLEL_GC
+        gc_mark_parallel(true);
 
-        // Mark and purge of non-garbage collected structures
-        gc_purge_weakref_list();
-        jsm_purge();
-        tm_purge();
-        gc_purge_bin();
+        while (gc_mark_soft_refs(policy)) {
+            gc_mark_parallel(false);
+        }
 
-        gc_sweep(grow);
-    } else {
-        gc_grow(heap.end, grow); // Just grow the heap
+        gc_mark_finalizable();
+        gc_mark_parallel(false);
+#elif !JEL_POINTER_REVERSAL
+        gc_mark();
+        gc_drain(SIZE_MAX);
+
+        while (gc_mark_soft_refs(policy)) {
+            gc_drain(SIZE_MAX);
+        }
+
+        gc_mark_finalizable();
+        gc_drain(SIZE_MAX);
+#else
+        gc_mark();
+
+        while (gc_mark_soft_refs(policy));
+
+        gc_mark_finalizable();
+#endif // JEL_INCREMENTAL_GC
+
+        // Mark and purge of non-garbage collected structures
+        gc_purge_weakref_list();
+        gc_purge_softref_list();
+        gc_purge_identity_hashes();
+        jsm_purge();
+        tm_purge();
+        gc_purge_bin();
+
+#if JEL_LARGE_OBJECTS
+        los_sweep();
+#endif // JEL_LARGE_OBJECTS
+        gc_sweep(grow);
+
+#if JEL_PRINT
+        gc_log_pause("collection", start);
+        gc_log_pauses();
+#   if JEL_LARGE_OBJECTS
+        los_log_stats();
+#   endif // JEL_LARGE_OBJECTS
+#endif // JEL_PRINT
+
+        heap.collections++;
+#if JEL_CONCURRENT_GC
+        pthread_mutex_unlock(&heap.mark_lock);
+#endif // JEL_CONCURRENT_GC
+    } else {
+        gc_grow(heap.end, grow); // Just grow the heap
     }
 
     // If a collection happened this will also restart the stopped threads
     tm_unlock();
-} // gc_collect()
+} // gc_collect_soft()
 
 /** Helper function used for implementing Runtime.freeMemory(), returns
  * the amount of free memory in bytes
@@ -554,9 +1433,23 @@ size_t gc_free_memory( void )
 
 size_t gc_total_memory( void )
 {
+#if JEL_LARGE_OBJECTS
+    return heap.size + heap.los.size;
+#else
     return heap.size;
+#endif // JEL_LARGE_OBJECTS
 } // gc_total_memory()
 
+/** Checks if an object survived the last marking phase, used for purging the
+ * structures holding weak references to Java objects
+ * \param ref A reference to a Java object
+ * \returns true if the object is marked, false otherwise */
+
+bool gc_is_marked(uintptr_t ref)
+{
+    return mark_get(ref);
+} // gc_is_marked()
+
 /** Check if a reference is a pointer and recursively gc_mark it if it is
  * \param ref A reference to a Java object */
 
@@ -570,6 +1463,13 @@ void gc_mark_potential(uintptr_t ref)
 
     // If it exceeds the heap bounds this is not a reference to a Java object
     if ((ref < heap.start) || (ref >= heap.end)) {
+#if JEL_LARGE_OBJECTS
+        // ...unless it points to a large object
+        if (los_find(ref) != NULL) {
+            gc_mark_reference(ref);
+        }
+#endif // JEL_LARGE_OBJECTS
+
         return;
     }
 
@@ -584,19 +1484,31 @@ void gc_mark_potential(uintptr_t ref)
     gc_mark_reference(ref);
 } // gc_mark_potential()
 
+#if !JEL_POINTER_REVERSAL
+
+/** Marks the object pointed by ref, the objects pointed by the references it
+ * contains will be marked when it is removed from the mark stack
+ * \param ref A reference to a Java object */
+
+void gc_mark_reference(uintptr_t ref)
+{
+    gc_grey(ref);
+} // gc_mark_reference()
+
+#else
+
 /** Marks the object pointed by ref and recursively all the objects
  * pointed by the references it contains
  * \param ref A reference to a Java object */
 
-#if !JEL_POINTER_REVERSAL
-
 void gc_mark_reference(uintptr_t ref)
 {
     class_t *cl;
-    header_t *header, *new_header;
-    uintptr_t *references;
-    uintptr_t new_ref;
+    uintptr_t prev, curr, tmp;
+    header_t *header, *tmp_header;
+    jword_t count;
     uint32_t ref_n;
+    bool ref_array;
 
     if (ref == JNULL) {
         return;
@@ -604,201 +1516,1583 @@ void gc_mark_reference(uintptr_t ref)
 
     header = (header_t *) ref;
 
-    if (!header_is_object(header)) {
+    if (!header_is_object(header) || header_is_marked(header)) {
         return;
     }
 
-    cl = header_get_class(header);
+    curr = ref;
+    prev = JNULL;
+
+    header = (header_t *) curr;
+    header_create_gc_counter(header);
+
+    while (1) {
+        cl = bcl_get_class_by_id(header_get_class_index(header));
+
+        if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
+            ref_array = true;
+            ref_n = ((array_t *) header)->length;
+        } else {
+            ref_array = false;
+            ref_n = class_get_ref_n(cl);
+        }
+
+        count = header_get_count(header, ref_array);
+
+        if (count < ref_n) {
+            // We're not done yet with the current object
+            tmp = *((uintptr_t *) curr - count - 1);
+
+            if (tmp == JNULL) {
+                // Null reference, skip to the next object
+                header_set_count(header, count + 1, ref_array);
+                continue;
+            }
+
+            tmp_header = (header_t *) tmp;
+
+            if (!header_is_marked(tmp_header)) {
+                /* This object is not marked, gc_mark it, push the previous
+                 * object and set this one as the current */
+                *((uintptr_t *) curr - count - 1) = prev;
+                prev = curr;
+                curr = tmp;
+                header = tmp_header;
+                header_create_gc_counter(header);
+                continue;
+            } else {
+                // This object has already been marked, skip to the next one
+                header_set_count(header, count + 1, ref_array);
+                continue;
+            }
+        } else {
+            // We're done with the current object, pop the previous
+            tmp = curr;
+            curr = prev;
+            header = (header_t *) curr;
+
+            // We returned to the root pointer, return to the caller
+            if (curr == JNULL) {
+                return;
+            }
+
+            cl = bcl_get_class_by_id(header_get_class_index(header));
+
+            if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
+                ref_array = true;
+            } else {
+                ref_array = false;
+            }
+
+            count = header_get_count(header, ref_array);
+            prev = *((uintptr_t *) curr - count - 1);
+            *((uintptr_t *) curr - count - 1) = tmp;
+            header_set_count(header, count + 1, ref_array);
+        }
+    }
+} // gc_mark_reference()
+
+#endif // !JEL_POINTER_REVERSAL
+
+#if JEL_INCREMENTAL_GC
+
+/** Marks a reference which is being handed to the application during an
+ * incremental marking cycle. Used by the write barrier and when reading
+ * weakly held references. With concurrent marking the reference is recorded
+ * in the SATB buffer of the current thread instead, it will be greyed by the
+ * collector thread
+ * \param ref A reference to a Java object */
+
+void gc_shade(uintptr_t ref)
+{
+#if JEL_CONCURRENT_GC
+    thread_t *self;
+    satb_buffer_t *buffer;
 
-    if (header_is_marked(header)) {
+    /* Marking can start only while all threads are stopped, so if it is not
+     * in progress there's nothing to record */
+    if ((ref == JNULL) || !gc_marking || mark_get(ref)) {
         return;
+    }
+
+    self = thread_self();
+    buffer = self->satb;
+
+    if ((buffer == NULL) || (buffer->used == SATB_BUFFER_ENTRIES)) {
+        buffer = gc_satb_swap(self);
+    }
+
+    if (buffer != NULL) {
+        buffer->refs[buffer->used++] = ref;
     } else {
-        header_set_mark(header);
+        // Out of memory for a new buffer, grey the object directly
+        pthread_mutex_lock(&heap.mark_lock);
+
+        if (gc_marking) {
+            gc_grey(ref);
+        }
+
+        pthread_mutex_unlock(&heap.mark_lock);
+    }
+#else
+    /* Marking can start only while all threads are stopped, so if it is not
+     * in progress there's no need to take the VM lock */
+    if ((ref == JNULL) || !gc_marking) {
+        return;
     }
 
-    if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
-        ref_n = array_get_ref_n((array_t *) header);
+    tm_lock();
+
+    if (gc_marking) {
+        gc_grey(ref);
+    }
+
+    tm_unlock();
+#endif // JEL_CONCURRENT_GC
+} // gc_shade()
+
+#if JEL_CONCURRENT_GC
+
+/** Hands over the SATB buffer of a thread to the collector. The thread must be
+ * the current one, be stopped at a safepoint or be exiting
+ * \param thread A pointer to a thread */
+
+void gc_satb_flush(thread_t *thread)
+{
+    satb_buffer_t *buffer = thread->satb;
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&heap.satb_lock);
+
+    if (buffer->used != 0) {
+        buffer->next = heap.satb_full;
+        heap.satb_full = buffer;
     } else {
-        ref_n = class_get_ref_n(cl);
+        buffer->next = heap.satb_free;
+        heap.satb_free = buffer;
     }
 
-    references = ((uintptr_t *) header) - ref_n;
+    pthread_mutex_unlock(&heap.satb_lock);
+    thread->satb = NULL;
+} // gc_satb_flush()
 
-    for (size_t i = 0; i < ref_n; i++) {
-        new_ref = references[i];
+/** Hands over the full SATB buffer of the current thread to the collector and
+ * provides it with an empty one
+ * \param thread A pointer to the current thread
+ * \returns A pointer to the new buffer, NULL if none could be allocated */
 
-        if (new_ref == JNULL) {
-            continue;
-        } else {
-            new_header = (header_t *) new_ref;
+static satb_buffer_t *gc_satb_swap(thread_t *thread)
+{
+    satb_buffer_t *buffer;
 
-            if (header_is_marked(new_header)) {
-                continue;
-            } else {
-                gc_mark_reference(new_ref);
-            }
+    gc_satb_flush(thread);
+    pthread_mutex_lock(&heap.satb_lock);
+    buffer = heap.satb_free;
+
+    if (buffer != NULL) {
+        heap.satb_free = buffer->next;
+    }
+
+    pthread_mutex_unlock(&heap.satb_lock);
+
+    if (buffer == NULL) {
+        buffer = malloc(sizeof(satb_buffer_t));
+    }
+
+    if (buffer != NULL) {
+        buffer->used = 0;
+    }
+
+    thread->satb = buffer;
+    return buffer;
+} // gc_satb_swap()
+
+/** Greys the references held in the SATB buffers handed over so far and puts
+ * the buffers back in the free list, the caller must hold the mark lock
+ * \returns The amount of work done */
+
+static size_t gc_satb_drain( void )
+{
+    satb_buffer_t *full, *last = NULL;
+    size_t work = 0;
+
+    pthread_mutex_lock(&heap.satb_lock);
+    full = heap.satb_full;
+    heap.satb_full = NULL;
+    pthread_mutex_unlock(&heap.satb_lock);
+
+    for (satb_buffer_t *curr = full; curr != NULL; curr = curr->next) {
+        for (size_t i = 0; i < curr->used; i++) {
+            gc_grey(curr->refs[i]);
         }
+
+        work += curr->used;
+        last = curr;
     }
-} // gc_mark_reference()
 
+    if (last != NULL) {
+        pthread_mutex_lock(&heap.satb_lock);
+        last->next = heap.satb_free;
+        heap.satb_free = full;
+        pthread_mutex_unlock(&heap.satb_lock);
+    }
+
+    return work;
+} // gc_satb_drain()
+
+/** Traces grey objects on the collector thread while the other threads keep
+ * running, the references recorded in the SATB buffers handed over so far are
+ * greyed first. The objects are marked atomically as the threads mark the ones
+ * they allocate at the same time. A mark stack overflow is left to the remark
+ * since finding the marked objects requires walking the heap with the world
+ * stopped. The caller must hold the mark lock
+ * \param budget The maximum amount of work to be done
+ * \returns true if no grey objects are left, false otherwise */
+
+static bool gc_trace(size_t budget)
+{
+    size_t work = gc_satb_drain();
+
+    while ((heap.mark_stack_used != 0) && (work < budget)) {
+        work += gc_scan(heap.mark_stack[--heap.mark_stack_used]);
+    }
+
+    return heap.mark_stack_used == 0;
+} // gc_trace()
+
+#endif // JEL_CONCURRENT_GC
+
+/** Accounts for a new allocation and starts a marking cycle or executes a
+ * marking step if enough memory was allocated since the last one. The number
+ * of bytes allocated between two steps is computed when a cycle starts so that
+ * marking is expected to terminate when half of the free memory has been used.
+ * When using concurrent marking the collector thread is woken up instead and
+ * the allocating threads never take part in marking
+ * \param size The size in bytes of the allocation */
+
+static void gc_increment(size_t size)
+{
+    size_t budget = opts_get_gc_pause_target();
+
+    if ((budget == 0) || !heap.collect) {
+        return;
+    }
+
+    heap.allocated += size;
+
+#if JEL_CONCURRENT_GC
+    if (!gc_marking && !heap.cycle_requested
+        && (heap.allocated >= heap.trigger))
+    {
+        heap.cycle_requested = true;
+        tm_gc_signal();
+    }
 #else
+    if (!gc_marking) {
+        if (heap.allocated >= heap.trigger) {
+            gc_start_marking();
+        }
+    } else {
+        heap.step_allocated += size;
 
-void gc_mark_reference(uintptr_t ref)
+        if (heap.step_allocated >= heap.step_quantum) {
+            heap.step_allocated = 0;
+            gc_step(budget);
+        }
+    }
+#endif // JEL_CONCURRENT_GC
+} // gc_increment()
+
+/** Starts a new marking cycle. The world is stopped only for marking the
+ * roots, the objects they reference are traced by the following steps */
+
+static void gc_start_marking( void )
 {
-    class_t *cl;
-    uintptr_t prev, curr, tmp;
-    header_t *header, *tmp_header;
-    jword_t count;
-    uint32_t ref_n;
-    bool ref_array;
+#if !JEL_CONCURRENT_GC
+    size_t steps, avail;
+#endif // !JEL_CONCURRENT_GC
+#if JEL_PRINT
+    uint64_t start = get_time_usec();
+#endif // JEL_PRINT
+
+    tm_stop_the_world();
+    gc_marking = true;
+    gc_mark();
+
+#if JEL_FINALIZER
+    // Objects waiting to be finalized are still reachable by the finalizer
+    for (finalizable_t *curr = heap.finalizing; curr; curr = curr->next) {
+        gc_grey(curr->ref);
+    }
+#endif // JEL_FINALIZER
+
+#if !JEL_CONCURRENT_GC
+    // Every step traces at most budget references, one per word at worst
+    steps = heap.live / (opts_get_gc_pause_target() * sizeof(uintptr_t)) + 1;
+    avail = (heap.size > heap.live + heap.allocated)
+           ? heap.size - heap.live - heap.allocated : 0;
+    heap.step_quantum = size_max(avail / (2 * steps), sizeof(jword_t));
+    heap.step_allocated = 0;
+
+#   if JEL_PRINT
+    if (opts_get_print_memory()) {
+        fprintf(stderr, "GC MARKING STARTED steps = %zu quantum = %zu\n",
+                steps, heap.step_quantum);
+    }
+#   endif // JEL_PRINT
+#endif // !JEL_CONCURRENT_GC
+
+#if JEL_PRINT
+    gc_log_pause("initial mark", start);
+#endif // JEL_PRINT
+} // gc_start_marking()
+
+#if JEL_CONCURRENT_GC
+
+/** Body of the collector thread, waits until a marking cycle is requested and
+ * then runs it. Only the initial root scan and the final remark take the VM
+ * lock and stop the world, in between the heap is traced without it while the
+ * other threads record the references they overwrite in their SATB buffers.
+ * The mark lock is released every time the number of references specified by
+ * the --gc-pause-target option has been traced. This function never throws
+ * and returns once the cycle is over */
+
+void gc_concurrent_mark( void )
+{
+    size_t budget = opts_get_gc_pause_target();
+    bool done = false;
+
+    tm_lock();
+
+    while (!heap.cycle_requested) {
+        tm_gc_wait();
+    }
+
+    heap.cycle_requested = false;
+
+    // A full collection might have happened in the meantime
+    if ((heap.allocated < heap.trigger) || gc_marking) {
+        tm_unlock();
+        return;
+    }
+
+    gc_start_marking();
+    tm_unlock(); // Restarts the world
+
+    /* The cycle may also be completed by a thread which ran out of memory
+     * between two slices. The collector holds no roots so it looks blocked to
+     * the other threads while tracing, a stop-the-world needs only wait for the
+     * current slice as it takes the mark lock after stopping the world */
+    while (!done) {
+        thread_may_block();
+        pthread_mutex_lock(&heap.mark_lock);
+        done = !gc_marking || gc_trace(budget);
+        pthread_mutex_unlock(&heap.mark_lock);
+        thread_resumes();
+
+        if (!done) {
+            thread_yield();
+        }
+    }
+
+    // Remark, the collection drains the SATB buffers with the world stopped
+    tm_lock();
+
+    if (gc_marking) {
+        gc_collect(0);
+    }
+
+    tm_unlock();
+} // gc_concurrent_mark()
+
+#endif // JEL_CONCURRENT_GC
+
+#if !JEL_CONCURRENT_GC
+
+/** Executes a marking step, if the mark stack is emptied the cycle is
+ * completed with a final collection
+ * \param budget The maximum number of references to be traced */
+
+static void gc_step(size_t budget)
+{
+    bool done;
+#if JEL_PRINT
+    uint64_t start = get_time_usec();
+#endif // JEL_PRINT
+
+    tm_stop_the_world();
+    done = gc_drain(budget);
+
+#if JEL_PRINT
+    gc_log_pause("marking step", start);
+#endif // JEL_PRINT
+
+    if (done) {
+        gc_collect(0);
+    }
+} // gc_step()
+
+#endif // !JEL_CONCURRENT_GC
+
+#endif // JEL_INCREMENTAL_GC
+
+#if !JEL_POINTER_REVERSAL
+
+/** Marks an object and pushes it on the mark stack. If the stack is full the
+ * object is left marked but unscanned and the overflow flag is raised, its
+ * children will be found by gc_rescan()
+ * \param ref A reference to a Java object */
+
+static void gc_grey(uintptr_t ref)
+{
+    header_t *header = (header_t *) ref;
+
+    if ((ref == JNULL) || !header_is_object(header) || mark_get(ref)) {
+        return;
+    }
+
+#if JEL_PARALLEL_GC
+    if (mark_try_set(ref)) {
+        gc_worker_push(gc_worker_self(), ref);
+    }
+#else
+#   if JEL_CONCURRENT_GC
+    if (!mark_try_set(ref)) {
+        return;
+    }
+#   else
+    mark_set(ref);
+#   endif // JEL_CONCURRENT_GC
+
+    if (heap.mark_stack_used < heap.mark_stack_size) {
+        heap.mark_stack[heap.mark_stack_used++] = ref;
+    } else {
+        heap.mark_overflow = true;
+    }
+#endif // JEL_PARALLEL_GC
+} // gc_grey()
+
+/** Greys all the objects referenced by a marked object. The headers of the
+ * children are prefetched a few references ahead of the one being greyed so
+ * that scanning large arrays is not dominated by cache misses
+ * \param ref A reference to a marked Java object
+ * \returns The amount of work done, i.e. the number of slots scanned */
+
+static size_t gc_scan(uintptr_t ref)
+{
+    header_t *header = (header_t *) ref;
+    class_t *cl = header_get_class(header);
+    jref_t *references;
+    uint32_t ref_n;
+
+    if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
+        ref_n = array_get_ref_n((array_t *) header);
+    } else {
+        ref_n = class_get_ref_n(cl);
+    }
+
+    references = ((jref_t *) header) - ref_n;
+
+    for (size_t i = 0; (i < MARK_PREFETCH_DISTANCE) && (i < ref_n); i++) {
+        mark_prefetch(gc_ref_load(references + i));
+    }
+
+    for (size_t i = 0; i < ref_n; i++) {
+        if (i + MARK_PREFETCH_DISTANCE < ref_n) {
+            mark_prefetch(gc_ref_load(&references[i + MARK_PREFETCH_DISTANCE]));
+        }
+
+        gc_grey(gc_ref_load(references + i));
+    }
+
+    return ref_n + 1;
+} // gc_scan()
+
+/** Recovers from a mark stack overflow by scanning all the marked objects in
+ * the heap, the objects are found by walking the bitmap
+ * \returns The amount of work done */
+
+static size_t gc_rescan( void )
+{
+    size_t work = 0;
+    uintptr_t ref = bitmap_next(heap.start, heap.end);
+
+    while (ref < heap.end) {
+        if (header_is_object((header_t *) ref) && mark_get(ref)) {
+            work += gc_scan(ref);
+        }
+
+        ref = bitmap_next(ref + sizeof(jword_t), heap.end);
+    }
+
+#if JEL_LARGE_OBJECTS
+    for (size_t i = 0; i < heap.los.used; i++) {
+        ref = heap.los.objects[i]->ref;
+
+        if (mark_get(ref)) {
+            work += gc_scan(ref);
+        }
+    }
+#endif // JEL_LARGE_OBJECTS
+
+    return work;
+} // gc_rescan()
+
+#if !JEL_PARALLEL_GC
+
+/** Scans grey objects until the mark stack is empty or \a budget slots have
+ * been traced. If the stack overflowed the marked objects are found again by
+ * rescanning the heap once it has been emptied
+ * \param budget The maximum amount of work to be done
+ * \returns true if no grey objects are left, false otherwise */
+
+static bool gc_drain(size_t budget)
+{
+    size_t work = 0;
+
+    while (work < budget) {
+        if (heap.mark_stack_used != 0) {
+            work += gc_scan(heap.mark_stack[--heap.mark_stack_used]);
+        } else if (heap.mark_overflow) {
+            heap.mark_overflow = false;
+            work += gc_rescan();
+        } else {
+            return true;
+        }
+    }
+
+    return (heap.mark_stack_used == 0) && !heap.mark_overflow;
+} // gc_drain()
+
+#endif // !JEL_PARALLEL_GC
+
+#endif // !JEL_POINTER_REVERSAL
+
+#if JEL_PARALLEL_GC
+
+/** Initializes the marking threads, their deques are carved from the
+ * permanent allocation area
+ * \param heap_size The size of the heap in bytes */
+
+static void gc_workers_init(size_t heap_size)
+{
+    gc_worker_t *worker;
+    size_t n = opts_get_gc_threads();
+    size_t capacity;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (n == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif // _SC_NPROCESSORS_ONLN
+
+    n = (n == 0) ? 1 : ((n > GC_MAX_WORKERS) ? GC_MAX_WORKERS : n);
+    capacity = size_max(heap_size / MARK_STACK_FRACTION / sizeof(uintptr_t)
+                        / n, MARK_STACK_MIN_ENTRIES);
+
+    heap.perm -= size_ceil(n * sizeof(gc_worker_t), sizeof(jword_t));
+    workers.worker = (gc_worker_t *) heap.perm;
+    workers.n = n;
+    workers.phase = 0;
+    workers.roots = false;
+    workers.running = 0;
+    workers.idle = 0;
+    pthread_mutex_init(&workers.lock, NULL);
+    pthread_cond_init(&workers.start, NULL);
+    pthread_cond_init(&workers.done, NULL);
+
+#if !defined(TLS)
+    pthread_key_create(&gc_worker_key, NULL);
+#endif // !defined(TLS)
+
+    for (size_t i = 0; i < n; i++) {
+        worker = workers.worker + i;
+        heap.perm -= size_ceil(capacity * sizeof(uintptr_t), sizeof(jword_t));
+        worker->id = i;
+        worker->deque = (uintptr_t *) heap.perm;
+        worker->capacity = capacity;
+        worker->head = 0;
+        worker->count = 0;
+        worker->local_used = 0;
+        pthread_mutex_init(&worker->lock, NULL);
+
+        // The collector acts as the first worker
+        if ((i != 0) && pthread_create(&worker->thread, NULL, gc_worker_main,
+                                       worker))
+        {
+            dbg_error("Unable to create a marking thread");
+            vm_fail();
+        }
+    }
+} // gc_workers_init()
+
+/** Entry point of the marking threads, waits for a marking phase to begin
+ * and takes part in it
+ * \param arg A pointer to the worker structure of this thread
+ * \returns Never returns */
+
+static void *gc_worker_main(void *arg)
+{
+    gc_worker_t *worker = (gc_worker_t *) arg;
+    unsigned int phase = 0;
+
+    native_key_set(&gc_worker_key, worker);
+
+    while (true) {
+        pthread_mutex_lock(&workers.lock);
+
+        while (workers.phase == phase) {
+            pthread_cond_wait(&workers.start, &workers.lock);
+        }
+
+        phase = workers.phase;
+        pthread_mutex_unlock(&workers.lock);
+
+        gc_worker_mark(worker);
+
+        pthread_mutex_lock(&workers.lock);
+
+        if (--workers.running == 0) {
+            pthread_cond_signal(&workers.done);
+        }
+
+        pthread_mutex_unlock(&workers.lock);
+    }
+
+    return NULL;
+} // gc_worker_main()
+
+/** Executes a marking phase on a worker, first the worker's partition of the
+ * roots is scanned if needed, then grey objects are traced until no work is
+ * left for any worker
+ * \param worker A pointer to the worker */
+
+static void gc_worker_mark(gc_worker_t *worker)
+{
+    uintptr_t ref;
+
+    if (workers.roots) {
+        bcl_mark(worker->id, workers.n);
+        jsm_mark(worker->id, workers.n);
+        tm_mark(worker->id, workers.n);
+    }
+
+    do {
+        while (gc_worker_pop(worker, &ref)
+               || (gc_worker_steal(worker) && gc_worker_pop(worker, &ref)))
+        {
+            gc_scan(ref);
+        }
+    } while (!gc_worker_terminate());
+} // gc_worker_mark()
+
+/** Returns the worker associated with the calling thread
+ * \returns A pointer to a worker */
+
+static gc_worker_t *gc_worker_self( void )
+{
+    gc_worker_t *worker = native_key_get(gc_worker_key);
+
+    return (worker != NULL) ? worker : workers.worker;
+} // gc_worker_self()
+
+/** Pushes a grey object on the private stack of a worker, if the stack is full
+ * its older half is moved to the shared deque
+ * \param worker A pointer to the worker
+ * \param ref A reference to a marked Java object */
+
+static void gc_worker_push(gc_worker_t *worker, uintptr_t ref)
+{
+    size_t half = GC_WORKER_LOCAL / 2;
+
+    if (worker->local_used == GC_WORKER_LOCAL) {
+        pthread_mutex_lock(&worker->lock);
+
+        for (size_t i = 0; i < half; i++) {
+            if (worker->count == worker->capacity) {
+                // The object stays marked, gc_rescan() will find it
+                heap.mark_overflow = true;
+            } else {
+                worker->deque[(worker->head + worker->count)
+                              % worker->capacity] = worker->local[i];
+                worker->count++;
+            }
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+        memmove(worker->local, worker->local + half,
+                (GC_WORKER_LOCAL - half) * sizeof(uintptr_t));
+        worker->local_used -= half;
+    }
+
+    worker->local[worker->local_used++] = ref;
+} // gc_worker_push()
+
+/** Pops a grey object from the private stack of a worker, refilling it from
+ * the worker's deque if it is empty
+ * \param worker A pointer to the worker
+ * \param ref Filled with a reference to a grey object
+ * \returns true if an object was found, false otherwise */
+
+static bool gc_worker_pop(gc_worker_t *worker, uintptr_t *ref)
+{
+    size_t tail;
+
+    if ((worker->local_used == 0) && (worker->count != 0)) {
+        pthread_mutex_lock(&worker->lock);
+
+        while ((worker->count != 0)
+               && (worker->local_used < GC_WORKER_LOCAL / 2))
+        {
+            worker->count--;
+            tail = (worker->head + worker->count) % worker->capacity;
+            worker->local[worker->local_used++] = worker->deque[tail];
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    if (worker->local_used == 0) {
+        return false;
+    }
+
+    *ref = worker->local[--worker->local_used];
+    return true;
+} // gc_worker_pop()
+
+/** Steals up to half of the grey objects from the deque of another worker and
+ * puts them in the private stack of the thief which must be empty
+ * \param thief A pointer to the worker looking for work
+ * \returns true if some objects were stolen, false otherwise */
+
+static bool gc_worker_steal(gc_worker_t *thief)
+{
+    gc_worker_t *victim;
+    size_t n;
+
+    for (size_t i = 1; i < workers.n; i++) {
+        victim = workers.worker + ((thief->id + i) % workers.n);
+
+        if (victim->count == 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&victim->lock);
+        n = (victim->count + 1) / 2;
+        n = (n > GC_WORKER_LOCAL) ? GC_WORKER_LOCAL : n;
+
+        for (size_t j = 0; j < n; j++) {
+            thief->local[j] = victim->deque[victim->head];
+            victim->head = (victim->head + 1) % victim->capacity;
+            victim->count--;
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+
+        if (n != 0) {
+            thief->local_used = n;
+            return true;
+        }
+    }
+
+    return false;
+} // gc_worker_steal()
+
+/** Termination protocol of a marking phase, called by a worker which ran out
+ * of work. The phase is over when all the workers are idle, since idle workers
+ * never push objects no work can be left at that point
+ * \returns true if the phase is over, false if some work became available */
+
+static bool gc_worker_terminate( void )
+{
+    __sync_fetch_and_add(&workers.idle, 1);
+
+    while (workers.idle != workers.n) {
+        for (size_t i = 0; i < workers.n; i++) {
+            if (workers.worker[i].count != 0) {
+                __sync_fetch_and_sub(&workers.idle, 1);
+                return false;
+            }
+        }
+
+        sched_yield();
+    }
+
+    return true;
+} // gc_worker_terminate()
+
+/** Runs marking phases on all the workers until every reachable object has
+ * been marked, the calling thread acts as the first worker. Overflowing
+ * objects are recovered with a serial heap scan followed by a new phase
+ * \param roots true if the roots must be scanned */
+
+static void gc_mark_parallel(bool roots)
+{
+    do {
+        if (heap.mark_overflow) {
+            heap.mark_overflow = false;
+            gc_rescan();
+        }
+
+        pthread_mutex_lock(&workers.lock);
+        workers.roots = roots;
+        workers.idle = 0;
+        workers.running = workers.n;
+        workers.phase++;
+        pthread_cond_broadcast(&workers.start);
+        pthread_mutex_unlock(&workers.lock);
+
+        gc_worker_mark(workers.worker);
+
+        pthread_mutex_lock(&workers.lock);
+        workers.running--;
+
+        while (workers.running != 0) {
+            pthread_cond_wait(&workers.done, &workers.lock);
+        }
+
+        pthread_mutex_unlock(&workers.lock);
+        roots = false;
+    } while (heap.mark_overflow);
+} // gc_mark_parallel()
+
+#endif // JEL_PARALLEL_GC
+
+#if JEL_PRINT
+
+/** Records the duration of a pause in the pause-time statistics and prints it
+ * if memory printing is enabled
+ * \param what A string describing the pause
+ * \param start The time at which the pause started (in microseconds) */
+
+static void gc_log_pause(const char *what, uint64_t start)
+{
+    uint64_t duration = get_time_usec() - start;
+    uint64_t ttsp = tm_take_ttsp();
+    size_t bucket = 0;
+
+    while ((bucket < PAUSE_BUCKETS - 1) && (duration >= (1ULL << bucket))) {
+        bucket++;
+    }
+
+    heap.pauses.count++;
+    heap.pauses.total += duration;
+    heap.pauses.histogram[bucket]++;
+
+    if (duration > heap.pauses.max) {
+        heap.pauses.max = duration;
+    }
+
+    heap.pauses.ttsp_total += ttsp;
+
+    if (ttsp > heap.pauses.ttsp_max) {
+        heap.pauses.ttsp_max = ttsp;
+    }
+
+    if (opts_get_print_memory()) {
+        fprintf(stderr, "GC PAUSE %s: %llu us (time to safepoint %llu us)\n",
+                what, (unsigned long long) duration, (unsigned long long) ttsp);
+    }
+} // gc_log_pause()
+
+/** Prints the pause-time distribution if memory printing is enabled */
+
+static void gc_log_pauses( void )
+{
+    if (!opts_get_print_memory() || (heap.pauses.count == 0)) {
+        return;
+    }
+
+    fprintf(stderr, "GC PAUSES count = %zu total = %llu us max = %llu us\n",
+            heap.pauses.count, (unsigned long long) heap.pauses.total,
+            (unsigned long long) heap.pauses.max);
+    fprintf(stderr, "GC SAFEPOINTS total = %llu us max = %llu us\n",
+            (unsigned long long) heap.pauses.ttsp_total,
+            (unsigned long long) heap.pauses.ttsp_max);
+
+    for (size_t i = 0; i < PAUSE_BUCKETS; i++) {
+        if (heap.pauses.histogram[i] != 0) {
+            fprintf(stderr, "GC PAUSES < %llu us: %zu\n", 1ULL << i,
+                    heap.pauses.histogram[i]);
+        }
+    }
+} // gc_log_pauses()
+
+#endif // JEL_PRINT
+
+/** Allocates a chunk of the specified size (in jwords) from the bin, calls the
+ * garbage collector if necessary and throws an exception if unable to satisfy
+ * the request. The returned memory will have already been cleared
+ * \param size The chunk size in jwords
+ * \returns A chunk of memory carved from the garbage collected heap */
+
+static uintptr_t gc_alloc(size_t size)
+{
+    uintptr_t ptr;
+
+#if JEL_INCREMENTAL_GC
+    gc_increment(size);
+#endif // JEL_INCREMENTAL_GC
+
+    ptr = get_chunk(size);
+
+    if (ptr == 0) {
+        // get_chunk() failed... collect and retry
+        gc_collect(size);
+        ptr = get_chunk(size);
+
+        /* Still no luck, clear the least recently used soft references and
+         * then all of them before giving up */
+        if ((ptr == 0) && (heap.softref_list != NULL)) {
+            gc_collect_soft(size, SOFT_CLEAR_LRU);
+            ptr = get_chunk(size);
+        }
+
+        if ((ptr == 0) && (heap.softref_list != NULL)) {
+            gc_collect_soft(size, SOFT_CLEAR_ALL);
+            ptr = get_chunk(size);
+        }
+
+        if (ptr == 0) {
+            dbg_error("Out of memory. Try giving the VM a larger heap with the"
+                      " --size <size_in_bytes> option.");
+            vm_fail();
+        }
+    }
+
+    /* Free memory is kept cleared by the sweep, only the words linking the
+     * chunk in the bin need to be wiped */
+    memset((jword_t *) ptr, 0, (size < sizeof(large_chunk_t))
+                               ? size : sizeof(large_chunk_t));
+
+#ifndef NDEBUG
+    for (size_t i = 0; i < size / sizeof(jword_t); i++) {
+        assert(((jword_t *) ptr)[i] == 0);
+    }
+#endif // !NDEBUG
+
+    return ptr;
+} // gc_alloc()
+
+/** Allocates the memory for a Java object and records its header in the
+ * bitmap. Large objects are placed in the large-object space instead
+ * \param size The size of the object in bytes
+ * \param offset The offset of the object header from the start of the object
+ * \returns A reference to the newly allocated, cleared object */
+
+static uintptr_t gc_alloc_object(size_t size, size_t offset)
+{
+    uintptr_t ptr;
+
+#if JEL_LARGE_OBJECTS
+    if (size >= heap.page_size * LARGE_OBJECT_PAGES) {
+        return los_alloc(size, offset);
+    }
+#endif // JEL_LARGE_OBJECTS
+
+    ptr = gc_alloc(size) + offset;
+    bitmap_set(ptr);
+    return ptr;
+} // gc_alloc_object()
+
+#if JEL_LARGE_OBJECTS
+
+/******************************************************************************
+ * Large-object space implementation                                          *
+ ******************************************************************************/
+
+/** Allocates an object in the large-object space. Every object is mapped
+ * separately and page-aligned so that its memory is returned to the operating
+ * system as soon as it is freed. The large objects share the reserved memory
+ * not yet used by the heap and the permanent area, a collection is triggered
+ * if the new object wouldn't fit or if as much memory as the heap holds was
+ * mapped since the last collection
+ * \param size The size of the object in bytes
+ * \param offset The offset of the object header from the start of the object
+ * \returns A reference to the newly allocated, cleared object */
+
+static uintptr_t los_alloc(size_t size, size_t offset)
+{
+    large_space_t *los = &heap.los;
+    large_object_t *block, **objects;
+    size_t block_size = size_ceil(LARGE_OBJECT_OFFSET + size, heap.page_size);
+    size_t low = 0, high = los->used, mid;
+    void *mem;
+
+#if JEL_INCREMENTAL_GC
+    gc_increment(size);
+#endif // JEL_INCREMENTAL_GC
+
+    if ((los->size + block_size > heap.perm - heap.end)
+        || (los->allocated + block_size > heap.size))
+    {
+        gc_collect(0);
+    }
+
+    // Clear the soft references if the collection did not free enough space
+    if ((los->size + block_size > heap.perm - heap.end)
+        && (heap.softref_list != NULL))
+    {
+        gc_collect_soft(0, SOFT_CLEAR_LRU);
+    }
+
+    if ((los->size + block_size > heap.perm - heap.end)
+        && (heap.softref_list != NULL))
+    {
+        gc_collect_soft(0, SOFT_CLEAR_ALL);
+    }
+
+    mem = MAP_FAILED;
+
+    if (los->size + block_size <= heap.perm - heap.end) {
+        mem = mmap(NULL, block_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (mem == MAP_FAILED) {
+        dbg_error("Out of memory. Try giving the VM a larger heap with the"
+                  " --size <size_in_bytes> option.");
+        vm_fail();
+    }
+
+    if (los->used == los->capacity) {
+        objects = realloc(los->objects, (los->capacity + LARGE_OBJECT_INC)
+                                        * sizeof(large_object_t *));
+
+        if (objects == NULL) {
+            dbg_error("Out of memory, cannot grow the large-object table.");
+            vm_fail();
+        }
+
+        los->objects = objects;
+        los->capacity += LARGE_OBJECT_INC;
+    }
+
+    block = (large_object_t *) mem;
+    block->size = block_size;
+    block->object_size = size;
+    block->ref = (uintptr_t) block + LARGE_OBJECT_OFFSET + offset;
+
+    // Keep the table sorted by address
+    while (low < high) {
+        mid = (low + high) / 2;
+
+        if (los->objects[mid] < block) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    memmove(los->objects + low + 1, los->objects + low,
+            (los->used - low) * sizeof(large_object_t *));
+    los->objects[low] = block;
+    los->used++;
+    los->size += block_size;
+    los->allocated += block_size;
+
+#if JEL_PRINT
+    los->live += size;
+    los->total_objects++;
+    los->total_size += size;
+    los->peak = size_max(los->peak, los->size);
+#endif // JEL_PRINT
+
+    return block->ref;
+} // los_alloc()
+
+/** Looks up a large object
+ * \param ref A potential reference to a large object
+ * \returns A pointer to the block holding the object or NULL if \a ref is not
+ * a reference to a large object */
+
+static large_object_t *los_find(uintptr_t ref)
+{
+    large_space_t *los = &heap.los;
+    size_t low = 0, high = los->used, mid;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+
+        if ((uintptr_t) los->objects[mid] <= ref) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if ((low > 0) && (los->objects[low - 1]->ref == ref)) {
+        return los->objects[low - 1];
+    }
+
+    return NULL;
+} // los_find()
+
+/** Sweeps the large-object space, the blocks of the dead objects are unmapped
+ * and the marks of the live ones cleared. Large objects always hold their
+ * mark in the header */
+
+static void los_sweep( void )
+{
+    large_space_t *los = &heap.los;
+    large_object_t *block;
+    header_t *header;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < los->used; i++) {
+        block = los->objects[i];
+        header = (header_t *) block->ref;
+
+        if (header_is_marked(header)) {
+#if JEL_POINTER_REVERSAL
+            header_restore(header,
+                           bcl_get_class_by_id(header_get_class_index(header)));
+#else
+            header_clear_mark(header);
+#endif // JEL_POINTER_REVERSAL
+            los->objects[kept++] = block;
+        } else {
+            los->size -= block->size;
+#if JEL_PRINT
+            los->live -= block->object_size;
+#endif // JEL_PRINT
+            munmap(block, block->size);
+        }
+    }
+
+    los->used = kept;
+    los->allocated = 0;
+} // los_sweep()
+
+#if JEL_PRINT
+
+/** Prints the statistics of the large-object space if memory printing is
+ * enabled, the size of the objects is the amount of memory kept out of the
+ * heap */
+
+static void los_log_stats( void )
+{
+    large_space_t *los = &heap.los;
+
+    if (!opts_get_print_memory()) {
+        return;
+    }
+
+    fprintf(stderr, "GC LARGE OBJECTS count = %zu size = %zu mapped = %zu "
+            "peak = %zu\n", los->used, los->live, los->size, los->peak);
+    fprintf(stderr, "GC LARGE OBJECTS allocated = %zu size = %llu\n",
+            los->total_objects, (unsigned long long) los->total_size);
+} // los_log_stats()
+
+#endif // JEL_PRINT
+
+#endif // JEL_LARGE_OBJECTS
+
+#if JEL_METADATA_ARENA
+
+/******************************************************************************
+ * Metadata arena implementation                                              *
+ ******************************************************************************/
+
+/** Obtains a new region for the metadata arena, the unused tail of the
+ * current region is split in blocks which are put in the free lists. The first
+ * word of every region links it to the previous one */
+
+static void arena_region( void )
+{
+    arena_t *arena = &heap.arena;
+    size_t rest = arena->limit - arena->top;
+    size_t size;
+    small_chunk_t *block;
+    uintptr_t region;
+
+    while (rest >= 2 * sizeof(jword_t)) {
+        size = (rest < ARENA_CLASSES * sizeof(jword_t))
+               ? rest : ARENA_CLASSES * sizeof(jword_t);
+        block = (small_chunk_t *) arena->top;
+        block->next = arena->free[size / sizeof(jword_t) - 1];
+        arena->free[size / sizeof(jword_t) - 1] = block;
+        arena->top += size;
+        rest -= size;
+    }
+
+    region = (uintptr_t) calloc(1, ARENA_REGION_SIZE);
+
+    if (region == 0) {
+        dbg_error("Out of memory, cannot grow the metadata arena.");
+        vm_fail();
+    }
+
+    *((uintptr_t *) region) = arena->region;
+    arena->region = region;
+    arena->top = region + size_ceil(sizeof(uintptr_t), sizeof(jword_t));
+    arena->limit = region + ARENA_REGION_SIZE;
+    arena->size += ARENA_REGION_SIZE;
+
+#if JEL_PRINT
+    if (opts_get_print_memory()) {
+       fprintf(stderr, "ARENA REGION: %p SIZE = %zu bytes\n", (void *) region,
+               arena->size);
+    }
+#endif // JEL_PRINT
+} // arena_region()
+
+/** Carves a block from the current region of the metadata arena. This serves
+ * the permanent allocations of gc_palloc(), which can have any size, and the
+ * size classes of arena_alloc() whose free list is empty. Permanent blocks too
+ * large to be carved efficiently are allocated directly from the system and,
+ * like all permanent blocks, are never released; arena_alloc() never passes
+ * such sizes as it handles the blocks above the size classes itself. The
+ * caller must hold the VM lock
+ * \param size The size of the block in bytes, a multiple of the jword size
+ * \returns A pointer to the cleared block */
+
+static uintptr_t arena_carve(size_t size)
+{
+    arena_t *arena = &heap.arena;
+    uintptr_t ptr;
+
+    // Only reached by gc_palloc(), see above
+    if (size > ARENA_CARVE_MAX) {
+        ptr = (uintptr_t) calloc(1, size);
+
+        if (ptr == 0) {
+            dbg_error("Out of memory, cannot grow the metadata arena.");
+            vm_fail();
+        }
+
+        return ptr;
+    }
+
+    if (arena->limit - arena->top < size) {
+        arena_region();
+    }
+
+    ptr = arena->top;
+    arena->top += size;
+    return ptr;
+} // arena_carve()
+
+/** Allocates a block from the metadata arena, the block is taken from the free
+ * list of its size class or carved from the current region if the list is
+ * empty. The caller must hold the VM lock
+ * \param size The size of the block in bytes including its header, a multiple
+ * of the jword size
+ * \returns A pointer to the cleared block */
+
+static uintptr_t arena_alloc(size_t size)
+{
+    arena_t *arena = &heap.arena;
+    size_t class = size / sizeof(jword_t) - 1;
+    small_chunk_t *block;
+    uintptr_t ptr;
+
+    if (class >= ARENA_CLASSES) {
+        ptr = (uintptr_t) calloc(1, size);
+
+        if (ptr == 0) {
+            dbg_error("Out of memory, cannot grow the metadata arena.");
+            vm_fail();
+        }
+    } else if (arena->free[class] != NULL) {
+        block = arena->free[class];
+        arena->free[class] = block->next;
+        ptr = (uintptr_t) block;
+        memset(block, 0, size);
+    } else {
+        ptr = arena_carve(size);
+    }
+
+    return ptr;
+} // arena_alloc()
+
+/** Returns a block to the metadata arena. The caller must hold the VM lock
+ * \param ptr A pointer to the block, its header holds the size */
+
+static void arena_free(uintptr_t ptr)
+{
+    arena_t *arena = &heap.arena;
+    size_t size = header_get_size((header_t *) ptr) + sizeof(header_t);
+    size_t class = size / sizeof(jword_t) - 1;
+    small_chunk_t *block = (small_chunk_t *) ptr;
+
+    if (class >= ARENA_CLASSES) {
+        free(block);
+    } else {
+        block->next = arena->free[class];
+        arena->free[class] = block;
+    }
+} // arena_free()
+
+#endif // JEL_METADATA_ARENA
+
+/******************************************************************************
+ * Identity hash codes implementation                                         *
+ ******************************************************************************/
+
+/** Returns the identity hash code of an object generating it if the object
+ * was never hashed before. The codes come from a xorshift generator so they
+ * are well distributed even for objects allocated one after the other.
+ * Objects which were already hashed are looked up without taking the VM lock:
+ * while other threads are running entries are only added, with their hash
+ * code set before their reference, and the slots are only ever replaced as a
+ * whole. Entries are removed only while the world is stopped
+ * \param ref A reference to a Java object
+ * \returns The identity hash code of the object, 0 for a null reference */
+
+int32_t gc_identity_hash(uintptr_t ref)
+{
+    idhash_slots_t *slots;
+    idhash_entry_t *entry;
+    size_t capacity;
+    uint32_t x;
+    int32_t hash;
+
+    if (ref == JNULL) {
+        return 0;
+    }
+
+    slots = *((idhash_slots_t *volatile *) &heap.idhash.slots);
+    memory_barrier();
+
+    if (slots != NULL) {
+        entry = idhash_lookup(slots, ref);
+
+        if (((volatile idhash_entry_t *) entry)->ref == ref) {
+            memory_barrier(); // Pairs with the one publishing the entry
+            return entry->hash;
+        }
+    }
+
+    tm_lock();
+    capacity = (heap.idhash.slots != NULL) ? heap.idhash.slots->capacity : 0;
+
+    if ((heap.idhash.used + 1) * 4 > capacity * 3) {
+        // Keep the load factor of the table below 3/4
+        idhash_rehash((capacity != 0) ? capacity * 2 : IDHASH_INITIAL_CAPACITY);
+    } else if ((heap.idhash.used < capacity / 4)
+               && (capacity > IDHASH_INITIAL_CAPACITY))
+    {
+        /* A collection might have purged many entries since the table was
+         * last resized, we don't shrink it in gc_purge_identity_hashes()
+         * because that function is called during a garbage collection */
+        while ((heap.idhash.used < capacity / 4)
+               && (capacity > IDHASH_INITIAL_CAPACITY))
+        {
+            capacity /= 2;
+        }
 
-    if (ref == JNULL) {
-        return;
+        idhash_rehash(capacity);
     }
 
-    header = (header_t *) ref;
+    entry = idhash_lookup(heap.idhash.slots, ref);
 
-    if (!header_is_object(header) || header_is_marked(header)) {
-        return;
+    if (entry->ref == JNULL) {
+        x = heap.idhash.state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        heap.idhash.state = x;
+
+        entry->hash = (int32_t) x;
+        memory_barrier(); // Publish the entry only once its code is set
+        entry->ref = ref;
+        heap.idhash.used++;
     }
 
-    curr = ref;
-    prev = JNULL;
+    hash = entry->hash;
+    tm_unlock();
 
-    header = (header_t *) curr;
-    header_create_gc_counter(header);
+    return hash;
+} // gc_identity_hash()
 
-    while (1) {
-        cl = bcl_get_class_by_id(header_get_class_index(header));
+/** Returns the slot where the lookup of an object in the identity hash table
+ * starts before it is reduced to the capacity of the table. The address of
+ * the object is used only for placing its entry, all of its bits are mixed so
+ * that objects allocated one after the other are spread over the table
+ * \param ref A reference to a Java object
+ * \returns The mixed address of the object */
 
-        if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
-            ref_array = true;
-            ref_n = ((array_t *) header)->length;
-        } else {
-            ref_array = false;
-            ref_n = class_get_ref_n(cl);
-        }
+static inline size_t idhash_slot(uintptr_t ref)
+{
+    uint64_t key = ref / sizeof(jword_t);
 
-        count = header_get_count(header, ref_array);
+    key ^= key >> 33;
+    key *= IDHASH_MIX1;
+    key ^= key >> 33;
+    key *= IDHASH_MIX2;
+    key ^= key >> 33;
 
-        if (count < ref_n) {
-            // We're not done yet with the current object
-            tmp = *((uintptr_t *) curr - count - 1);
+    return (size_t) key;
+} // idhash_slot()
 
-            if (tmp == JNULL) {
-                // Null reference, skip to the next object
-                header_set_count(header, count + 1, ref_array);
-                continue;
-            }
+/** Looks up an object in the identity hash table
+ * \param slots A pointer to the slots of the table
+ * \param ref A reference to a Java object
+ * \returns A pointer to the entry of the object or to the empty slot where it
+ * should be inserted */
 
-            tmp_header = (header_t *) tmp;
+static idhash_entry_t *idhash_lookup(idhash_slots_t *slots, uintptr_t ref)
+{
+    volatile idhash_entry_t *entries = slots->entry;
+    size_t mask = slots->capacity - 1;
+    size_t i = idhash_slot(ref) & mask;
+    uintptr_t curr;
+
+    // Entries may be added concurrently, read each reference only once
+    while (((curr = entries[i].ref) != JNULL) && (curr != ref)) {
+        i = (i + 1) & mask;
+    }
 
-            if (!header_is_marked(tmp_header)) {
-                /* This object is not marked, gc_mark it, push the previous
-                 * object and set this one as the current */
-                *((uintptr_t *) curr - count - 1) = prev;
-                prev = curr;
-                curr = tmp;
-                header = tmp_header;
-                header_create_gc_counter(header);
-                continue;
-            } else {
-                // This object has already been marked, skip to the next one
-                header_set_count(header, count + 1, ref_array);
-                continue;
-            }
-        } else {
-            // We're done with the current object, pop the previous
-            tmp = curr;
-            curr = prev;
-            header = (header_t *) curr;
+    return slots->entry + i;
+} // idhash_lookup()
 
-            // We returned to the root pointer, return to the caller
-            if (curr == JNULL) {
-                return;
+/** Moves the identity hash table to a new set of slots, used both for growing
+ * and shrinking it. The old slots might still be probed by lock-free lookups
+ * and are released at the next collection, the caller must hold the VM lock
+ * \param capacity The new number of slots, a power of two */
+
+static void idhash_rehash(size_t capacity)
+{
+    idhash_slots_t *slots, *old;
+
+    // A collection may happen here and purge the current slots
+    slots = gc_malloc(sizeof(idhash_slots_t)
+                      + capacity * sizeof(idhash_entry_t));
+    slots->capacity = capacity;
+    old = heap.idhash.slots;
+
+    if (old != NULL) {
+        for (size_t i = 0; i < old->capacity; i++) {
+            if (old->entry[i].ref != JNULL) {
+                *idhash_lookup(slots, old->entry[i].ref) = old->entry[i];
             }
+        }
+    }
 
-            cl = bcl_get_class_by_id(header_get_class_index(header));
+    memory_barrier(); // Publish the slots only once they are filled
+    heap.idhash.slots = slots;
+    gc_retire(old);
+} // idhash_rehash()
 
-            if (class_is_array(cl) && (cl->elem_type == PT_REFERENCE)) {
-                ref_array = true;
-            } else {
-                ref_array = false;
-            }
+/** Removes an entry from the identity hash table, the entries following it
+ * are moved back so that no lookup is broken by the empty slot. The world
+ * must be stopped
+ * \param i The index of the entry to be removed */
 
-            count = header_get_count(header, ref_array);
-            prev = *((uintptr_t *) curr - count - 1);
-            *((uintptr_t *) curr - count - 1) = tmp;
-            header_set_count(header, count + 1, ref_array);
+static void idhash_remove(size_t i)
+{
+    idhash_entry_t *entries = heap.idhash.slots->entry;
+    size_t mask = heap.idhash.slots->capacity - 1;
+    size_t j = i, k;
+
+    while (1) {
+        j = (j + 1) & mask;
+
+        if (entries[j].ref == JNULL) {
+            break;
+        }
+
+        /* The entry in slot j can fill the hole in slot i only if its home
+         * slot k does not lie cyclically in (i, j] */
+        k = idhash_slot(entries[j].ref) & mask;
+
+        if ((i <= j) ? ((k <= i) || (k > j)) : ((k <= i) && (k > j))) {
+            entries[i] = entries[j];
+            i = j;
         }
     }
-} // gc_mark_reference()
 
-#endif // !JEL_POINTER_REVERSAL
+    entries[i].ref = JNULL;
+    entries[i].hash = 0;
+    heap.idhash.used--;
+} // idhash_remove()
 
-/** Allocates a chunk of the specified size (in jwords) from the bin, calls the
- * garbage collector if necessary and throws an exception if unable to satisfy
- * the request. The returned memory will have already been cleared
- * \param size The chunk size in jwords
- * \returns A chunk of memory carved from the garbage collected heap */
+/** Purges the identity hash table by removing the entries of dead objects.
+ * When an entry is removed the slot is examined again as another entry may
+ * have been moved into it. The table is shrunk, if needed, the next time an
+ * object is hashed */
 
-static uintptr_t gc_alloc(size_t size)
+static void gc_purge_identity_hashes( void )
 {
-    uintptr_t ptr = get_chunk(size);
+    idhash_slots_t *slots = heap.idhash.slots;
+    idhash_entry_t *entry;
+    size_t i = 0;
 
-    if (ptr == 0) {
-        // get_chunk() failed... collect and retry
-        gc_collect(size);
-        ptr = get_chunk(size);
+    while ((slots != NULL) && (i < slots->capacity)) {
+        entry = slots->entry + i;
 
-        if (ptr == 0) {
-            dbg_error("Out of memory. Try giving the VM a larger heap with the"
-                      " --size <size_in_bytes> option.");
-            vm_fail();
+        if ((entry->ref != JNULL) && !mark_get(entry->ref)) {
+            idhash_remove(i);
+        } else {
+            i++;
         }
     }
-
-    memset((jword_t *) ptr, 0, size);
-    return ptr;
-} // gc_alloc()
+} // gc_purge_identity_hashes()
 
 /** Purges the free chunks bin
  *
- * This function also clears the free chunks left in the bin so that the
- * garbage collector can reclaim the space they hold and aggregate them with
- * other potentially free chunks surrounding them */
+ * The sweep phase rebuilds the bin from scratch aggregating the free chunks
+ * with the free space surrounding them. All free memory is kept cleared save
+ * for the words linking the chunks in the bin, these are wiped here so that
+ * the sweep only needs to clear the objects it reclaims */
 
 static void gc_purge_bin( void ) {
-    small_chunk_t *schunk;
-    large_chunk_t *lchunk;
-    char *free_space;
-    size_t free_size;
-
-    // Empty the fixed-size bins
+    small_chunk_t *schunk, *snext;
+    large_chunk_t *lchunk, *lnext;
 
     for (size_t i = 0; i < BIN_ENTRIES; i++) {
-        schunk = heap.bin[i];
-        heap.bin[i] = NULL;
-
-        while (schunk != NULL) {
-            free_space = (char *) schunk;
-            free_size = (i + 1) * sizeof(jword_t);
-            schunk = schunk->next;
-            memset(free_space, 0, free_size); // Clear the fred space
+        for (schunk = heap.bin[i]; schunk != NULL; schunk = snext) {
+            snext = schunk->next;
+            schunk->next = NULL;
         }
     }
 
-    // Empty the large bin
-    lchunk = heap.large_bin;
+    for (lchunk = heap.large_bin; lchunk != NULL; lchunk = lnext) {
+        lnext = lchunk->next;
+        lchunk->next = NULL;
+        lchunk->size = 0;
+    }
+
+    memset(heap.bin, 0, sizeof(small_chunk_t *) * BIN_ENTRIES);
     heap.large_bin = NULL;
+} // gc_purge_bin()
 
-    while (lchunk != NULL) {
-        free_space = (char *) lchunk;
-        free_size = lchunk->size;
-        lchunk = lchunk->next;
-        memset(free_space, 0, free_size); // Clear the fred space
+/** Clears an area of the heap, large areas are cleared with non-temporal
+ * stores as they will not be used until they are allocated again
+ * \param start The first byte of the area
+ * \param end The first byte after the area */
+
+static void gc_zero(uintptr_t start, uintptr_t end)
+{
+#if HEAP_ZERO_STREAM
+    __m128i zero;
+    uintptr_t first, last;
+
+    if (end - start >= ZERO_STREAM_SIZE) {
+        zero = _mm_setzero_si128();
+        first = (start + 63) & ~((uintptr_t) 63);
+        last = end & ~((uintptr_t) 63);
+        memset((void *) start, 0, first - start);
+
+        for (uintptr_t ptr = first; ptr < last; ptr += 64) {
+            _mm_stream_si128((__m128i *) ptr, zero);
+            _mm_stream_si128((__m128i *) (ptr + 16), zero);
+            _mm_stream_si128((__m128i *) (ptr + 32), zero);
+            _mm_stream_si128((__m128i *) (ptr + 48), zero);
+        }
+
+        memset((void *) last, 0, end - last);
+        _mm_sfence();
+        return;
     }
-} // gc_purge_bin()
+#endif // HEAP_ZERO_STREAM
+
+    memset((void *) start, 0, end - start);
+} // gc_zero()
 
 /** Executes the 'gc_mark' phase of the garbage collector
  *
@@ -810,13 +3104,17 @@ static void gc_purge_bin( void ) {
  * the gc is thus completely self-contained and cannot fail due to a stack
  * overflow */
 
+#if !JEL_PARALLEL_GC
+
 static void gc_mark( void )
 {
-    bcl_mark();
-    jsm_mark();
-    tm_mark();
+    bcl_mark(0, 1);
+    jsm_mark(0, 1);
+    tm_mark(0, 1);
 } // gc_mark()
 
+#endif // !JEL_PARALLEL_GC
+
 /** After the gc_mark phase executed checks the finalizable obejcts. The ones which
  * haven't been marked and thus are dead are 'resurrected' by marking them and
  * moved to the list of objects to be finalized. Once the finalizer thread has
@@ -831,7 +3129,7 @@ static void gc_mark_finalizable( void )
     finalizable_t *next;
 
     while (curr != NULL) {
-        if (!header_is_marked((header_t *) (curr->ref))) {
+        if (!mark_get(curr->ref)) {
             // Add the object to the queue of the objects being finalized
             next = curr->next;
             curr->next = heap.finalizing;
@@ -867,7 +3165,8 @@ static void gc_mark_finalizable( void )
 } // gc_mark_finalizable()
 
 /** Scans the heap for live objects and reclaims dead ones replenishing
- * the free list
+ * the free list. Objects are found by walking the bitmap so the free space
+ * between them is never touched
  * \param size The size of the allocation which triggered the collection, if
  * no chunk of free space larger or equal to this value is fred the heap must
  * be grown of at least this value */
@@ -876,9 +3175,11 @@ static void gc_sweep(size_t size)
 {
     class_t *cl;
     header_t *header;
-    uintptr_t scan = heap.start;
+    uintptr_t scan = bitmap_next(heap.start, heap.end);
     uintptr_t start; // Start of a new object
     uintptr_t end = heap.start; // End of the previous object
+    uintptr_t dead_start = heap.start; // Start of the dead objects to clear
+    uintptr_t dead_end = heap.start; // End of the dead objects to clear
     size_t reclaimed = 0;
     size_t in_use = 0;
     size_t max_size = 0;
@@ -889,16 +3190,6 @@ static void gc_sweep(size_t size)
 #endif // JEL_POINTER_REVERSAL
 
     while (scan < heap.end) {
-        if ((*((uintptr_t *) scan) & ((1 << HEADER_RESERVED) - 1)) == 0) {
-            scan += sizeof(jword_t);
-
-            if (scan >= heap.end) {
-                break;
-            } else {
-                continue;
-            }
-        }
-
         header = (header_t *) scan; // We found a header
 
         if (header_is_object(header)) {
@@ -929,16 +3220,25 @@ static void gc_sweep(size_t size)
         }
 
         nref_size = size_ceil(nref_size, sizeof(jword_t));
-#if SIZEOF_VOID_P == (SIZEOF_JWORD_T / 2)
-        ref_n = size_ceil(ref_n, 2);
-#endif // SIZEOF_VOID_P == (SIZEOF_JWORD_T / 2)
+#if SIZEOF_JREF_T < SIZEOF_JWORD_T
+        ref_n = size_ceil(ref_n, SIZEOF_JWORD_T / SIZEOF_JREF_T);
+#endif // SIZEOF_JREF_T < SIZEOF_JWORD_T
 
+#if JEL_MARK_BITMAP
+        // C objects are always alive until they're explicitely fred
+        if (!is_java || mark_get(scan)) {
+#else
         if (header_is_marked(header)) {
             if (is_java) {
                 header_clear_mark(header);
             }
+#endif // JEL_MARK_BITMAP
 
-            start = scan - ref_n * sizeof(uintptr_t);
+            start = scan - ref_n * sizeof(jref_t);
+
+            // Clear the dead objects before linking them in the bin
+            gc_zero(dead_start, dead_end);
+            dead_start = dead_end;
 
             /* If there was some free space between the previous object and
              * this one reclaim it */
@@ -954,15 +3254,34 @@ static void gc_sweep(size_t size)
             // Skip to the next object
             scan += sizeof(header_t) + nref_size;
             end = scan;
-            in_use += ref_n * sizeof(uintptr_t) + sizeof(header_t) + nref_size;
+            in_use += ref_n * sizeof(jref_t) + sizeof(header_t) + nref_size;
         } else {
-            // This is a dead object remove it from the bitmap
+            /* This is a dead object remove it from the bitmap, runs of
+             * adjacent dead objects are cleared at once */
             assert(header_is_object(header));
             bitmap_clear(scan);
+            start = scan - ref_n * sizeof(jref_t);
+
+            if (start != dead_end) {
+                gc_zero(dead_start, dead_end);
+                dead_start = start;
+            }
+
             scan += sizeof(header_t) + nref_size;
+            dead_end = scan;
         }
+
+        scan = bitmap_next(scan, heap.end);
     }
 
+    gc_zero(dead_start, dead_end);
+
+#if JEL_MARK_BITMAP
+    // Clear all the marks at once
+    memset(heap.markmap, 0,
+           size_div_inf((heap.end - heap.start) / sizeof(jword_t), 8));
+#endif // JEL_MARK_BITMAP
+
     if (heap.end - end > max_size) {
         max_size = heap.end - end;
     }
@@ -971,8 +3290,15 @@ static void gc_sweep(size_t size)
 
     // Check if we have fred enough memory, otherwise we grow the heap
     if ((max_size > size) && (reclaimed > in_use / 2)) {
+#if HEAP_RELEASE
+        reclaimed -= gc_shrink(end, in_use, size);
+#endif // HEAP_RELEASE
         put_chunk(end, heap.end - end);
     } else {
+#if HEAP_RELEASE
+        heap.underused = 0;
+#endif // HEAP_RELEASE
+
         if (reclaimed < in_use / 2) {
             size = size_max(size, in_use / 2 - reclaimed);
             size = size_ceil(size, sizeof(jword_t));
@@ -981,6 +3307,13 @@ static void gc_sweep(size_t size)
         gc_grow(end, size);
     }
 
+#if JEL_INCREMENTAL_GC
+    // The next marking cycle starts when half of the free memory is used
+    heap.live = in_use;
+    heap.allocated = 0;
+    heap.trigger = (heap.size - in_use) / 2;
+#endif // JEL_INCREMENTAL_GC
+
 #if JEL_PRINT
     if (opts_get_print_memory()) {
        fprintf(stderr, "GARBAGE COLLECTION in_use = %zu reclaimed = %zu\n",
@@ -1010,7 +3343,12 @@ void *gc_malloc(size_t size)
 
     size = size_ceil(size, sizeof(jword_t)) + sizeof(header_t);
     tm_lock();
+#if JEL_METADATA_ARENA
+    ptr = arena_alloc(size);
+#else
     ptr = gc_alloc(size);
+    bitmap_set(ptr);
+#endif // JEL_METADATA_ARENA
     header = (header_t *) ptr;
     *header = header_create_c(size - sizeof(header_t));
 
@@ -1045,11 +3383,15 @@ void *gc_palloc(size_t size)
     size = size_ceil(size, sizeof(jword_t));
     tm_lock();
 
+#if JEL_METADATA_ARENA
+    ptr = arena_carve(size);
+#else
     if (heap.perm - size >= heap.end) {
         heap.perm -= size;
         ptr = heap.perm;
         memset((jword_t *) ptr, 0, size);
     }
+#endif // JEL_METADATA_ARENA
 
     tm_unlock();
 
@@ -1075,11 +3417,17 @@ void *gc_palloc(size_t size)
 
 void gc_free(void *ptr)
 {
+#if !JEL_METADATA_ARENA
+    size_t size;
+#endif // !JEL_METADATA_ARENA
+
     if (ptr == NULL) {
         return;
     }
 
+#if !JEL_METADATA_ARENA
     assert(((uintptr_t) ptr >= heap.start) && ((uintptr_t) ptr < heap.perm));
+#endif // !JEL_METADATA_ARENA
 
     tm_lock();
     header_t *header = (header_t *) ((uintptr_t) ptr - sizeof(header_t));
@@ -1091,10 +3439,60 @@ void gc_free(void *ptr)
     }
 #endif // JEL_VERBOSE_GC
 
-    put_chunk((uintptr_t) header, header_get_size(header) + sizeof(header_t));
+#if JEL_METADATA_ARENA
+    arena_free((uintptr_t) header);
+#else
+    size = header_get_size(header) + sizeof(header_t);
+    bitmap_clear((uintptr_t) header);
+    gc_zero((uintptr_t) header, (uintptr_t) header + size);
+    put_chunk((uintptr_t) header, size);
+#endif // JEL_METADATA_ARENA
     tm_unlock();
 } // gc_free()
 
+/** Frees a C object which other threads may still be reading without holding
+ * the VM lock, typically the old version of a table which has been replaced
+ * by a larger one. The object is actually freed at the next collection: once
+ * all threads have been stopped none can still hold a pointer to it
+ *
+ * If \a ptr is NULL no action is taken
+ *
+ * \param ptr A pointer to the object to be retired */
+
+void gc_retire(void *ptr)
+{
+    retired_t *retired;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    tm_lock();
+    retired = gc_malloc(sizeof(retired_t));
+    retired->ptr = ptr;
+    retired->next = heap.retired;
+    heap.retired = retired;
+    tm_unlock();
+} // gc_retire()
+
+/** Frees the objects retired with gc_retire(), this function must be called
+ * only when all the threads have been stopped */
+
+static void gc_free_retired( void )
+{
+    retired_t *retired = heap.retired;
+    retired_t *next;
+
+    heap.retired = NULL;
+
+    while (retired != NULL) {
+        next = retired->next;
+        gc_free(retired->ptr);
+        gc_free(retired);
+        retired = next;
+    }
+} // gc_free_retired()
+
 /** Purges the weak reference list by cleaning all the weak references
  * which point to weakly reachable (or non-reachable) objects and removing all
  * the non-reachable weak references */
@@ -1102,25 +3500,26 @@ void gc_free(void *ptr)
 static void gc_purge_weakref_list( void )
 {
     java_lang_ref_WeakReference_t *curr, *prev, list;
-    header_t *referent;
+    uintptr_t referent;
 
     prev = &list;
     prev->next = NULL;
     curr = heap.weakref_list;
 
     while (curr != NULL) {
-        if (header_is_marked(&(curr->header))) {
+        if (mark_get(JAVA_LANG_REF_WEAKREFERENCE_PTR2REF(curr))) {
             /*
              * This weak reference is marked, if the referent is marked too
              * we can leave it alone, otherwise the referent is only weakly
              * reacheable so we have to clear the weak reference pointing to it
              */
-            referent = (header_t *) curr->referent;
+            referent = gc_ref_load(&curr->referent);
 
-            if (!header_is_marked(referent)) {
-                curr->referent = JNULL;
+            if ((referent != JNULL) && !mark_get(referent)) {
+                gc_ref_store(&curr->referent, JNULL);
             }
 
+            prev->next = curr;
             prev = curr;
         } else {
             // This reference is not marked, remove it from the queue
@@ -1133,6 +3532,88 @@ static void gc_purge_weakref_list( void )
     heap.weakref_list = list.next;
 } // heap_purge_weakref_list()
 
+/** Marks the referents of the soft references which survived marking and must
+ * not be cleared according to \a policy. When clearing the least recently
+ * used references those which were not accessed in the most recent half of
+ * the age span of all soft references are left unmarked. Marking a referent
+ * may make more soft references reachable so the caller must drain the mark
+ * stack and call this function again until it returns false
+ * \param policy The policy used for clearing soft references
+ * \returns true if at least one referent was marked */
+
+static bool gc_mark_soft_refs(soft_policy_t policy)
+{
+    java_lang_ref_SoftReference_t *curr;
+    uintptr_t referent;
+    uint32_t age, max_age = 0;
+    bool marked = false;
+
+    if (policy == SOFT_CLEAR_ALL) {
+        return false;
+    }
+
+    if (policy == SOFT_CLEAR_LRU) {
+        for (curr = heap.softref_list; curr != NULL; curr = curr->next) {
+            age = heap.collections - curr->timestamp;
+            max_age = (age > max_age) ? age : max_age;
+        }
+
+        max_age /= 2;
+    } else {
+        max_age = UINT32_MAX;
+    }
+
+    for (curr = heap.softref_list; curr != NULL; curr = curr->next) {
+        if (!mark_get(JAVA_LANG_REF_SOFTREFERENCE_PTR2REF(curr))) {
+            continue;
+        }
+
+        referent = gc_ref_load(&curr->referent);
+
+        if ((referent != JNULL) && !mark_get(referent)
+            && (heap.collections - curr->timestamp <= max_age))
+        {
+            gc_mark_reference(referent);
+            marked = true;
+        }
+    }
+
+    return marked;
+} // gc_mark_soft_refs()
+
+/** Purges the soft reference list by clearing the soft references whose
+ * referents were not marked and removing the non-reachable soft references */
+
+static void gc_purge_softref_list( void )
+{
+    java_lang_ref_SoftReference_t *curr, *prev, list;
+    uintptr_t referent;
+
+    prev = &list;
+    prev->next = NULL;
+    curr = heap.softref_list;
+
+    while (curr != NULL) {
+        if (mark_get(JAVA_LANG_REF_SOFTREFERENCE_PTR2REF(curr))) {
+            referent = gc_ref_load(&curr->referent);
+
+            if ((referent != JNULL) && !mark_get(referent)) {
+                gc_ref_store(&curr->referent, JNULL);
+            }
+
+            prev->next = curr;
+            prev = curr;
+        } else {
+            // This reference is not marked, remove it from the list
+            prev->next = curr->next;
+        }
+
+        curr = curr->next;
+    }
+
+    heap.softref_list = list.next;
+} // gc_purge_softref_list()
+
 /** Set an entry in the bitmap to 1
  * \param ptr A pointer in the garbage collected heap */
 
@@ -1163,6 +3644,174 @@ static inline bool bitmap_get(uintptr_t ptr)
     return (heap.bitmap[offset >> 3] >> (offset & 0x7)) & 1;
 } // bitmap_get()
 
+/** Reads a word of the bitmap, bit n of the returned value corresponds to the
+ * n-th heap word covered by it regardless of the machine endianness
+ * \param index The index of the bitmap word
+ * \returns The requested bitmap word */
+
+static inline jword_t bitmap_load(size_t index)
+{
+#if WORDS_BIGENDIAN
+    const uint8_t *bytes = heap.bitmap + index * sizeof(jword_t);
+    jword_t word = 0;
+
+    for (size_t i = 0; i < sizeof(jword_t); i++) {
+        word |= (jword_t) bytes[i] << (i * 8);
+    }
+
+    return word;
+#else
+    return ((jword_t *) heap.bitmap)[index];
+#endif // WORDS_BIGENDIAN
+} // bitmap_load()
+
+/** Finds the first object header located at or after \a ptr. Empty areas of
+ * the bitmap are skipped one word at a time, each word covering 32 or 64
+ * words of the heap
+ * \param ptr A word-aligned pointer in the garbage collected heap
+ * \param limit The end of the area to be searched
+ * \returns A pointer to the next header or \a limit if none was found */
+
+static uintptr_t bitmap_next(uintptr_t ptr, uintptr_t limit)
+{
+    const size_t bits = sizeof(jword_t) * 8;
+    size_t offset = (ptr - heap.start) / sizeof(jword_t);
+    size_t last = (limit - heap.start) / sizeof(jword_t);
+    size_t index = offset / bits;
+    jword_t word;
+
+    if (offset >= last) {
+        return limit;
+    }
+
+    // Discard the bits preceding ptr in the first word
+    word = bitmap_load(index) & ((jword_t) ~0 << (offset % bits));
+
+    while (word == 0) {
+        index++;
+
+        if (index * bits >= last) {
+            return limit;
+        }
+
+        word = bitmap_load(index);
+    }
+
+#if HAVE___BUILTIN_CTZL
+    offset = index * bits + __builtin_ctzl(word);
+#else
+    offset = index * bits;
+
+    while ((word & 1) == 0) {
+        word >>= 1;
+        offset++;
+    }
+#endif // HAVE___BUILTIN_CTZL
+
+    return (offset < last) ? heap.start + offset * sizeof(jword_t) : limit;
+} // bitmap_next()
+
+#if JEL_MARK_BITMAP
+
+/** Checks if an object is marked
+ * \param ref A reference to a Java object
+ * \returns true if the object is marked, false otherwise */
+
+static inline bool mark_get(uintptr_t ref)
+{
+    uintptr_t offset = (ref - heap.start) / sizeof(jword_t);
+
+#if JEL_LARGE_OBJECTS
+    if (ref - heap.start >= heap.max_size) {
+        return header_is_marked((header_t *) ref); // Large object
+    }
+#endif // JEL_LARGE_OBJECTS
+
+    return (heap.markmap[offset >> 3] >> (offset & 0x7)) & 1;
+} // mark_get()
+
+/** Marks an object
+ * \param ref A reference to a Java object */
+
+static inline void mark_set(uintptr_t ref)
+{
+    uintptr_t offset = (ref - heap.start) / sizeof(jword_t);
+
+#if JEL_LARGE_OBJECTS
+    if (ref - heap.start >= heap.max_size) {
+        header_set_mark((header_t *) ref); // Large object
+        return;
+    }
+#endif // JEL_LARGE_OBJECTS
+
+#if JEL_CONCURRENT_GC
+    // The collector thread may be marking a neighbouring object
+    __sync_fetch_and_or(heap.markmap + (offset >> 3), 1 << (offset & 0x7));
+#else
+    heap.markmap[offset >> 3] |= 1 << (offset & 0x7);
+#endif // JEL_CONCURRENT_GC
+} // mark_set()
+
+#if JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+/** Atomically marks an object, used when multiple threads may try marking the
+ * same object
+ * \param ref A reference to a Java object
+ * \returns true if the object was marked by this call, false if it was already
+ * marked */
+
+static inline bool mark_try_set(uintptr_t ref)
+{
+    uintptr_t offset = (ref - heap.start) / sizeof(jword_t);
+    uint8_t bit = 1 << (offset & 0x7);
+
+#if JEL_LARGE_OBJECTS
+    if (ref - heap.start >= heap.max_size) {
+        return header_try_mark((header_t *) ref); // Large object
+    }
+#endif // JEL_LARGE_OBJECTS
+
+    return !(__sync_fetch_and_or(heap.markmap + (offset >> 3), bit) & bit);
+} // mark_try_set()
+
+#endif // JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+#else
+
+/** Checks if an object is marked
+ * \param ref A reference to a Java object
+ * \returns true if the object is marked, false otherwise */
+
+static inline bool mark_get(uintptr_t ref)
+{
+    return header_is_marked((header_t *) ref);
+} // mark_get()
+
+/** Marks an object
+ * \param ref A reference to a Java object */
+
+static inline void mark_set(uintptr_t ref)
+{
+    header_set_mark((header_t *) ref);
+} // mark_set()
+
+#if JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+/** Atomically marks an object, used when multiple threads may try marking the
+ * same object
+ * \param ref A reference to a Java object
+ * \returns true if the object was marked by this call, false if it was already
+ * marked */
+
+static inline bool mark_try_set(uintptr_t ref)
+{
+    return header_try_mark((header_t *) ref);
+} // mark_try_set()
+
+#endif // JEL_PARALLEL_GC || JEL_CONCURRENT_GC
+
+#endif // JEL_MARK_BITMAP
+
 /** Pulls a chunk from the bin
  * \param size The minimum size (in words) requested
  * \returns A chunk if one large enough is avaible, otherwise NULL */
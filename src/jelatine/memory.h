@@ -31,11 +31,25 @@
 
 #include "opcodes.h"
 #include "header.h"
+#include "java_lang_ref_SoftReference.h"
 #include "java_lang_ref_WeakReference.h"
 
 
 // Forward declarations
 struct class_t;
+struct thread_t;
+
+/******************************************************************************
+ * Globals                                                                    *
+ ******************************************************************************/
+
+#if JEL_INCREMENTAL_GC
+extern bool gc_marking;
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_COMPRESSED_REFS
+extern uintptr_t gc_ref_base;
+#endif // JEL_COMPRESSED_REFS
 
 /******************************************************************************
  * Function prototypes                                                        *
@@ -52,11 +66,23 @@ extern size_t gc_total_memory( void );
 // Managed allocations
 extern void gc_mark_potential(uintptr_t);
 extern void gc_mark_reference(uintptr_t);
+extern bool gc_is_marked(uintptr_t);
+extern int32_t gc_identity_hash(uintptr_t);
 extern uintptr_t gc_new(struct class_t *);
 extern uintptr_t gc_new_array_nonref(array_type_t, int32_t);
 extern uintptr_t gc_new_array_ref(struct class_t *, int32_t);
 extern uintptr_t gc_new_multiarray(struct class_t *, uint8_t, jword_t *);
 
+// Incremental marking
+#if JEL_INCREMENTAL_GC
+extern void gc_shade(uintptr_t);
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_CONCURRENT_GC
+extern void gc_concurrent_mark( void );
+extern void gc_satb_flush(struct thread_t *);
+#endif // JEL_CONCURRENT_GC
+
 // Finalization
 #if JEL_FINALIZER
 extern void gc_register_finalizer(uintptr_t);
@@ -66,10 +92,74 @@ extern uintptr_t gc_get_finalizable( void );
 
 // Special references
 extern void gc_register_weak_ref(java_lang_ref_WeakReference_t *);
+extern void gc_register_soft_ref(java_lang_ref_SoftReference_t *);
+extern uint32_t gc_collections( void );
 
 // Unmanaged allocations
 extern void *gc_malloc(size_t);
 extern void *gc_palloc(size_t);
 extern void gc_free(void *);
+extern void gc_retire(void *);
+
+/******************************************************************************
+ * Inlined functions                                                          *
+ ******************************************************************************/
+
+/** Loads a reference stored inside a Java object or array
+ * \param slot A pointer to the slot holding the reference
+ * \returns The reference held in the slot */
+
+static inline uintptr_t gc_ref_load(const jref_t *slot)
+{
+#if JEL_COMPRESSED_REFS
+    return (*slot == 0) ? JNULL
+                        : gc_ref_base + (uintptr_t) *slot * sizeof(jword_t);
+#else
+    return *slot;
+#endif // JEL_COMPRESSED_REFS
+} // gc_ref_load()
+
+/** Stores a reference inside a Java object or array, the write barrier must
+ * have already been invoked on the slot if needed
+ * \param slot A pointer to the slot which will hold the reference
+ * \param ref A reference to a Java object or JNULL */
+
+static inline void gc_ref_store(jref_t *slot, uintptr_t ref)
+{
+#if JEL_COMPRESSED_REFS
+    *slot = (ref == JNULL) ? 0
+                           : (jref_t) ((ref - gc_ref_base) / sizeof(jword_t));
+#else
+    *slot = ref;
+#endif // JEL_COMPRESSED_REFS
+} // gc_ref_store()
+
+#if !JEL_INCREMENTAL_GC
+
+/** Marks a reference which is being handed to the application during an
+ * incremental marking cycle, without incremental marking this is a no-op
+ * \param ref A reference to a Java object */
+
+static inline void gc_shade(uintptr_t ref)
+{
+} // gc_shade()
+
+#endif // !JEL_INCREMENTAL_GC
+
+/** Write barrier, must be invoked before overwriting a reference stored in a
+ * Java object. While an incremental marking cycle is in progress the object
+ * previously referenced by the slot is marked, or recorded in the thread's
+ * SATB buffer with concurrent marking, so that the snapshot of the heap taken
+ * at the beginning of the cycle is preserved
+ * \param slot A pointer to the reference about to be overwritten */
+
+static inline void gc_write_barrier(jref_t *slot)
+{
+#if JEL_INCREMENTAL_GC
+    if (gc_marking) {
+        gc_shade(gc_ref_load(slot));
+    }
+#endif // JEL_INCREMENTAL_GC
+} // gc_write_barrier()
 
 #endif // !JELATINE_MEMORY_H
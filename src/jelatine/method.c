@@ -64,9 +64,40 @@ method_t halt_method = {
     4, // code_length
     1, // exception_table_length
     halt_method_code, // code
-    { NULL } // handlers
+    { NULL }, // handlers
+#if JEL_PRECISE_GC
+    NULL // stack_map
+#endif // JEL_PRECISE_GC
 };
 
+#if JEL_SEGMENTED_STACKS
+
+/** Dummy variable used to hold the segment method's bytecode */
+static uint8_t segment_method_code[] = { WIDE, SEGMENT_RETURN };
+
+/** Segment method structure */
+
+method_t segment_method = {
+    "segment_method", // name
+    NULL, // descriptor
+    NULL, // cp
+    0, // access_flags
+    0, // args_size
+    0, // index
+    0, // max_stack
+    0, // max_locals
+    RET_VOID, // return_type
+    2, // code_length
+    0, // exception_table_length
+    segment_method_code, // code
+    { NULL }, // handlers
+#if JEL_PRECISE_GC
+    NULL // stack_map
+#endif // JEL_PRECISE_GC
+};
+
+#endif // JEL_SEGMENTED_STACKS
+
 /** Holds the dummy code of an abstract method */
 static uint8_t abstract_method_code[] = { WIDE, METHOD_ABSTRACT };
 
@@ -89,6 +120,9 @@ void init_dummy_methods( void )
     halt_exception_handler.catch_type = object;
     halt_method.cp = cp_create_dummy();
     halt_method.data.handlers = &halt_exception_handler;
+#if JEL_SEGMENTED_STACKS
+    segment_method.cp = cp_create_dummy();
+#endif // JEL_SEGMENTED_STACKS
 } // init_dummy_methods()
 
 /** Creates a method manager
@@ -517,6 +551,10 @@ void method_purge(method_t *method)
 {
     gc_free(method->code);
     gc_free(method->data.handlers);
+#if JEL_PRECISE_GC
+    gc_free(method->stack_map);
+    method->stack_map = NULL;
+#endif // JEL_PRECISE_GC
 } // method_purge()
 
 
@@ -35,6 +35,7 @@
 // Forward declarations
 
 struct class_t;
+struct stack_map_t;
 
 /******************************************************************************
  * Method type declarations                                                   *
@@ -112,6 +113,10 @@ struct method_t {
         long offset; ///< Offset in the class file of the method attributes
         native_proto_t function; ///< Native function if available
     } data; ///< Extra method data
+
+#if JEL_PRECISE_GC
+    struct stack_map_t *stack_map; ///< Reference maps, NULL if not linked
+#endif // JEL_PRECISE_GC
 };
 
 /** Typedef for struct method_t */
@@ -144,6 +149,17 @@ typedef struct method_manager_t method_manager_t;
 
 extern method_t halt_method;
 
+#if JEL_SEGMENTED_STACKS
+
+/** Dummy method of the link frame found at the end of every stack segment but
+ * the first one. The methods called at the beginning of a segment return to
+ * this method which moves their return value back to the previous segment,
+ * releases the current one and resumes the caller */
+
+extern method_t segment_method;
+
+#endif // JEL_SEGMENTED_STACKS
+
 /******************************************************************************
  * Function prototypes                                                        *
  ******************************************************************************/
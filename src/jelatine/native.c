@@ -27,6 +27,7 @@
 #include "jstring.h"
 #include "kni.h"
 #include "loader.h"
+#include "memory.h"
 #include "native.h"
 #include "thread.h"
 #include "utf8_string.h"
@@ -132,9 +133,18 @@ static KNI_RETURNTYPE_VOID java_lang_Thread_interrupt( void );
 // java.lang.Throwable methods
 static KNI_RETURNTYPE_VOID java_lang_Throwable_printStackTrace( void );
 
+// java.lang.ref.SoftReference methods
+static KNI_RETURNTYPE_VOID java_lang_ref_SoftReference_addToSoftReferenceList( void );
+static KNI_RETURNTYPE_INT java_lang_ref_SoftReference_collections( void );
+
 // java.lang.ref.WeakReference methods
 static KNI_RETURNTYPE_VOID java_lang_ref_WeakReference_addToWeakReferenceList( void );
 
+// jelatine.VMCollector methods
+#if JEL_CONCURRENT_GC
+static KNI_RETURNTYPE_VOID jelatine_VMCollector_collect( void );
+#endif // JEL_CONCURRENT_GC
+
 // jelatine.VMFinalizer methods
 #if JEL_FINALIZER
 static KNI_RETURNTYPE_OBJECT jelatine_VMFinalizer_getNextObject( void );
@@ -430,6 +440,20 @@ native_method_desc_t native_desc[] = {
         java_lang_Throwable_printStackTrace
     },
 
+    // java.lang.ref.SoftReference methods
+    {
+        "java/lang/ref/SoftReference",
+        "addToSoftReferenceList",
+        "(Ljava/lang/ref/SoftReference;)V",
+        java_lang_ref_SoftReference_addToSoftReferenceList
+    },
+    {
+        "java/lang/ref/SoftReference",
+        "collections",
+        "()I",
+        java_lang_ref_SoftReference_collections
+    },
+
     // java.lang.refWeakReference methods
     {
         "java/lang/ref/WeakReference",
@@ -439,6 +463,16 @@ native_method_desc_t native_desc[] = {
     },
 
 
+    // jelatine.VMCollector methods
+#if JEL_CONCURRENT_GC
+    {
+        "jelatine/VMCollector",
+        "collect",
+        "()V",
+        jelatine_VMCollector_collect
+    },
+#endif // JEL_CONCURRENT_GC
+
     // jelatine.VMFinalizer methods
 #if JEL_FINALIZER
     {
@@ -571,7 +605,8 @@ static KNI_RETURNTYPE_OBJECT java_lang_Class_forName( void )
     if (KNI_IsNullHandle(str_ref)) {
         KNI_ThrowNew("java/lang/NullPointerException", NULL);
     } else {
-        data = array_get_data(JAVA_LANG_STRING_REF2PTR(*str_ref)->value);
+        data = array_get_data((array_t *)
+                   gc_ref_load(&JAVA_LANG_STRING_REF2PTR(*str_ref)->value));
         data += JAVA_LANG_STRING_REF2PTR(*str_ref)->offset;
         length = JAVA_LANG_STRING_REF2PTR(*str_ref)->count;
         str = utf8_slashify(java_to_utf8(data, length));
@@ -919,7 +954,7 @@ static KNI_RETURNTYPE_VOID java_lang_Object_notifyAll( void )
 
     KNI_GetThisPointer(this_ref);
 
-    if (!thread_notify(*this_ref, false)) {
+    if (!thread_notify(*this_ref, true)) {
         KNI_ThrowNew("java/lang/IllegalMonitorStateException", NULL);
     }
 
@@ -944,6 +979,7 @@ static KNI_RETURNTYPE_VOID java_lang_Object__wait( void )
     KNI_GetThisPointer(this_ref);
     millis = KNI_GetParameterAsLong(1);
     nanos = KNI_GetParameterAsInt(3);
+    thread_may_unmount();
 
     if (!thread_wait(*this_ref, millis, nanos)) {
         KNI_ThrowNew("java/lang/IllegalMonitorStateException", NULL);
@@ -1122,7 +1158,7 @@ static KNI_RETURNTYPE_INT java_lang_System_identityHashCode( void )
     KNI_DeclareHandle(o_ref);
 
     KNI_GetParameterAsObject(1, o_ref);
-    hash = *o_ref / sizeof(uintptr_t);
+    hash = gc_identity_hash(*o_ref);
     KNI_EndHandles();
     KNI_ReturnInt(hash);
 } // java_lang_System_identityHashCode()
@@ -1155,6 +1191,7 @@ static KNI_RETURNTYPE_VOID java_lang_Thread_sleep( void )
     if (ms < 0) {
         KNI_ThrowNew("java/lang/IllegalArgumentException", NULL);
     } else {
+        thread_may_unmount();
         thread_sleep(ms);
     }
 
@@ -1175,7 +1212,11 @@ static KNI_RETURNTYPE_VOID java_lang_Thread_start( void )
     KNI_GetThisPointer(thread_ref);
     cl = header_get_class((header_t *) *thread_ref);
     run = mm_get(cl->method_manager, "run", "()V");
+#if JEL_GREEN_THREADS
+    thread_launch_virtual(thread_ref, run);
+#else
     thread_launch(thread_ref, run);
+#endif // JEL_GREEN_THREADS
     KNI_EndHandles();
 #endif // !JEL_THREAD_NONE
 
@@ -1198,6 +1239,7 @@ static KNI_RETURNTYPE_VOID java_lang_Thread_join( void )
     KNI_DeclareHandle(thread_ref);
 
     KNI_GetThisPointer(thread_ref);
+    thread_may_unmount();
     thread_join(thread_ref);
     KNI_EndHandles();
 #endif // !JEL_THREAD_NONE
@@ -1230,6 +1272,29 @@ static KNI_RETURNTYPE_VOID java_lang_Throwable_printStackTrace( void )
     KNI_ReturnVoid();
 } // java_lang_Throwable_printStackTrace()
 
+/** Implementation of java.lang.ref.SoftReference.addToSoftReferenceList() */
+
+static KNI_RETURNTYPE_VOID java_lang_ref_SoftReference_addToSoftReferenceList( void )
+{
+    java_lang_ref_SoftReference_t *sref;
+
+    KNI_StartHandles(1);
+    KNI_DeclareHandle(sref_ref);
+
+    KNI_GetParameterAsObject(1, sref_ref);
+    sref = JAVA_LANG_REF_SOFTREFERENCE_REF2PTR(*sref_ref);
+    gc_register_soft_ref(sref);
+    KNI_EndHandles();
+    KNI_ReturnVoid();
+} // java_lang_ref_SoftReference_addToSoftReferenceList()
+
+/** Implementation of java.lang.ref.SoftReference.collections() */
+
+static KNI_RETURNTYPE_INT java_lang_ref_SoftReference_collections( void )
+{
+    KNI_ReturnInt(gc_collections());
+} // java_lang_ref_SoftReference_collections()
+
 /** Implementation of java.lang.ref.WeakReference.addToWeakReferenceList() */
 
 static KNI_RETURNTYPE_VOID java_lang_ref_WeakReference_addToWeakReferenceList( void )
@@ -1246,6 +1311,18 @@ static KNI_RETURNTYPE_VOID java_lang_ref_WeakReference_addToWeakReferenceList( v
     KNI_ReturnVoid();
 } // java_lang_ref_WeakReference_addToWeakReferenceList()
 
+#if JEL_CONCURRENT_GC
+
+/** Implementation of jelatine.VMCollector.collect() */
+
+static KNI_RETURNTYPE_VOID jelatine_VMCollector_collect( void )
+{
+    gc_concurrent_mark();
+    KNI_ReturnVoid();
+} // jelatine_VMCollector_collect()
+
+#endif // JEL_CONCURRENT_GC
+
 #if JEL_FINALIZER
 
 /** Implementation of jelatine.VMFinalizer.getNextObject() */
@@ -1296,9 +1373,9 @@ static KNI_RETURNTYPE_BOOLEAN jelatine_VMResourceStream_open( void )
     rs = JELATINE_VMRESOURCESTREAM_REF2PTR(*rs_ref);
 
     // Get the resource name
-    *jstr_ref = rs->resource;
+    *jstr_ref = gc_ref_load(&rs->resource);
     jstr = JAVA_LANG_STRING_REF2PTR(*jstr_ref);
-    value_data = array_get_data(jstr->value);
+    value_data = array_get_data((array_t *) gc_ref_load(&jstr->value));
     str = java_to_utf8(value_data + jstr->offset, jstr->count);
 
     // Open the stream
@@ -1390,7 +1467,8 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_open( void )
         KNI_ThrowNew("java/lang/NullPointerException", NULL);
     } else {
         // Get hostname
-        uint16_t *data = array_get_data(JAVA_LANG_STRING_REF2PTR(*str_ref)->value);
+        uint16_t *data = array_get_data((array_t *)
+                   gc_ref_load(&JAVA_LANG_STRING_REF2PTR(*str_ref)->value));
         data += JAVA_LANG_STRING_REF2PTR(*str_ref)->offset;
         size_t length = JAVA_LANG_STRING_REF2PTR(*str_ref)->count;
         char *hostname = java_to_utf8(data, length);
@@ -1402,19 +1480,19 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_open( void )
             struct sockaddr_in name;
             name.sin_family = AF_INET;
             name.sin_port = htons(port);
-            thread_may_block();
+            thread_may_block_long();
             struct hostent *hostinfo = gethostbyname(hostname);
-            thread_resumes();
+            thread_resumes_long();
 
             if (hostinfo == NULL) {
                 KNI_ThrowNew("java/io/IOException", "Host can't be resolved");
                 sock = -1;
             } else {
                 name.sin_addr = *(struct in_addr *) hostinfo->h_addr;
-                thread_may_block();
+                thread_may_block_long();
                 res = connect(sock, (struct sockaddr *) &name,
                               sizeof(struct sockaddr_in));
-                thread_resumes();
+                thread_resumes_long();
 
                 if (res < 0)
                 {
@@ -1446,9 +1524,9 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_read( void )
     int sock = KNI_GetParameterAsInt(1);
     char b;
 
-    thread_may_block();
+    thread_may_block_long();
     ssize_t result = recv(sock, &b, 1, 0);
-    thread_resumes();
+    thread_resumes_long();
 
     if (result == 0) {
        KNI_ReturnInt(-1);
@@ -1484,9 +1562,9 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_readBuf( void )
         array = (array_t *) *src_ref;
         data = ((uint8_t *)array_get_data(array) + offset);
 
-        thread_may_block();
+        thread_may_block_long();
         result = recv(sock, data, len, 0);
-        thread_resumes();
+        thread_resumes_long();
 
         if (result == 0) {
             result = -1;
@@ -1507,9 +1585,9 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_write( void )
     int sock = KNI_GetParameterAsInt(1);
     uint8_t byte = KNI_GetParameterAsInt(2);
 
-    thread_may_block();
+    thread_may_block_long();
     ssize_t result = send(sock, &byte, 1, 0);
-    thread_resumes();
+    thread_resumes_long();
 
     if (result == 0) {
         result = -1;
@@ -1546,9 +1624,9 @@ static KNI_RETURNTYPE_INT jelatine_cldc_io_socket_ProtocolImpl_writeBuf( void )
         array = (array_t *) *src_ref;
         data = ((uint8_t *)array_get_data(array) + offset);
 
-        thread_may_block();
+        thread_may_block_long();
         result = send(sock, data, len, 0);
-        thread_resumes();
+        thread_resumes_long();
 
         if (result == 0) {
             result = -1;
@@ -312,7 +312,8 @@ enum internal_opcode_t {
     METHOD_LOAD = 201, ///< Loads a method code
     METHOD_ABSTRACT = 202, ///< Dummy opcode for triggering abstract method errors
     INVOKE_NATIVE = 203, ///< Invoke a native method
-    HALT = 204 ///< Halt the exection of the interpreter
+    HALT = 204, ///< Halt the exection of the interpreter
+    SEGMENT_RETURN = 205 ///< Return to the caller living in the previous stack segment
 };
 
 /** Typedef for enum internal_opcode_t */
@@ -25,6 +25,7 @@
 
 #include "class.h"
 #include "constantpool.h"
+#include "memory.h"
 #include "opcodes.h"
 #include "print.h"
 #include "thread.h"
@@ -817,7 +818,8 @@ void print_bytecode(thread_t *thread, const uint8_t *pc, const_pool_t *cp)
             if (cp_get_tag(cp, *(pc + 1)) == CONSTANT_Class) {
                 fprintf(stderr, "LDC_REF CONSTANT_Class ");
                 jclass = JAVA_LANG_CLASS_REF2PTR(ref);
-                jstring_print(JAVA_LANG_STRING_REF2PTR(jclass->name));
+                jstring = JAVA_LANG_STRING_REF2PTR(gc_ref_load(&jclass->name));
+                jstring_print(jstring);
             } else { // CONSTANT_String
                 fprintf(stderr, "LDC_REF CONSTANT_String ");
                 jstring = JAVA_LANG_STRING_REF2PTR(ref);
@@ -837,7 +839,8 @@ void print_bytecode(thread_t *thread, const uint8_t *pc, const_pool_t *cp)
             if (cp_get_tag(cp, load_uint16_un(pc + 1)) == CONSTANT_Class) {
                 fprintf(stderr, "LDC_REF CONSTANT_Class ");
                 jclass = JAVA_LANG_CLASS_REF2PTR(ref);
-                jstring_print(JAVA_LANG_STRING_REF2PTR(jclass->name));
+                jstring = JAVA_LANG_STRING_REF2PTR(gc_ref_load(&jclass->name));
+                jstring_print(jstring);
             } else { // CONSTANT_String
                 fprintf(stderr, "LDC_REF CONSTANT_String ");
                 jstring = JAVA_LANG_STRING_REF2PTR(ref);
@@ -1057,6 +1060,10 @@ void print_bytecode(thread_t *thread, const uint8_t *pc, const_pool_t *cp)
                     fprintf(stderr, "HALT\n");
                     break;
 
+                case SEGMENT_RETURN:
+                    fprintf(stderr, "SEGMENT_RETURN\n");
+                    break;
+
                 default:
                     dbg_unreachable();
             }
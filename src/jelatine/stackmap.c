@@ -0,0 +1,1427 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+/** \file stackmap.c
+ * Reference maps used for precise stack scanning, implementation
+ *
+ * The maps are computed when a method is linked by abstract interpretation of
+ * its translated bytecode. Every slot of the frame is tracked as holding either
+ * a reference or a primitive value, the states are merged at the entry of each
+ * basic block until a fixpoint is reached and a map is then emitted for every
+ * instruction which might stop the executing thread. Slots holding different
+ * kinds of values on different paths cannot be used by verified code and are
+ * treated as primitive values. */
+
+#include "wrappers.h"
+
+#include "class.h"
+#include "constantpool.h"
+#include "memory.h"
+#include "method.h"
+#include "opcodes.h"
+#include "stackmap.h"
+#include "util.h"
+
+#if JEL_PRECISE_GC
+
+/******************************************************************************
+ * Local declarations                                                         *
+ ******************************************************************************/
+
+/** The slot holds a reference */
+#define SM_REF (1)
+
+/** The slot holds a primitive value or has not been initialized */
+#define SM_VAL (2)
+
+/** The slot holds different kinds of values depending on the path taken, the
+ * result of merging an SM_REF and an SM_VAL state */
+#define SM_CONFLICT (SM_REF | SM_VAL)
+
+/** Holds the state of the abstract interpreter */
+
+struct sm_context_t {
+    const method_t *method; ///< The method being analyzed
+    const uint8_t *code; ///< The translated bytecode
+    exception_handler_t *handlers; ///< The method exception handlers
+    int32_t code_length; ///< Length of the bytecode
+    uint16_t max_locals; ///< Number of local variables
+    uint16_t max_stack; ///< Maximum depth of the operand stack
+    uint32_t width; ///< Slots in a frame, locals followed by the stack
+    uint32_t blocks; ///< Number of basic blocks
+    uint16_t *leaders; ///< Sorted PCs of the first instruction of each block
+    uint8_t *states; ///< Slot states at the entry of each block
+    int32_t *depths; ///< Stack depth at the entry of each block, -1 if unseen
+    bool *dirty; ///< Flags the blocks which need to be re-examined
+    bool changed; ///< Set when the state of any block changed
+    uint8_t *cur; ///< Slot states of the instruction being examined
+    int32_t sp; ///< Stack depth of the instruction being examined
+};
+
+/** Typedef for struct sm_context_t */
+typedef struct sm_context_t sm_context_t;
+
+/******************************************************************************
+ * Local function prototypes                                                  *
+ ******************************************************************************/
+
+static uint32_t sm_length(const uint8_t *, int32_t, int32_t);
+static uint16_t sm_index(const uint8_t *, int32_t);
+static bool sm_is_gc_point(const uint8_t *, int32_t);
+static void sm_find_leaders(sm_context_t *, uint32_t *);
+static void sm_set_leader(sm_context_t *, uint8_t *, int32_t);
+static uint32_t sm_find_block(const sm_context_t *, int32_t);
+static void sm_merge(sm_context_t *, int32_t, bool);
+static void sm_entry_state(sm_context_t *);
+static const char *sm_type(const char *, uint8_t *, uint32_t *);
+static void sm_push(sm_context_t *, uint8_t);
+static void sm_push_values(sm_context_t *, uint32_t);
+static void sm_pop(sm_context_t *, uint32_t);
+static uint8_t sm_peek(sm_context_t *, uint32_t);
+static void sm_load(sm_context_t *, uint32_t, uint32_t);
+static void sm_store(sm_context_t *, uint32_t, uint32_t);
+static void sm_field(sm_context_t *, uint16_t, bool, bool);
+static void sm_invoke(sm_context_t *, uint16_t, bool);
+static bool sm_step(sm_context_t *, int32_t);
+static void sm_simulate(sm_context_t *, uint32_t, stack_map_t *);
+
+/******************************************************************************
+ * Stack map implementation                                                   *
+ ******************************************************************************/
+
+/** Returns the length of a translated instruction
+ * \param code The method bytecode
+ * \param pc The PC of the instruction
+ * \param code_length The length of the bytecode
+ * \returns The length in bytes of the instruction */
+
+static uint32_t sm_length(const uint8_t *code, int32_t pc, int32_t code_length)
+{
+    int32_t aligned;
+
+    switch (code[pc]) {
+        case BIPUSH:
+        case LDC:
+        case LDC_PRELINK:
+        case ILOAD:
+        case LLOAD:
+        case FLOAD:
+        case DLOAD:
+        case ALOAD:
+        case ISTORE:
+        case LSTORE:
+        case FSTORE:
+        case DSTORE:
+        case ASTORE:
+        case NEWARRAY_PRELINK:
+            return 2;
+
+        case SIPUSH:
+        case LDC_W:
+        case LDC_W_PRELINK:
+        case LDC2_W:
+        case IINC:
+        case IFEQ:
+        case IFNE:
+        case IFLT:
+        case IFGE:
+        case IFGT:
+        case IFLE:
+        case IF_ICMPEQ:
+        case IF_ICMPNE:
+        case IF_ICMPLT:
+        case IF_ICMPGE:
+        case IF_ICMPGT:
+        case IF_ICMPLE:
+        case IF_ACMPEQ:
+        case IF_ACMPNE:
+        case GOTO:
+        case IFNULL:
+        case IFNONNULL:
+        case GETSTATIC_PRELINK:
+        case PUTSTATIC_PRELINK:
+        case GETFIELD_PRELINK:
+        case PUTFIELD_PRELINK:
+        case INVOKEVIRTUAL_PRELINK:
+        case INVOKESPECIAL_PRELINK:
+        case INVOKESTATIC_PRELINK:
+        case NEW_PRELINK:
+        case ANEWARRAY_PRELINK:
+        case CHECKCAST_PRELINK:
+        case INSTANCEOF_PRELINK:
+            return 3;
+
+        case MULTIANEWARRAY_PRELINK:
+            return 4;
+
+        case INVOKEINTERFACE_PRELINK:
+        case GOTO_W:
+            return 5;
+
+        case WIDE:
+            return (code[pc + 1] == IINC) ? 6 : 4;
+
+        case TABLESWITCH:
+            aligned = size_ceil(pc + 1, 4);
+            return aligned - pc + 12
+                   + 4 * (load_int32_un(code + aligned + 8)
+                          - load_int32_un(code + aligned + 4) + 1);
+
+        case LOOKUPSWITCH:
+            aligned = size_ceil(pc + 1, 4);
+            return aligned - pc + 8 + 8 * load_int32_un(code + aligned + 4);
+
+        default:
+            // Everything else including the opcodes added by the translator
+            return 1;
+    }
+} // sm_length()
+
+/** Reads the constant pool index of an instruction which hasn't been linked
+ * yet, the translator leaves these indexes in big-endian format
+ * \param code The method bytecode
+ * \param pc The PC of the instruction
+ * \returns The constant pool index */
+
+static uint16_t sm_index(const uint8_t *code, int32_t pc)
+{
+    return (code[pc + 1] << 8) | code[pc + 2];
+} // sm_index()
+
+/** Tells if the executing thread can be stopped by the collector while
+ * executing an instruction, either because it allocates memory, calls a
+ * method, blocks or throws an exception or because it is a safepoint polled by
+ * the interpreter: backward branches, switches and method returns
+ * \param code The method bytecode
+ * \param pc The PC of a translated instruction
+ * \returns true if the instruction needs a reference map, false otherwise */
+
+static bool sm_is_gc_point(const uint8_t *code, int32_t pc)
+{
+    switch (code[pc]) {
+        case IFEQ:
+        case IFNE:
+        case IFLT:
+        case IFGE:
+        case IFGT:
+        case IFLE:
+        case IF_ICMPEQ:
+        case IF_ICMPNE:
+        case IF_ICMPLT:
+        case IF_ICMPGE:
+        case IF_ICMPGT:
+        case IF_ICMPLE:
+        case IF_ACMPEQ:
+        case IF_ACMPNE:
+        case IFNULL:
+        case IFNONNULL:
+        case GOTO:
+            return load_int16_un(code + pc + 1) <= 0;
+
+        case GOTO_W:
+            return load_int32_un(code + pc + 1) <= 0;
+
+        case TABLESWITCH:
+        case LOOKUPSWITCH:
+        case IRETURN:
+        case LRETURN:
+        case FRETURN:
+        case DRETURN:
+        case ARETURN:
+        case RETURN:
+            return true;
+
+        case LDC_PRELINK:
+        case LDC_W_PRELINK:
+        case IALOAD:
+        case LALOAD:
+        case FALOAD:
+        case DALOAD:
+        case AALOAD:
+        case BALOAD:
+        case CALOAD:
+        case SALOAD:
+        case IASTORE:
+        case LASTORE:
+        case FASTORE:
+        case DASTORE:
+        case AASTORE:
+        case BASTORE:
+        case CASTORE:
+        case SASTORE:
+        case IDIV:
+        case LDIV:
+        case IREM:
+        case LREM:
+        case GETSTATIC_PRELINK:
+        case PUTSTATIC_PRELINK:
+        case GETFIELD_PRELINK:
+        case PUTFIELD_PRELINK:
+        case INVOKEVIRTUAL_PRELINK:
+        case INVOKESPECIAL_PRELINK:
+        case INVOKESTATIC_PRELINK:
+        case INVOKEINTERFACE_PRELINK:
+        case NEW_PRELINK:
+        case NEWARRAY_PRELINK:
+        case ANEWARRAY_PRELINK:
+        case MULTIANEWARRAY_PRELINK:
+        case ARRAYLENGTH:
+        case ATHROW:
+        case CHECKCAST_PRELINK:
+        case INSTANCEOF_PRELINK:
+        case MONITORENTER:
+        case MONITOREXIT:
+        case MONITORENTER_SPECIAL:
+        case MONITORENTER_SPECIAL_STATIC:
+        case IRETURN_MONITOREXIT:
+        case LRETURN_MONITOREXIT:
+        case FRETURN_MONITOREXIT:
+        case DRETURN_MONITOREXIT:
+        case ARETURN_MONITOREXIT:
+        case RETURN_MONITOREXIT:
+            return true;
+
+        default:
+            return false;
+    }
+} // sm_is_gc_point()
+
+/** Flags an instruction as the beginning of a basic block
+ * \param ctx The analysis context
+ * \param leaders The bitmap of the block leaders
+ * \param pc The PC of the instruction */
+
+static void sm_set_leader(sm_context_t *ctx, uint8_t *leaders, int32_t pc)
+{
+    if ((pc < 0) || (pc >= ctx->code_length)) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Jump instruction address outside of the code range");
+    }
+
+    leaders[pc / 8] |= 1 << (pc % 8);
+} // sm_set_leader()
+
+/** Finds the first instruction of every basic block of the method, the
+ * branch targets, the exception handlers and the instructions following a
+ * branch. Also counts the instructions which need a reference map
+ * \param ctx The analysis context
+ * \param gc_points Used to return the number of instructions needing a map */
+
+static void sm_find_leaders(sm_context_t *ctx, uint32_t *gc_points)
+{
+    const uint8_t *code = ctx->code;
+    uint8_t *leaders, *starts;
+    int32_t pc = 0, next, aligned, n;
+    uint32_t blocks = 0;
+    bool branch;
+
+    leaders = gc_malloc(size_div_inf(ctx->code_length, 8));
+    starts = gc_malloc(size_div_inf(ctx->code_length, 8));
+    *gc_points = 0;
+    sm_set_leader(ctx, leaders, 0);
+
+    for (size_t i = 0; i < ctx->method->exception_table_length; i++) {
+        sm_set_leader(ctx, leaders, ctx->handlers[i].handler_pc - code);
+    }
+
+    while (pc < ctx->code_length) {
+        starts[pc / 8] |= 1 << (pc % 8);
+        next = pc + sm_length(code, pc, ctx->code_length);
+        branch = true;
+
+        if (sm_is_gc_point(code, pc)) {
+            (*gc_points)++;
+        }
+
+        switch (code[pc]) {
+            case IFEQ:
+            case IFNE:
+            case IFLT:
+            case IFGE:
+            case IFGT:
+            case IFLE:
+            case IF_ICMPEQ:
+            case IF_ICMPNE:
+            case IF_ICMPLT:
+            case IF_ICMPGE:
+            case IF_ICMPGT:
+            case IF_ICMPLE:
+            case IF_ACMPEQ:
+            case IF_ACMPNE:
+            case IFNULL:
+            case IFNONNULL:
+            case GOTO:
+                sm_set_leader(ctx, leaders, pc + load_int16_un(code + pc + 1));
+                break;
+
+            case GOTO_W:
+                sm_set_leader(ctx, leaders, pc + load_int32_un(code + pc + 1));
+                break;
+
+            case TABLESWITCH:
+                aligned = size_ceil(pc + 1, 4);
+                sm_set_leader(ctx, leaders, pc + load_int32_un(code + aligned));
+                n = load_int32_un(code + aligned + 8)
+                    - load_int32_un(code + aligned + 4) + 1;
+
+                for (int32_t i = 0; i < n; i++) {
+                    sm_set_leader(ctx, leaders,
+                                  pc + load_int32_un(code + aligned + 12
+                                                     + (i * 4)));
+                }
+
+                break;
+
+            case LOOKUPSWITCH:
+                aligned = size_ceil(pc + 1, 4);
+                sm_set_leader(ctx, leaders, pc + load_int32_un(code + aligned));
+                n = load_int32_un(code + aligned + 4);
+
+                for (int32_t i = 0; i < n; i++) {
+                    sm_set_leader(ctx, leaders,
+                                  pc + load_int32_un(code + aligned + 12
+                                                     + (i * 8)));
+                }
+
+                break;
+
+            default:
+                branch = false;
+        }
+
+        // The instruction following a branch starts a new block
+        if (branch && (next < ctx->code_length)) {
+            sm_set_leader(ctx, leaders, next);
+        }
+
+        pc = next;
+    }
+
+    for (pc = 0; pc < ctx->code_length; pc++) {
+        if (leaders[pc / 8] & (1 << (pc % 8))) {
+            if (!(starts[pc / 8] & (1 << (pc % 8)))) {
+                c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                        "Jump instruction address in the middle of an "
+                        "instruction");
+            }
+
+            blocks++;
+        }
+    }
+
+    ctx->blocks = blocks;
+    ctx->leaders = gc_malloc(blocks * sizeof(uint16_t));
+    blocks = 0;
+
+    for (pc = 0; pc < ctx->code_length; pc++) {
+        if (leaders[pc / 8] & (1 << (pc % 8))) {
+            ctx->leaders[blocks++] = pc;
+        }
+    }
+
+    gc_free(starts);
+    gc_free(leaders);
+} // sm_find_leaders()
+
+/** Finds the basic block starting at the specified PC
+ * \param ctx The analysis context
+ * \param pc The PC of the first instruction of the block
+ * \returns The index of the block */
+
+static uint32_t sm_find_block(const sm_context_t *ctx, int32_t pc)
+{
+    uint32_t low = 0, high = ctx->blocks, mid;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+
+        if (ctx->leaders[mid] < pc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if ((low == ctx->blocks) || (ctx->leaders[low] != pc)) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Jump instruction address in the middle of an instruction");
+    }
+
+    return low;
+} // sm_find_block()
+
+/** Merges the current state in the entry state of a basic block, if the state
+ * of the block changes the block is flagged for re-examination
+ * \param ctx The analysis context
+ * \param pc The PC of the first instruction of the block
+ * \param handler true if the block is an exception handler, in this case the
+ * operand stack holds only the exception reference */
+
+static void sm_merge(sm_context_t *ctx, int32_t pc, bool handler)
+{
+    uint32_t block = sm_find_block(ctx, pc);
+    uint8_t *state = ctx->states + (block * ctx->width);
+    int32_t sp = handler ? 1 : ctx->sp;
+    bool seen = ctx->depths[block] >= 0;
+    bool changed = !seen;
+    uint8_t src;
+
+    if (sp > ctx->max_stack) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Operand stack overflow");
+    } else if (seen && (ctx->depths[block] != sp)) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Inconsistent operand stack depth");
+    }
+
+    for (uint32_t i = 0; i < (uint32_t) (ctx->max_locals + sp); i++) {
+        src = (handler && (i == ctx->max_locals)) ? SM_REF : ctx->cur[i];
+
+        if (!seen) {
+            state[i] = src;
+        } else if ((state[i] | src) != state[i]) {
+            state[i] |= src;
+            changed = true;
+        }
+    }
+
+    ctx->depths[block] = sp;
+
+    if (changed) {
+        ctx->dirty[block] = true;
+        ctx->changed = true;
+    }
+} // sm_merge()
+
+/** Parses a field type or a method argument type
+ * \param desc A pointer to the type descriptor
+ * \param state Used to return the state of the slots holding the value
+ * \param size Used to return the number of slots taken by the value
+ * \returns A pointer to the character following the type */
+
+static const char *sm_type(const char *desc, uint8_t *state, uint32_t *size)
+{
+    *state = SM_VAL;
+    *size = 1;
+
+    switch (*desc) {
+        case '[':
+            while (*desc == '[') {
+                desc++;
+            }
+
+            *state = SM_REF;
+
+            if (*desc != 'L') {
+                return (*desc != 0) ? desc + 1 : desc;
+            }
+
+            // FALLTHROUGH
+
+        case 'L':
+            *state = SM_REF;
+
+            while ((*desc != ';') && (*desc != 0)) {
+                desc++;
+            }
+
+            return (*desc != 0) ? desc + 1 : desc;
+
+        case 'J':
+        case 'D':
+            *size = 2;
+            return desc + 1;
+
+        case 'V':
+            *size = 0;
+            return desc + 1;
+
+        case 0:
+            c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Malformed descriptor");
+
+        default:
+            return desc + 1;
+    }
+} // sm_type()
+
+/** Sets up the state at the entry of the method from its descriptor, the
+ * locals not holding an argument are considered uninitialized
+ * \param ctx The analysis context */
+
+static void sm_entry_state(sm_context_t *ctx)
+{
+    const char *desc = ctx->method->descriptor + 1;
+    uint32_t local = 0, size;
+    uint8_t state;
+
+    memset(ctx->cur, SM_VAL, ctx->width);
+
+    if (!method_is_static(ctx->method)) {
+        ctx->cur[local++] = SM_REF;
+    }
+
+    while (*desc != ')') {
+        desc = sm_type(desc, &state, &size);
+
+        if (local + size > ctx->max_locals) {
+            c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                    "Method arguments exceed the number of locals");
+        }
+
+        memset(ctx->cur + local, state, size);
+        local += size;
+    }
+
+    ctx->sp = 0;
+} // sm_entry_state()
+
+/** Pushes a slot on the operand stack
+ * \param ctx The analysis context
+ * \param state The state of the pushed slot */
+
+static void sm_push(sm_context_t *ctx, uint8_t state)
+{
+    if (ctx->sp >= ctx->max_stack) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Operand stack overflow");
+    }
+
+    ctx->cur[ctx->max_locals + ctx->sp] = state;
+    ctx->sp++;
+} // sm_push()
+
+/** Pushes primitive values on the operand stack
+ * \param ctx The analysis context
+ * \param n The number of slots taken by the values */
+
+static void sm_push_values(sm_context_t *ctx, uint32_t n)
+{
+    while (n--) {
+        sm_push(ctx, SM_VAL);
+    }
+} // sm_push_values()
+
+/** Pops slots from the operand stack
+ * \param ctx The analysis context
+ * \param n The number of slots to be popped */
+
+static void sm_pop(sm_context_t *ctx, uint32_t n)
+{
+    if ((uint32_t) ctx->sp < n) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Operand stack underflow");
+    }
+
+    ctx->sp -= n;
+} // sm_pop()
+
+/** Reads a slot of the operand stack
+ * \param ctx The analysis context
+ * \param n The position of the slot, 0 being the top of the stack
+ * \returns The state of the slot */
+
+static uint8_t sm_peek(sm_context_t *ctx, uint32_t n)
+{
+    if ((uint32_t) ctx->sp <= n) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Operand stack underflow");
+    }
+
+    return ctx->cur[ctx->max_locals + ctx->sp - n - 1];
+} // sm_peek()
+
+/** Pushes the contents of one or more local variables on the stack
+ * \param ctx The analysis context
+ * \param index The index of the first local
+ * \param n The number of locals */
+
+static void sm_load(sm_context_t *ctx, uint32_t index, uint32_t n)
+{
+    if (index + n > ctx->max_locals) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Access to a non-existing local variable");
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        sm_push(ctx, ctx->cur[index + i]);
+    }
+} // sm_load()
+
+/** Pops the top of the stack in one or more local variables
+ * \param ctx The analysis context
+ * \param index The index of the first local
+ * \param n The number of locals */
+
+static void sm_store(sm_context_t *ctx, uint32_t index, uint32_t n)
+{
+    if (index + n > ctx->max_locals) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Access to a non-existing local variable");
+    }
+
+    sm_pop(ctx, n);
+    memcpy(ctx->cur + index, ctx->cur + ctx->max_locals + ctx->sp, n);
+} // sm_store()
+
+/** Applies the effect of a field access to the operand stack
+ * \param ctx The analysis context
+ * \param index The constant pool index of the field reference
+ * \param instance true for instance fields, false for static ones
+ * \param put true for PUTFIELD and PUTSTATIC, false for GETFIELD and
+ * GETSTATIC */
+
+static void sm_field(sm_context_t *ctx, uint16_t index, bool instance,
+                     bool put)
+{
+    uint8_t state;
+    uint32_t size;
+
+    sm_type(cp_get_ref_descriptor(ctx->method->cp, index), &state, &size);
+
+    if (put) {
+        sm_pop(ctx, size + (instance ? 1 : 0));
+    } else {
+        sm_pop(ctx, instance ? 1 : 0);
+
+        while (size--) {
+            sm_push(ctx, state);
+        }
+    }
+} // sm_field()
+
+/** Applies the effect of a method invocation to the operand stack
+ * \param ctx The analysis context
+ * \param index The constant pool index of the method reference
+ * \param instance true if the method has a receiver */
+
+static void sm_invoke(sm_context_t *ctx, uint16_t index, bool instance)
+{
+    const char *desc = cp_get_ref_descriptor(ctx->method->cp, index);
+    uint32_t args = instance ? 1 : 0, size;
+    uint8_t state;
+
+    if (*desc++ != '(') {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR, "Malformed method descriptor");
+    }
+
+    while (*desc != ')') {
+        desc = sm_type(desc, &state, &size);
+        args += size;
+    }
+
+    sm_pop(ctx, args);
+    sm_type(desc + 1, &state, &size);
+
+    while (size--) {
+        sm_push(ctx, state);
+    }
+} // sm_invoke()
+
+/** Applies the effect of an instruction to the current state and merges the
+ * resulting state in the blocks targeted by the instruction
+ * \param ctx The analysis context
+ * \param pc The PC of the instruction
+ * \returns true if the execution can continue with the next instruction, false
+ * otherwise */
+
+static bool sm_step(sm_context_t *ctx, int32_t pc)
+{
+    const uint8_t *code = ctx->code;
+    uint8_t a, b, c, d;
+    int32_t aligned, n;
+
+    switch (code[pc]) {
+        case NOP:
+        case IINC:
+        case CHECKCAST_PRELINK:
+        case MONITORENTER_SPECIAL:
+        case MONITORENTER_SPECIAL_STATIC:
+            break;
+
+        case ACONST_NULL:
+        case LDC_PRELINK:
+        case LDC_W_PRELINK:
+        case NEW_PRELINK:
+            sm_push(ctx, SM_REF);
+            break;
+
+        case ICONST_M1:
+        case ICONST_0:
+        case ICONST_1:
+        case ICONST_2:
+        case ICONST_3:
+        case ICONST_4:
+        case ICONST_5:
+        case FCONST_0:
+        case FCONST_1:
+        case FCONST_2:
+        case BIPUSH:
+        case SIPUSH:
+        case LDC:
+        case LDC_W:
+            sm_push_values(ctx, 1);
+            break;
+
+        case LCONST_0:
+        case LCONST_1:
+        case DCONST_0:
+        case DCONST_1:
+        case LDC2_W:
+            sm_push_values(ctx, 2);
+            break;
+
+        case ILOAD:
+        case FLOAD:
+        case ALOAD:
+            sm_load(ctx, code[pc + 1], 1);
+            break;
+
+        case LLOAD:
+        case DLOAD:
+            sm_load(ctx, code[pc + 1], 2);
+            break;
+
+        case ILOAD_0:
+        case ILOAD_1:
+        case ILOAD_2:
+        case ILOAD_3:
+            sm_load(ctx, code[pc] - ILOAD_0, 1);
+            break;
+
+        case LLOAD_0:
+        case LLOAD_1:
+        case LLOAD_2:
+        case LLOAD_3:
+            sm_load(ctx, code[pc] - LLOAD_0, 2);
+            break;
+
+        case FLOAD_0:
+        case FLOAD_1:
+        case FLOAD_2:
+        case FLOAD_3:
+            sm_load(ctx, code[pc] - FLOAD_0, 1);
+            break;
+
+        case DLOAD_0:
+        case DLOAD_1:
+        case DLOAD_2:
+        case DLOAD_3:
+            sm_load(ctx, code[pc] - DLOAD_0, 2);
+            break;
+
+        case ALOAD_0:
+        case ALOAD_1:
+        case ALOAD_2:
+        case ALOAD_3:
+            sm_load(ctx, code[pc] - ALOAD_0, 1);
+            break;
+
+        case IALOAD:
+        case FALOAD:
+        case BALOAD:
+        case CALOAD:
+        case SALOAD:
+            sm_pop(ctx, 2);
+            sm_push_values(ctx, 1);
+            break;
+
+        case LALOAD:
+        case DALOAD:
+            sm_pop(ctx, 2);
+            sm_push_values(ctx, 2);
+            break;
+
+        case AALOAD:
+            sm_pop(ctx, 2);
+            sm_push(ctx, SM_REF);
+            break;
+
+        case ISTORE:
+        case FSTORE:
+        case ASTORE:
+            sm_store(ctx, code[pc + 1], 1);
+            break;
+
+        case LSTORE:
+        case DSTORE:
+            sm_store(ctx, code[pc + 1], 2);
+            break;
+
+        case ISTORE_0:
+        case ISTORE_1:
+        case ISTORE_2:
+        case ISTORE_3:
+            sm_store(ctx, code[pc] - ISTORE_0, 1);
+            break;
+
+        case LSTORE_0:
+        case LSTORE_1:
+        case LSTORE_2:
+        case LSTORE_3:
+            sm_store(ctx, code[pc] - LSTORE_0, 2);
+            break;
+
+        case FSTORE_0:
+        case FSTORE_1:
+        case FSTORE_2:
+        case FSTORE_3:
+            sm_store(ctx, code[pc] - FSTORE_0, 1);
+            break;
+
+        case DSTORE_0:
+        case DSTORE_1:
+        case DSTORE_2:
+        case DSTORE_3:
+            sm_store(ctx, code[pc] - DSTORE_0, 2);
+            break;
+
+        case ASTORE_0:
+        case ASTORE_1:
+        case ASTORE_2:
+        case ASTORE_3:
+            sm_store(ctx, code[pc] - ASTORE_0, 1);
+            break;
+
+        case IASTORE:
+        case FASTORE:
+        case AASTORE:
+        case BASTORE:
+        case CASTORE:
+        case SASTORE:
+            sm_pop(ctx, 3);
+            break;
+
+        case LASTORE:
+        case DASTORE:
+            sm_pop(ctx, 4);
+            break;
+
+        case POP:
+        case MONITORENTER:
+        case MONITOREXIT:
+            sm_pop(ctx, 1);
+            break;
+
+        case POP2:
+            sm_pop(ctx, 2);
+            break;
+
+        case DUP:
+            sm_push(ctx, sm_peek(ctx, 0));
+            break;
+
+        case DUP_X1:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            sm_pop(ctx, 2);
+            sm_push(ctx, a);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            break;
+
+        case DUP_X2:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            c = sm_peek(ctx, 2);
+            sm_pop(ctx, 3);
+            sm_push(ctx, a);
+            sm_push(ctx, c);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            break;
+
+        case DUP2:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            break;
+
+        case DUP2_X1:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            c = sm_peek(ctx, 2);
+            sm_pop(ctx, 3);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            sm_push(ctx, c);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            break;
+
+        case DUP2_X2:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            c = sm_peek(ctx, 2);
+            d = sm_peek(ctx, 3);
+            sm_pop(ctx, 4);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            sm_push(ctx, d);
+            sm_push(ctx, c);
+            sm_push(ctx, b);
+            sm_push(ctx, a);
+            break;
+
+        case SWAP:
+            a = sm_peek(ctx, 0);
+            b = sm_peek(ctx, 1);
+            sm_pop(ctx, 2);
+            sm_push(ctx, a);
+            sm_push(ctx, b);
+            break;
+
+        case IADD:
+        case FADD:
+        case ISUB:
+        case FSUB:
+        case IMUL:
+        case FMUL:
+        case IDIV:
+        case FDIV:
+        case IREM:
+        case FREM:
+        case ISHL:
+        case ISHR:
+        case IUSHR:
+        case IAND:
+        case IOR:
+        case IXOR:
+        case FCMPL:
+        case FCMPG:
+            sm_pop(ctx, 2);
+            sm_push_values(ctx, 1);
+            break;
+
+        case LADD:
+        case DADD:
+        case LSUB:
+        case DSUB:
+        case LMUL:
+        case DMUL:
+        case LDIV:
+        case DDIV:
+        case LREM:
+        case DREM:
+        case LAND:
+        case LOR:
+        case LXOR:
+            sm_pop(ctx, 4);
+            sm_push_values(ctx, 2);
+            break;
+
+        case LSHL:
+        case LSHR:
+        case LUSHR:
+            sm_pop(ctx, 3);
+            sm_push_values(ctx, 2);
+            break;
+
+        case INEG:
+        case FNEG:
+        case I2F:
+        case F2I:
+        case I2B:
+        case I2C:
+        case I2S:
+        case ARRAYLENGTH:
+        case INSTANCEOF_PRELINK:
+            sm_pop(ctx, 1);
+            sm_push_values(ctx, 1);
+            break;
+
+        case LNEG:
+        case DNEG:
+        case L2D:
+        case D2L:
+            sm_pop(ctx, 2);
+            sm_push_values(ctx, 2);
+            break;
+
+        case I2L:
+        case I2D:
+        case F2L:
+        case F2D:
+            sm_pop(ctx, 1);
+            sm_push_values(ctx, 2);
+            break;
+
+        case L2I:
+        case L2F:
+        case D2I:
+        case D2F:
+            sm_pop(ctx, 2);
+            sm_push_values(ctx, 1);
+            break;
+
+        case LCMP:
+        case DCMPL:
+        case DCMPG:
+            sm_pop(ctx, 4);
+            sm_push_values(ctx, 1);
+            break;
+
+        case IFEQ:
+        case IFNE:
+        case IFLT:
+        case IFGE:
+        case IFGT:
+        case IFLE:
+        case IFNULL:
+        case IFNONNULL:
+            sm_pop(ctx, 1);
+            sm_merge(ctx, pc + load_int16_un(code + pc + 1), false);
+            break;
+
+        case IF_ICMPEQ:
+        case IF_ICMPNE:
+        case IF_ICMPLT:
+        case IF_ICMPGE:
+        case IF_ICMPGT:
+        case IF_ICMPLE:
+        case IF_ACMPEQ:
+        case IF_ACMPNE:
+            sm_pop(ctx, 2);
+            sm_merge(ctx, pc + load_int16_un(code + pc + 1), false);
+            break;
+
+        case GOTO:
+            sm_merge(ctx, pc + load_int16_un(code + pc + 1), false);
+            return false;
+
+        case GOTO_W:
+            sm_merge(ctx, pc + load_int32_un(code + pc + 1), false);
+            return false;
+
+        case TABLESWITCH:
+            sm_pop(ctx, 1);
+            aligned = size_ceil(pc + 1, 4);
+            sm_merge(ctx, pc + load_int32_un(code + aligned), false);
+            n = load_int32_un(code + aligned + 8)
+                - load_int32_un(code + aligned + 4) + 1;
+
+            for (int32_t i = 0; i < n; i++) {
+                sm_merge(ctx, pc + load_int32_un(code + aligned + 12 + (i * 4)),
+                         false);
+            }
+
+            return false;
+
+        case LOOKUPSWITCH:
+            sm_pop(ctx, 1);
+            aligned = size_ceil(pc + 1, 4);
+            sm_merge(ctx, pc + load_int32_un(code + aligned), false);
+            n = load_int32_un(code + aligned + 4);
+
+            for (int32_t i = 0; i < n; i++) {
+                sm_merge(ctx, pc + load_int32_un(code + aligned + 12 + (i * 8)),
+                         false);
+            }
+
+            return false;
+
+        case IRETURN:
+        case LRETURN:
+        case FRETURN:
+        case DRETURN:
+        case ARETURN:
+        case RETURN:
+        case IRETURN_MONITOREXIT:
+        case LRETURN_MONITOREXIT:
+        case FRETURN_MONITOREXIT:
+        case DRETURN_MONITOREXIT:
+        case ARETURN_MONITOREXIT:
+        case RETURN_MONITOREXIT:
+        case ATHROW:
+            return false;
+
+        case GETSTATIC_PRELINK:
+            sm_field(ctx, sm_index(code, pc), false, false);
+            break;
+
+        case PUTSTATIC_PRELINK:
+            sm_field(ctx, sm_index(code, pc), false, true);
+            break;
+
+        case GETFIELD_PRELINK:
+            sm_field(ctx, sm_index(code, pc), true, false);
+            break;
+
+        case PUTFIELD_PRELINK:
+            sm_field(ctx, sm_index(code, pc), true, true);
+            break;
+
+        case INVOKEVIRTUAL_PRELINK:
+        case INVOKESPECIAL_PRELINK:
+        case INVOKEINTERFACE_PRELINK:
+            sm_invoke(ctx, sm_index(code, pc), true);
+            break;
+
+        case INVOKESTATIC_PRELINK:
+            sm_invoke(ctx, sm_index(code, pc), false);
+            break;
+
+        case NEWARRAY_PRELINK:
+        case ANEWARRAY_PRELINK:
+            sm_pop(ctx, 1);
+            sm_push(ctx, SM_REF);
+            break;
+
+        case MULTIANEWARRAY_PRELINK:
+            sm_pop(ctx, code[pc + 3]);
+            sm_push(ctx, SM_REF);
+            break;
+
+        case WIDE:
+            switch (code[pc + 1]) {
+                case ILOAD:
+                case FLOAD:
+                case ALOAD:
+                    sm_load(ctx, load_uint16_un(code + pc + 2), 1);
+                    break;
+
+                case LLOAD:
+                case DLOAD:
+                    sm_load(ctx, load_uint16_un(code + pc + 2), 2);
+                    break;
+
+                case ISTORE:
+                case FSTORE:
+                case ASTORE:
+                    sm_store(ctx, load_uint16_un(code + pc + 2), 1);
+                    break;
+
+                case LSTORE:
+                case DSTORE:
+                    sm_store(ctx, load_uint16_un(code + pc + 2), 2);
+                    break;
+
+                default:
+                    break; // IINC
+            }
+
+            break;
+
+        default:
+            c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                    "Unknown opcode found while computing the stack maps");
+    }
+
+    return true;
+} // sm_step()
+
+/** Simulates the execution of a basic block starting from its entry state
+ * \param ctx The analysis context
+ * \param block The index of the block
+ * \param map If not NULL the reference maps of the instructions of the block
+ * are appended to this stack map */
+
+static void sm_simulate(sm_context_t *ctx, uint32_t block, stack_map_t *map)
+{
+    exception_handler_t *handlers = ctx->handlers;
+    int32_t pc = ctx->leaders[block];
+    int32_t end = (block + 1 < ctx->blocks) ? ctx->leaders[block + 1]
+                                            : ctx->code_length;
+    uint32_t slots;
+    uint8_t *bits;
+
+    memcpy(ctx->cur, ctx->states + (block * ctx->width), ctx->width);
+    ctx->sp = ctx->depths[block];
+
+    while (pc < end) {
+        if ((map != NULL) && sm_is_gc_point(ctx->code, pc)) {
+            bits = map->maps + (map->entries * map->size);
+            slots = ctx->max_locals + ctx->sp;
+
+            for (uint32_t i = 0; i < slots; i++) {
+                if (ctx->cur[i] == SM_REF) {
+                    bits[i / 8] |= 1 << (i % 8);
+                }
+            }
+
+            map->pcs[map->entries] = pc;
+            map->depths[map->entries] = ctx->sp;
+            map->entries++;
+        }
+
+        // Propagate the locals to the exception handlers covering this PC
+        for (size_t i = 0; i < ctx->method->exception_table_length; i++) {
+            if (((uint32_t) pc >= handlers[i].start_pc)
+                && ((uint32_t) pc < handlers[i].end_pc))
+            {
+                sm_merge(ctx, handlers[i].handler_pc - ctx->code, true);
+            }
+        }
+
+        if (!sm_step(ctx, pc)) {
+            return;
+        }
+
+        pc += sm_length(ctx->code, pc, ctx->code_length);
+    }
+
+    if (pc >= ctx->code_length) {
+        c_throw(JAVA_LANG_NOCLASSDEFFOUNDERROR,
+                "Execution falls off the end of the code");
+    }
+
+    sm_merge(ctx, pc, false);
+} // sm_simulate()
+
+/** Computes the reference maps of a method, this must be called on the
+ * bytecode as it is right after translation, before any opcode is linked
+ * \param method A pointer to the method
+ * \param code The translated bytecode of the method
+ * \param handlers The exception handlers of the method
+ * \returns A pointer to the newly created stack map or NULL if the method
+ * doesn't have instructions needing one */
+
+stack_map_t *stack_map_create(method_t *method, const uint8_t *code,
+                              exception_handler_t *handlers)
+{
+    sm_context_t ctx;
+    stack_map_t *map;
+    uint32_t gc_points, size;
+
+    ctx.method = method;
+    ctx.code = code;
+    ctx.handlers = handlers;
+    ctx.code_length = method_get_code_length(method);
+    ctx.max_locals = method->max_locals;
+    ctx.max_stack = method->max_stack;
+    ctx.width = method->max_locals + method->max_stack;
+
+    sm_find_leaders(&ctx, &gc_points);
+
+    if (gc_points == 0) {
+        gc_free(ctx.leaders);
+        return NULL;
+    }
+
+    ctx.states = gc_malloc(ctx.blocks * ctx.width + 1);
+    ctx.depths = gc_malloc(ctx.blocks * sizeof(int32_t));
+    ctx.dirty = gc_malloc(ctx.blocks * sizeof(bool));
+    ctx.cur = gc_malloc(ctx.width + 1);
+
+    for (uint32_t i = 0; i < ctx.blocks; i++) {
+        ctx.depths[i] = -1;
+    }
+
+    // Seed the first block with the method arguments and iterate to a fixpoint
+    sm_entry_state(&ctx);
+    sm_merge(&ctx, 0, false);
+
+    do {
+        ctx.changed = false;
+
+        for (uint32_t i = 0; i < ctx.blocks; i++) {
+            if (ctx.dirty[i]) {
+                ctx.dirty[i] = false;
+                sm_simulate(&ctx, i, NULL);
+            }
+        }
+    } while (ctx.changed);
+
+    // Emit the maps, the blocks are laid out in order so the PCs are sorted
+    size = size_div_inf(ctx.width, 8);
+    map = gc_malloc(sizeof(stack_map_t)
+                    + gc_points * (2 * sizeof(uint16_t) + size));
+    map->entries = 0;
+    map->size = size;
+    map->pcs = (uint16_t *) (map + 1);
+    map->depths = map->pcs + gc_points;
+    map->maps = (uint8_t *) (map->depths + gc_points);
+
+    for (uint32_t i = 0; i < ctx.blocks; i++) {
+        if (ctx.depths[i] >= 0) {
+            sm_simulate(&ctx, i, map);
+        }
+    }
+
+    gc_free(ctx.cur);
+    gc_free(ctx.dirty);
+    gc_free(ctx.depths);
+    gc_free(ctx.states);
+    gc_free(ctx.leaders);
+
+    return map;
+} // stack_map_create()
+
+/** Marks the references held in a frame using its reference map. Slots
+ * above the recorded operand stack depth, frames without a map and PCs which
+ * do not correspond to a recorded instruction are scanned conservatively
+ * \param method The method owning the frame
+ * \param pc The PC of the instruction the frame was stopped at
+ * \param locals A pointer to the first local variable of the frame
+ * \param top A pointer past the last slot of the frame
+ * \param exact true if the frame is stopped at a method invocation, false if
+ * it was interrupted while executing an instruction in which case the operand
+ * stack might have been partially updated and it is scanned conservatively */
+
+void stack_map_mark(const method_t *method, const uint8_t *pc,
+                    jword_t *locals, jword_t *top, bool exact)
+{
+    const stack_map_t *map = method->stack_map;
+    const uint8_t *bits = NULL;
+    uint32_t offset, low, high, mid, slots, depth = 0;
+
+    if ((map != NULL) && (pc >= method->code)
+        && (pc < method->code + method_get_code_length(method)))
+    {
+        offset = pc - method->code;
+        low = 0;
+        high = map->entries;
+
+        while (low < high) {
+            mid = (low + high) / 2;
+
+            if (map->pcs[mid] < offset) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if ((low < map->entries) && (map->pcs[low] == offset)) {
+            bits = map->maps + (low * map->size);
+            depth = map->depths[low];
+        }
+    }
+
+    if (bits == NULL) {
+        for (jword_t *scan = locals; scan < top; scan++) {
+            gc_mark_potential(*((uintptr_t *) scan));
+        }
+
+        return;
+    }
+
+    slots = top - locals;
+
+    for (uint32_t i = 0; i < slots; i++) {
+        if (i >= method->max_locals + depth) {
+            gc_mark_potential(*((uintptr_t *) (locals + i)));
+        } else if (bits[i / 8] & (1 << (i % 8))) {
+            if (exact || (i < method->max_locals)) {
+                gc_mark_reference(*((uintptr_t *) (locals + i)));
+            } else {
+                gc_mark_potential(*((uintptr_t *) (locals + i)));
+            }
+        }
+    }
+} // stack_map_mark()
+
+#endif // JEL_PRECISE_GC
@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright © 2005-2011 by Gabriele Svelto                              *
+ *   gabriele.svelto@gmail.com                                             *
+ *                                                                         *
+ *   This file is part of Jelatine.                                        *
+ *                                                                         *
+ *   Jelatine is free software: you can redistribute it and/or modify      *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   Jelatine is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with Jelatine.  If not, see <http://www.gnu.org/licenses/>.     *
+ ***************************************************************************/
+
+/** \file stackmap.h
+ * Reference maps used for precise stack scanning, interface */
+
+/** \def JELATINE_STACKMAP_H
+ * stackmap.h inclusion macro */
+
+#ifndef JELATINE_STACKMAP_H
+#   define JELATINE_STACKMAP_H (1)
+
+#include "wrappers.h"
+
+#include "method.h"
+
+/******************************************************************************
+ * Type definitions                                                           *
+ ******************************************************************************/
+
+/** Holds the reference maps of a method. A map is recorded for every
+ * instruction where the executing thread may be stopped by the collector and
+ * describes the frame as it is right before the instruction executes. Each map
+ * is a bitmap with one bit per local variable followed by one bit per operand
+ * stack slot, a set bit indicates that the slot holds a reference */
+
+struct stack_map_t {
+    uint16_t entries; ///< Number of recorded maps
+    uint16_t size; ///< Size in bytes of a single bitmap
+    uint16_t *pcs; ///< Sorted PCs of the recorded instructions
+    uint16_t *depths; ///< Operand stack depth at each recorded instruction
+    uint8_t *maps; ///< Bitmaps, \a size bytes per entry
+};
+
+/** Typedef for struct stack_map_t */
+typedef struct stack_map_t stack_map_t;
+
+/******************************************************************************
+ * Stack map interface                                                        *
+ ******************************************************************************/
+
+extern stack_map_t *stack_map_create(method_t *, const uint8_t *,
+                                     exception_handler_t *);
+extern void stack_map_mark(const method_t *, const uint8_t *, jword_t *,
+                           jword_t *, bool);
+
+#endif // JELATINE_STACKMAP_H
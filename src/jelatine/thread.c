@@ -32,7 +32,10 @@
 #include "kni.h"
 #include "loader.h"
 #include "memory.h"
+#include "method.h"
+#include "stackmap.h"
 #include "thread.h"
+#include "util.h"
 #include "vm.h"
 
 #include "java_lang_Thread.h"
@@ -59,6 +62,23 @@ static void native_cond_timed_wait(native_cond_t *, native_mutex_t *,
 static void native_cond_signal(native_cond_t *);
 static void native_cond_broadcast(native_cond_t *);
 
+#if JEL_GREEN_THREADS
+
+/******************************************************************************
+ * Virtual thread function prototypes                                         *
+ ******************************************************************************/
+
+static void green_init( void );
+static void green_teardown( void );
+static bool green_take_restartable(thread_t *);
+static void green_park(thread_t *, uint64_t, uint32_t, bool);
+static void green_wake(thread_t *, bool);
+static void green_wake_joiners(thread_t *);
+static bool green_has_work( void );
+static void *green_carrier(void *);
+
+#endif // JEL_GREEN_THREADS
+
 /******************************************************************************
  * Native thread wrapper functions                                            *
  ******************************************************************************/
@@ -339,7 +359,9 @@ struct monitor_t {
     uintptr_t ref; ///< Object associated with this monitor
     thread_t *owner; ///< Owner thread, NULL if the monitor is unlocked
     size_t count; ///< Number of times the monitor was acquired
-    native_cond_t *cond; ///< Condition variable associated with the monitor
+    thread_t *queue; ///< Threads parked while entering, in arrival order
+    thread_t *waiters; ///< Wait set of the monitor, in arrival order
+    uint32_t spin; ///< Number of times a contending thread spins before parking
 };
 
 /** Typedef for the struct monitor_t type */
@@ -348,6 +370,20 @@ typedef struct monitor_t monitor_t;
 /** Define the minimum capacity (i.e. number of buckets) of the monitor table */
 #define TM_CAPACITY (4)
 
+/** Initial number of spins of a thread contending for a monitor */
+#define MONITOR_SPIN_INITIAL (8)
+
+/** Maximum number of spins of a thread contending for a monitor */
+#define MONITOR_SPIN_MAX (64)
+
+#if JEL_THIN_LOCKS
+
+/** Number of thin lock identifiers, identifier 0 is never handed out and the
+ * largest one denotes an inflated lock */
+#define TM_LOCK_IDS (HEADER_LOCK_INFLATED)
+
+#endif // JEL_THIN_LOCKS
+
 /** Thread manager, contains all the threads and is used to interact with them
  * globally */
 
@@ -358,14 +394,82 @@ struct thread_manager_t {
 #endif // JEL_THREAD_PTH
     size_t active; ///< Number of active threads
     thread_t *queue; ///< Doubly-linked queue of active threads
+#if JEL_THREAD_POOL
+    thread_t *pool; ///< Idle pooled threads, most recently parked first
+#endif // JEL_THREAD_POOL
     size_t capacity; ///< Capacity of the monitor hash-table
     size_t entries; ///< Number of used entries of the monitor hash-table
     monitor_t *buckets; ///< Buckets of the monitor hash-table
+#if JEL_THIN_LOCKS
+    uint32_t lock_ids[(TM_LOCK_IDS + 31) / 32]; ///< Used thin lock identifiers
+#endif // JEL_THIN_LOCKS
+#if JEL_CONCURRENT_GC
+    native_cond_t gc_cond; ///< Used for waking up the collector thread
+#endif // JEL_CONCURRENT_GC
+#if JEL_PRINT
+    uint64_t ttsp; ///< Time taken by the last stop-the-world (in microseconds)
+#endif // JEL_PRINT
 };
 
 /** Typedef for the struct thread_manager_t type */
 typedef struct thread_manager_t thread_manager_t;
 
+#if JEL_GREEN_THREADS
+
+/** Maximum number of carriers, including those started to stand in for
+ * carriers blocked by a pinned virtual thread */
+#define GREEN_MAX_CARRIERS (64)
+
+/** Length of the time slice of a virtual thread in milliseconds */
+#define GREEN_TIMESLICE (10)
+
+/** Number of virtual threads a carrier schedules between two looks at the
+ * global ready queue when its own queue is not empty */
+#define GREEN_GLOBAL_INTERVAL (61)
+
+/** A native thread running virtual threads. Each carrier owns a FIFO queue of
+ * ready virtual threads which is protected by its own lock, idle carriers
+ * steal half of the queue of a busy one */
+
+struct green_carrier_t {
+    bool used; ///< True if this slot holds a live carrier
+    native_thread_t native; ///< Native thread
+    native_mutex_t lock; ///< Protects the fields below
+    thread_t *current; ///< Mounted virtual thread, NULL when idle
+    thread_t *head; ///< Head of the local ready queue
+    thread_t *tail; ///< Tail of the local ready queue
+    size_t length; ///< Number of virtual threads in the local ready queue
+    size_t ticks; ///< Number of virtual threads scheduled so far
+};
+
+/** Typedef for the struct green_carrier_t type */
+typedef struct green_carrier_t green_carrier_t;
+
+/** Scheduler of the virtual threads. Its fields are protected by its own lock
+ * which is always taken after the VM lock and the park locks and before the
+ * locks of the carriers */
+
+struct green_scheduler_t {
+    native_mutex_t lock; ///< Scheduler lock
+    native_cond_t cond; ///< Signaled when a virtual thread becomes ready
+    native_cond_t tick; ///< Paces the ticker thread
+    bool started; ///< True once the ticker thread has been started
+    native_thread_t ticker; ///< Preempts virtual threads and expires timers
+    thread_t *ready; ///< Head of the global queue of ready virtual threads
+    thread_t *ready_tail; ///< Tail of the global ready queue
+    thread_t *timers; ///< Virtual threads parked with a timeout
+    size_t target; ///< Number of carriers meant to run at the same time
+    size_t carriers; ///< Number of live carriers
+    size_t blocked; ///< Carriers held by a pinned, blocked virtual thread
+    size_t idle; ///< Carriers waiting for a ready virtual thread
+    green_carrier_t carrier[GREEN_MAX_CARRIERS]; ///< Carrier slots
+};
+
+/** Typedef for the struct green_scheduler_t type */
+typedef struct green_scheduler_t green_scheduler_t;
+
+#endif // JEL_GREEN_THREADS
+
 /******************************************************************************
  * Globals                                                                    *
  ******************************************************************************/
@@ -376,6 +480,13 @@ JEL_TLS native_key_t self;
 /** Thread manager singleton */
 static thread_manager_t tm;
 
+#if JEL_GREEN_THREADS
+
+/** Virtual thread scheduler singleton */
+static green_scheduler_t gs;
+
+#endif // JEL_GREEN_THREADS
+
 /******************************************************************************
  * Thread manager implementation                                              *
  ******************************************************************************/
@@ -404,6 +515,14 @@ void tm_init( void )
      * the code can enter more than one syncrhonized sections safely */
     native_mutex_create(&tm.lock);
     native_key_create(&self);
+
+#if JEL_CONCURRENT_GC
+    native_cond_create(&tm.gc_cond);
+#endif // JEL_CONCURRENT_GC
+
+#if JEL_GREEN_THREADS
+    green_init();
+#endif // JEL_GREEN_THREADS
 } // tm_init()
 
 /** Tears down the thread manager */
@@ -420,9 +539,27 @@ void tm_teardown( void )
     tm_stop_the_world();
 
     for (thread = tm.queue; thread != NULL; thread = thread->next) {
+#if JEL_GREEN_THREADS
+        // Virtual threads go away together with their carriers
+        if (thread->green.is_virtual) {
+            continue;
+        }
+#endif // JEL_GREEN_THREADS
+
+        pthread_cancel(thread->native);
+    }
+
+#if JEL_THREAD_POOL
+    // Idle pooled threads are not registered anymore
+    for (thread = tm.pool; thread != NULL; thread = thread->pool.next) {
         pthread_cancel(thread->native);
     }
 
+#endif // JEL_THREAD_POOL
+#if JEL_GREEN_THREADS
+    green_teardown();
+#endif // JEL_GREEN_THREADS
+
     tm_unlock();
 #endif // JEL_THREAD_POSIX
 
@@ -439,6 +576,19 @@ void tm_teardown( void )
 
 void tm_register(thread_t *thread)
 {
+#if JEL_THIN_LOCKS
+    // Hand out the smallest free thin lock identifier, if any
+    thread->lock_id = 0;
+
+    for (uint32_t id = 1; id < TM_LOCK_IDS; id++) {
+        if (!(tm.lock_ids[id / 32] & (1U << (id % 32)))) {
+            tm.lock_ids[id / 32] |= 1U << (id % 32);
+            thread->lock_id = id;
+            break;
+        }
+    }
+#endif // JEL_THIN_LOCKS
+
     thread->next = tm.queue;
     tm.queue = thread;
     tm.active++;
@@ -465,6 +615,16 @@ void tm_unregister(thread_t *thread)
         prev->next = curr->next;
     }
 
+#if JEL_THIN_LOCKS
+    if (thread->lock_id != 0) {
+        tm.lock_ids[thread->lock_id / 32] &= ~(1U << (thread->lock_id % 32));
+    }
+#endif // JEL_THIN_LOCKS
+
+#if JEL_CONCURRENT_GC
+    gc_satb_flush(thread);
+#endif // JEL_CONCURRENT_GC
+
     tm.active--;
 } // tm_unregister_thread()
 
@@ -473,21 +633,121 @@ void tm_unregister(thread_t *thread)
 
 uint32_t tm_active( void )
 {
+    uint32_t active = tm.active;
+
 #if JEL_FINALIZER
-    return tm.active - 1;
-#else
-    return tm.active;
+    active--; // Do not count the finalizer thread
 #endif // JEL_FINALIZER
+
+#if JEL_CONCURRENT_GC
+    active--; // Do not count the collector thread
+#endif // JEL_CONCURRENT_GC
+
+    return active;
 } // tm_active()
 
-/** Marks all the references reacheable from the threads */
+#if JEL_PRECISE_GC
+
+/** Marks the references held in the stack of a thread by walking its frames
+ * and applying their reference maps. The frame which is currently executing
+ * and the frames interrupted by a nested call to the interpreter were stopped
+ * in the middle of an instruction so their operand stacks are scanned
+ * conservatively, as are the frames without a map
+ * \param thread A pointer to the thread */
+
+static void tm_mark_stack(thread_t *thread)
+{
+    stack_frame_t *end = thread_stack_end(thread);
+    stack_frame_t *fp = thread->fp;
+    jword_t *top = thread->sp;
+    const uint8_t *pc = thread->pc;
+    bool exact = false;
+#if JEL_SEGMENTED_STACKS
+    stack_segment_t *segment;
+#endif // JEL_SEGMENTED_STACKS
+
+    while (fp != end) {
+#if JEL_SEGMENTED_STACKS
+        if (fp->method == &segment_method) {
+            // Arguments or return value held at the beginning of the segment
+            for (jword_t *scan = fp->locals; scan < top; scan++) {
+                gc_mark_potential(*((uintptr_t *) scan));
+            }
+
+            // Carry on with the caller living in the previous segment
+            segment = (stack_segment_t *) fp->locals - 1;
+            top = segment->sp;
+            fp = segment->fp;
+
+            if (fp != end) {
+                if (pc == NULL) {
+                    pc = fp->pc;
+                    exact = false;
+                } else {
+                    pc = fp->pc - 3;
+                    exact = true;
+                }
+            }
+
+            continue;
+        }
+#endif // JEL_SEGMENTED_STACKS
+
+        if (fp->method == &halt_method) {
+            // Arguments pushed by the native code calling into the interpreter
+            for (jword_t *scan = fp->locals; scan < top; scan++) {
+                gc_mark_potential(*((uintptr_t *) scan));
+            }
+
+            pc = NULL;
+            exact = false;
+        } else {
+            stack_map_mark(fp->method, pc, fp->locals, top, exact);
+        }
+
+        top = fp->locals;
+        fp++;
+
+#if JEL_SEGMENTED_STACKS
+        if ((fp != end) && (fp->method != &segment_method)) {
+#else
+        if (fp != end) {
+#endif // JEL_SEGMENTED_STACKS
+            if (pc == NULL) {
+                // Frame interrupted by a nested call, see prepare_for_call()
+                pc = fp->pc;
+                exact = false;
+            } else {
+                // Frame stopped at an invoke instruction
+                pc = fp->pc - 3;
+                exact = true;
+            }
+        }
+    }
+
+    // Whatever lies below the outermost frame
+    for (jword_t *scan = thread->stack; scan < top; scan++) {
+        gc_mark_potential(*((uintptr_t *) scan));
+    }
+} // tm_mark_stack()
+
+#endif // JEL_PRECISE_GC
+
+/** Marks all the references reacheable from the threads. The threads can be
+ * split in several partitions which are marked independently
+ * \param part The index of the partition to be marked
+ * \param parts The number of partitions */
 
-void tm_mark( void )
+void tm_mark(size_t part, size_t parts)
 {
-    jword_t *scan;
     thread_t *thread;
+    size_t i = 0;
+
+    for (thread = tm.queue; thread != NULL; thread = thread->next, i++) {
+        if (i % parts != part) {
+            continue;
+        }
 
-    for (thread = tm.queue; thread != NULL; thread = thread->next) {
         gc_mark_reference(thread->obj);
 
         // Mark the temporary roots
@@ -497,13 +757,39 @@ void tm_mark( void )
 
         // Crawl the stack
         if (thread->stack != NULL) {
-            for (scan = thread->stack; scan < thread->sp; scan++) {
+#if JEL_PRECISE_GC
+            tm_mark_stack(thread);
+#else
+            jword_t *top = thread->sp;
+
+#   if JEL_SEGMENTED_STACKS
+            // Each segment is in use up to the arguments moved to the next one
+            for (stack_segment_t *segment = thread->segment; segment != NULL;
+                 segment = segment->prev)
+            {
+                for (jword_t *scan = (jword_t *) (segment + 1); scan < top;
+                     scan++)
+                {
+                    gc_mark_potential(*((uintptr_t *) scan));
+                }
+
+                top = segment->sp;
+            }
+#   endif // JEL_SEGMENTED_STACKS
+
+            for (jword_t *scan = thread->stack; scan < top; scan++) {
                 gc_mark_potential(*((uintptr_t *) scan));
             }
+#endif // JEL_PRECISE_GC
         }
 
         // Mark the pending exception
         gc_mark_reference(thread->exception);
+
+#if JEL_CONCURRENT_GC
+        // The thread is stopped, hand over its overwritten references
+        gc_satb_flush(thread);
+#endif // JEL_CONCURRENT_GC
     }
 } // tm_mark()
 
@@ -520,29 +806,20 @@ static size_t tm_hash(uintptr_t ref)
 } // tm_hash()
 
 /** Purge the monitor table by clearing the entries associated with dead
- * objects, also purge the associated conditions */
+ * objects */
 
 void tm_purge( void )
 {
     size_t hash, entries = 0;
     monitor_t *entry, *other;
-    header_t *header;
 
     for (size_t i = 0; i < tm.capacity; i++) {
         entry = tm.buckets + i;
 
         if (entry->ref) {
-            header = (header_t *) entry->ref;
-
-            if (!header_is_marked(header)) {
+            if (!gc_is_marked(entry->ref)) {
                 /* The object referenced by this monitor is dead, let's purge
                  * the monitor then */
-
-                if (entry->cond) {
-                    native_cond_dispose(entry->cond);
-                    gc_free(entry->cond);
-                }
-
                 memset(entry, 0, sizeof(monitor_t));
             } else {
                 entries++;
@@ -630,7 +907,9 @@ static void tm_rehash(bool grow)
             buckets[j].ref = entry->ref;
             buckets[j].owner = entry->owner;
             buckets[j].count = entry->count;
-            buckets[j].cond = entry->cond;
+            buckets[j].queue = entry->queue;
+            buckets[j].waiters = entry->waiters;
+            buckets[j].spin = entry->spin;
 
             // Chain the entry if there was a clash
             if (j == hash) {
@@ -677,13 +956,18 @@ void tm_unlock( void )
 } // tm_unlock()
 
 /** Waits for all threads to stop. The calling thread must have taken the VM
- * lock for this to happen safely */
+ * lock for this to happen safely. Running threads stop at the safepoints polled
+ * by the interpreter on backward branches and method returns, threads which
+ * are blocked are already considered stopped */
 
 void tm_stop_the_world( void )
 {
     thread_t *self = thread_self();
     thread_t *thread;
     bool stopped = false;
+#if JEL_PRINT
+    uint64_t start = get_time_usec();
+#endif // JEL_PRINT
 
     // Inform all threads that they must stop
     self->blocked = true;
@@ -704,8 +988,50 @@ void tm_stop_the_world( void )
     }
 
     self->blocked = false;
+
+#if JEL_PRINT
+    tm.ttsp += get_time_usec() - start;
+#endif // JEL_PRINT
 } // tm_stop_the_world()
 
+#if JEL_PRINT
+
+/** Returns the time spent waiting for the other threads to reach a safepoint
+ * since the last call of this function. The caller must hold the VM lock
+ * \returns The time-to-safepoint in microseconds */
+
+uint64_t tm_take_ttsp( void )
+{
+    uint64_t ttsp = tm.ttsp;
+
+    tm.ttsp = 0;
+    return ttsp;
+} // tm_take_ttsp()
+
+#endif // JEL_PRINT
+
+#if JEL_CONCURRENT_GC
+
+/** Puts the collector thread to sleep until it is woken up by tm_gc_signal().
+ * The caller must hold the VM lock exactly once, the lock is released while
+ * sleeping */
+
+void tm_gc_wait( void )
+{
+    thread_may_block();
+    native_cond_wait(&tm.gc_cond, &tm.lock);
+    thread_resumes();
+} // tm_gc_wait()
+
+/** Wakes up the collector thread, the caller must hold the VM lock */
+
+void tm_gc_signal( void )
+{
+    native_cond_signal(&tm.gc_cond);
+} // tm_gc_signal()
+
+#endif // JEL_CONCURRENT_GC
+
 #endif // !JEL_THREAD_NONE
 
 /******************************************************************************
@@ -720,73 +1046,484 @@ void monitor_init( void )
     tm.buckets = gc_malloc(TM_CAPACITY * sizeof(monitor_t));
 } // monitor_init()
 
-/** Implements the MONITOR_ENTER opcode
- * \param thread The thread requesting the monitor
- * \param ref A Java object reference */
+/** Appends a thread to the entry queue or the wait set of a monitor
+ * \param list A pointer to the head of the list
+ * \param thread The thread to be appended */
 
-void monitor_enter(thread_t *thread, uintptr_t ref)
+static void monitor_enqueue(thread_t **list, thread_t *thread)
+{
+    while (*list != NULL) {
+        list = &(*list)->park_next;
+    }
+
+    thread->park_next = NULL;
+    *list = thread;
+} // monitor_enqueue()
+
+/** Parks the calling thread on its own condition variable until another
+ * thread unparks it. The caller must hold the VM lock exactly once and must
+ * have set the parked flag of the thread, the VM lock is released and is not
+ * re-acquired when this function returns
+ * \param thread The calling thread
+ * \param millis Number of milliseconds before a timeout occurs
+ * \param nanos Number of nanoseconds before a timeout occurs
+ * \param interruptible If true return also when the thread is interrupted */
+
+static void monitor_park(thread_t *thread, uint64_t millis, uint32_t nanos,
+                         bool interruptible)
+{
+#if JEL_GREEN_THREADS
+    // A virtual thread is unmounted instead, leaving its carrier free
+    if (thread->green.unmountable) {
+        green_park(thread, millis, nanos, interruptible);
+        return;
+    }
+#endif // JEL_GREEN_THREADS
+
+    native_mutex_lock(&thread->park_lock);
+    tm_unlock();
+    thread_may_block_long();
+
+    if ((millis == 0) && (nanos == 0)) {
+        while (thread->parked && !(interruptible && thread->interrupted)) {
+            native_cond_wait(&thread->park, &thread->park_lock);
+        }
+    } else if (thread->parked && !(interruptible && thread->interrupted)) {
+        native_cond_timed_wait(&thread->park, &thread->park_lock, millis,
+                               nanos);
+    }
+
+    native_mutex_unlock(&thread->park_lock);
+    thread_resumes_long();
+} // monitor_park()
+
+/** Wakes up a parked thread, the caller must hold the VM lock
+ * \param thread The thread to be woken up */
+
+static void monitor_unpark(thread_t *thread)
+{
+    native_mutex_lock(&thread->park_lock);
+    thread->parked = false;
+    native_cond_signal(&thread->park);
+#if JEL_GREEN_THREADS
+    green_wake(thread, false);
+#endif // JEL_GREEN_THREADS
+    native_mutex_unlock(&thread->park_lock);
+} // monitor_unpark()
+
+#if !JEL_THREAD_NONE
+
+/** Removes a parked thread from the wait set or the entry queue of a monitor,
+ * the caller must hold the VM lock
+ * \param entry A pointer to the monitor
+ * \param thread The thread to be removed */
+
+static void monitor_unlink(monitor_t *entry, thread_t *thread)
+{
+    thread_t **link = &entry->waiters;
+
+    while ((*link != NULL) && (*link != thread)) {
+        link = &(*link)->park_next;
+    }
+
+    if (*link == NULL) {
+        link = &entry->queue;
+
+        while (*link != thread) {
+            link = &(*link)->park_next;
+        }
+    }
+
+    *link = thread->park_next;
+    thread->park_next = NULL;
+} // monitor_unlink()
+
+#endif // !JEL_THREAD_NONE
+
+/** Releases a monitor handing it over to the first thread of its entry queue,
+ * if any. The caller must hold the VM lock
+ * \param entry A pointer to the monitor */
+
+static void monitor_release(monitor_t *entry)
+{
+    thread_t *next = entry->queue;
+
+    entry->owner = next;
+    entry->count = 0;
+
+    if (next != NULL) {
+        entry->queue = next->park_next;
+        next->park_next = NULL;
+        entry->count = 1;
+        monitor_unpark(next);
+    }
+} // monitor_release()
+
+/** Returns the monitor of an object, creating a new unlocked one if needed.
+ * The caller must hold the VM lock
+ * \param ref A Java object reference
+ * \returns A pointer to the monitor of the object */
+
+static monitor_t *monitor_get(uintptr_t ref)
 {
     monitor_t *entry;
-    size_t hash;
-    bool done;
+    size_t hash = tm_hash(ref) & (tm.capacity - 1);
+    size_t i = hash;
 
-    do {
-        done = true;
-        tm_lock();
+    // Check if the monitor is already present
+    entry = tm.buckets + hash;
+
+    while (entry && (entry->ref != ref)) {
+        entry = entry->next;
+    }
+
+    if (entry) {
+        return entry;
+    }
+
+    // The monitor is not there, let's insert a new one
+    while (tm.buckets[i].ref != JNULL) {
+        i = (i + 1) & (tm.capacity - 1);
+    }
+
+    entry = tm.buckets + i;
+    entry->ref = ref;
+    entry->spin = MONITOR_SPIN_INITIAL;
+
+    // Chain the entry if there was a clash
+    if (i == hash) {
+        entry->next = NULL;
+    } else {
+        entry->next = tm.buckets[hash].next;
+        tm.buckets[hash].next = entry;
+    }
+
+    // Check if we must grow the table, the entry moves if we do
+    tm.entries++;
+
+    if (tm.entries == tm.capacity) {
+        tm_rehash(true);
+        entry = monitor_get(ref);
+    } else if (tm.entries < (tm.capacity / 4)) {
+        tm_rehash(false);
+        entry = monitor_get(ref);
+    }
+
+    return entry;
+} // monitor_get()
+
+/** Tells if spinning on a monitor held by \a owner may succeed. A virtual
+ * thread which is not mounted cannot release a monitor until it runs again so
+ * spinning on it would only keep the spinning thread's carrier busy. The
+ * caller must hold the VM lock
+ * \param owner The thread owning the monitor
+ * \returns true if the owner may release the monitor soon */
+
+static bool monitor_may_spin(thread_t *owner)
+{
+#if JEL_GREEN_THREADS
+    return !owner->green.is_virtual || (owner->green.state == GREEN_RUNNING);
+#else
+    return true;
+#endif // JEL_GREEN_THREADS
+} // monitor_may_spin()
+
+#if JEL_THIN_LOCKS
+
+/** Inflates the lock of an object. If the lock is thin and held by another
+ * thread the monitor is handed to that thread together with its recursion
+ * count so that the caller can queue on the monitor instead of spinning, the
+ * holder releases it through the monitor when it is done
+ * \param thread The thread inflating the lock
+ * \param ref A Java object reference */
+
+static void monitor_inflate(thread_t *thread, uintptr_t ref)
+{
+    volatile header_t *header = (header_t *) ref;
+    header_t old, inflated;
+    thread_t *holder;
+    monitor_t *entry;
+    uint32_t owner;
 
-        hash = tm_hash(ref) & (tm.capacity - 1);
+    tm_lock();
+    entry = monitor_get(ref);
 
-        // Check if the monitor is already present
-        entry = tm.buckets + hash;
+    while (1) {
+        old = *header;
+        owner = header_lock_owner(old);
+        inflated = (old & ~HEADER_LOCK_MASK)
+                   | ((header_t) HEADER_LOCK_INFLATED << HEADER_LOCK_OWNER_SHIFT);
 
-        while (entry && (entry->ref != ref)) {
-            entry = entry->next;
+        if (owner == HEADER_LOCK_INFLATED) {
+            break;
         }
 
-        if (entry) {
-            // The monitor is already present
-            if (entry->owner == NULL) {
-                entry->owner = thread;
-                entry->count = 1;
-            } else if (entry->owner == thread) {
-                entry->count++;
-            } else {
-                // This monitor is contended, spin
-                tm_unlock();
-                thread_yield();
-                done = false;
+        /* The header may change under our feet only because of the mark bit
+         * or because its holder changed the thin lock, all the changes made
+         * by the holder are compare-and-swaps so they fail once the lock is
+         * inflated */
+        if (__sync_bool_compare_and_swap(header, old, inflated)) {
+            if (header_lock_holds(old) != 0) {
+                holder = thread;
+
+                if (owner != thread->lock_id) {
+                    for (holder = tm.queue; holder != NULL;
+                         holder = holder->next)
+                    {
+                        if (holder->lock_id == owner) {
+                            break;
+                        }
+                    }
+                }
+
+                entry->owner = holder;
+                entry->count = (holder != NULL) ? header_lock_holds(old) : 0;
             }
-        } else {
-            // The monitor is not there, let's insert a new one
-            size_t i = hash;
 
-            while (tm.buckets[i].ref != JNULL) {
-                i = (i + 1) & (tm.capacity - 1);
+            break;
+        }
+    }
+
+    tm_unlock();
+} // monitor_inflate()
+
+#if JEL_BIASED_LOCKING
+
+/** Revokes the bias of a lock biased toward another thread by inflating it.
+ * The world is stopped so that the biased thread cannot be in the middle of
+ * updating the lock, its acquisitions are moved to the monitor
+ * \param ref A Java object reference */
+
+static void monitor_revoke(uintptr_t ref)
+{
+    header_t *header = (header_t *) ref;
+    thread_t *thread;
+    monitor_t *entry;
+    uint32_t owner;
+
+    tm_lock();
+    tm_stop_the_world();
+    owner = header_lock_owner(*header);
+
+    // The bias might have been revoked by another thread in the meantime
+    if ((owner != 0) && (owner != HEADER_LOCK_INFLATED)) {
+        entry = monitor_get(ref);
+
+        if (header_lock_holds(*header) != 0) {
+            for (thread = tm.queue; thread != NULL; thread = thread->next) {
+                if (thread->lock_id == owner) {
+                    entry->owner = thread;
+                    entry->count = header_lock_holds(*header);
+                    break;
+                }
             }
+        }
 
-            entry = tm.buckets + i;
-            entry->ref = ref;
-            entry->owner = thread;
-            entry->count = 1;
+#if JEL_CONCURRENT_GC
+        /* The collector thread counts as stopped while it traces the heap
+         * and may be marking the object at the same time */
+        header_t old;
+
+        do {
+            old = *header;
+        } while (!__sync_bool_compare_and_swap(header, old,
+                    (old & ~HEADER_LOCK_MASK)
+                    | ((header_t) HEADER_LOCK_INFLATED
+                       << HEADER_LOCK_OWNER_SHIFT)));
+#else
+        *header = (*header & ~HEADER_LOCK_MASK)
+                  | ((header_t) HEADER_LOCK_INFLATED << HEADER_LOCK_OWNER_SHIFT);
+#endif // JEL_CONCURRENT_GC
+    }
 
-            // Chain the entry if there was a clash
-            if (i == hash) {
-                entry->next = NULL;
-            } else {
-                entry->next = tm.buckets[hash].next;
-                tm.buckets[hash].next = entry;
+    tm_unlock();
+} // monitor_revoke()
+
+#endif // JEL_BIASED_LOCKING
+
+/** Tries to acquire the thin lock of an object. A thread which finds the lock
+ * held by another thread inflates it right away and then contends for the
+ * monitor, where it spins for a bounded time and parks. With
+ * biased locking the first thread acquiring the lock keeps it biased toward
+ * itself and acquires it again without atomic operations, other threads revoke
+ * the bias by inflating the lock
+ * \param thread The thread requesting the lock
+ * \param ref A Java object reference
+ * \returns true if the thin lock was acquired, false if the lock is inflated
+ * and must be acquired through the monitor */
+
+static bool monitor_thin_enter(thread_t *thread, uintptr_t ref)
+{
+    volatile header_t *header = (header_t *) ref;
+    header_t old;
+    uint32_t owner, id = thread->lock_id;
+
+    while (1) {
+        old = *header;
+        owner = header_lock_owner(old);
+
+        if (owner == HEADER_LOCK_INFLATED) {
+            return false;
+        } else if (owner == 0) {
+            if (id == 0) {
+                // No identifier left for this thread, use a monitor
+                monitor_inflate(thread, ref);
+                return false;
+            } else if (__sync_bool_compare_and_swap(header, old,
+                           old | ((header_t) id << HEADER_LOCK_OWNER_SHIFT)
+#if JEL_BIASED_LOCKING
+                               | ((header_t) 1 << HEADER_LOCK_COUNT_SHIFT)
+#endif // JEL_BIASED_LOCKING
+                           ))
+            {
+                return true;
+            }
+        } else if (owner == id) {
+#if JEL_BIASED_LOCKING
+            if (header_lock_holds(old) < HEADER_LOCK_COUNT_MAX) {
+                header_lock_set_holds((header_t *) header,
+                                      header_lock_holds(old) + 1);
+                return true;
+            }
+#else
+            if (header_lock_count(old) < HEADER_LOCK_COUNT_MAX) {
+                /* Another thread may be inflating the lock, retry if it did so
+                 * in the meantime */
+                if (__sync_bool_compare_and_swap(header, old,
+                        old + ((header_t) 1 << HEADER_LOCK_COUNT_SHIFT)))
+                {
+                    return true;
+                }
+
+                continue;
             }
+#endif // JEL_BIASED_LOCKING
+
+            // The recursion count overflowed, move it to a monitor
+            monitor_inflate(thread, ref);
+            return false;
+        } else {
+#if JEL_BIASED_LOCKING
+            monitor_revoke(ref);
+#else
+            // This lock is contended, queue on its monitor instead of spinning
+            monitor_inflate(thread, ref);
+            return false;
+#endif // JEL_BIASED_LOCKING
+        }
+    }
+} // monitor_thin_enter()
+
+/** Releases the thin lock of an object
+ * \param thread The thread releasing the lock
+ * \param ref A Java object reference
+ * \param done Set to true if \a thread held the thin lock
+ * \returns true if the lock is inflated and must be released through the
+ * monitor, false otherwise */
 
-            // Check if we must grow the table
-            tm.entries++;
+static bool monitor_thin_exit(thread_t *thread, uintptr_t ref, bool *done)
+{
+    volatile header_t *header = (header_t *) ref;
+    header_t old;
+    uint32_t owner;
+
+    while (1) {
+        old = *header;
+        owner = header_lock_owner(old);
+
+        if (owner == HEADER_LOCK_INFLATED) {
+            /* A contending thread may have inflated the lock while we held
+             * it, release it through the monitor so that it is handed over */
+            return true;
+        }
+
+        if ((owner == 0) || (owner != thread->lock_id)
+            || (header_lock_holds(old) == 0))
+        {
+            *done = false;
+            return false;
+        }
 
-            if (tm.entries == tm.capacity) {
-                tm_rehash(true);
-            } else if (tm.entries < (tm.capacity / 4)) {
-                tm_rehash(false);
+#if JEL_BIASED_LOCKING
+        // Only the owner changes the lock state of a lock biased toward it
+        header_lock_set_holds((header_t *) header, header_lock_holds(old) - 1);
+        break;
+#else
+        /* Contending threads may inflate the lock at any time, the
+         * compare-and-swap fails if they did */
+        if (header_lock_count(old) != 0) {
+            if (__sync_bool_compare_and_swap(header, old,
+                    old - ((header_t) 1 << HEADER_LOCK_COUNT_SHIFT)))
+            {
+                break;
             }
+        } else if (__sync_bool_compare_and_swap(header, old,
+                       old & ~HEADER_LOCK_MASK))
+        {
+            break;
+        }
+#endif // JEL_BIASED_LOCKING
+    }
+
+    *done = true;
+    return false;
+} // monitor_thin_exit()
+
+#endif // JEL_THIN_LOCKS
+
+/** Implements the MONITOR_ENTER opcode. A thread finding the monitor owned
+ * by another thread spins for a while and then parks itself in the monitor's
+ * queue until the owner hands the monitor over. The number of spins adapts to
+ * how often spinning succeeded in the past
+ * \param thread The thread requesting the monitor
+ * \param ref A Java object reference */
+
+void monitor_enter(thread_t *thread, uintptr_t ref)
+{
+    monitor_t *entry;
+    uint32_t spin = 0;
+
+#if JEL_THIN_LOCKS
+    if (monitor_thin_enter(thread, ref)) {
+        return;
+    }
+#endif // JEL_THIN_LOCKS
+
+    tm_lock();
+    entry = monitor_get(ref);
+
+    if (entry->owner == thread) {
+        entry->count++;
+        tm_unlock();
+        return;
+    }
+
+    // The monitor is contended, the owner might release it soon
+    while ((entry->owner != NULL) && (spin < entry->spin)
+           && monitor_may_spin(entry->owner))
+    {
+        tm_unlock();
+        thread_yield();
+        tm_lock();
+        entry = monitor_get(ref); // The table might have been rehashed
+        spin++;
+    }
+
+    if (entry->owner == NULL) {
+        if (spin != 0) {
+            entry->spin = size_min(entry->spin * 2, MONITOR_SPIN_MAX);
         }
-    } while (!done);
+
+        entry->owner = thread;
+        entry->count = 1;
+    } else {
+        // Spinning failed, park until monitor_exit() hands the monitor over
+        entry->spin = size_max(entry->spin / 2, 1);
+        monitor_enqueue(&entry->queue, thread);
+        thread->parked = true;
+        monitor_park(thread, 0, 0, false);
+        return;
+    }
 
     tm_unlock();
 } // monitor_enter()
@@ -803,6 +1540,12 @@ bool monitor_exit(thread_t *thread, uintptr_t ref)
     size_t hash;
     bool done = false;
 
+#if JEL_THIN_LOCKS
+    if (!monitor_thin_exit(thread, ref, &done)) {
+        return done;
+    }
+#endif // JEL_THIN_LOCKS
+
     tm_lock();
     hash = tm_hash(ref) & (tm.capacity - 1);
 
@@ -815,11 +1558,12 @@ bool monitor_exit(thread_t *thread, uintptr_t ref)
 
     if (entry) {
         if (entry->owner == thread) {
-            if (entry->count == 1) {
-                entry->owner = NULL;
+            entry->count--;
+
+            if (entry->count == 0) {
+                monitor_release(entry);
             }
 
-            entry->count--;
             done = true;
         }
     }
@@ -872,15 +1616,202 @@ void thread_pop_root( void )
     thread_self()->roots.used--;
 } // thread_pop_root()
 
-/** Initializes all the thread-local structures required for normal operation
- * of a thread including the thread's self reference
- * \param thread A pointer to the thread's own structure */
+/** Clears a thread structure and creates its synchronization primitives
+ * \param thread A pointer to the thread structure */
 
-void thread_init(thread_t *thread)
+static void thread_setup(thread_t *thread)
 {
     memset(thread, 0, sizeof(thread_t));
-    thread_set_self(thread);
     native_cond_create(&thread->cond);
+    native_mutex_create(&thread->park_lock);
+    native_cond_create(&thread->park);
+} // thread_setup()
+
+/** Returns the end of a thread's stack, or of its first segment if segmented
+ * stacks are enabled. The frame pointer of a thread which is not running any
+ * method points there
+ * \param thread A pointer to the thread
+ * \returns A pointer right past the outermost frame */
+
+stack_frame_t *thread_stack_end(thread_t *thread)
+{
+#if JEL_SEGMENTED_STACKS
+    size_t stack_size = opts_get_stack_segment_size();
+#else
+    size_t stack_size = opts_get_stack_size();
+#endif // JEL_SEGMENTED_STACKS
+
+    return (stack_frame_t *) ((char *) thread->stack + stack_size);
+} // thread_stack_end()
+
+/** Allocates the stack of a thread, only its first segment is allocated when
+ * segmented stacks are enabled
+ * \param thread A pointer to the thread */
+
+static void thread_stack_create(thread_t *thread)
+{
+#if JEL_SEGMENTED_STACKS
+    size_t stack_size = opts_get_stack_segment_size();
+#else
+    size_t stack_size = opts_get_stack_size();
+#endif // JEL_SEGMENTED_STACKS
+
+    thread->stack = gc_malloc(stack_size);
+    thread->sp = thread->stack;
+    thread->fp = thread_stack_end(thread);
+#if JEL_SEGMENTED_STACKS
+    thread->stack_used = stack_size;
+#endif // JEL_SEGMENTED_STACKS
+} // thread_stack_create()
+
+/** Releases the stack of a thread including all its segments
+ * \param thread A pointer to the thread */
+
+static void thread_stack_dispose(thread_t *thread)
+{
+#if JEL_SEGMENTED_STACKS
+    stack_segment_t *segment = thread->segment;
+    stack_segment_t *prev;
+
+    while (segment != NULL) {
+        prev = segment->prev;
+        gc_free(segment);
+        segment = prev;
+    }
+
+    gc_free(thread->spare);
+    thread->segment = NULL;
+    thread->spare = NULL;
+#endif // JEL_SEGMENTED_STACKS
+
+    gc_free(thread->stack);
+} // thread_stack_dispose()
+
+#if JEL_SEGMENTED_STACKS
+
+/** Allocates a new stack segment for a call which does not fit in the current
+ * one. The arguments of the call are moved at the beginning of the new segment
+ * and a link frame returning to the caller is placed at its end. The state of
+ * the calling thread must have been saved as the allocation may trigger a
+ * garbage collection. On return the thread's stack pointer points to the moved
+ * arguments and its frame pointer to the link frame
+ * \param thread The calling thread
+ * \param args A pointer to the arguments of the call
+ * \param n The size of the arguments in words
+ * \param size The size in words of the callee's locals and operand stack
+ * \returns A pointer to the link frame */
+
+stack_frame_t *thread_stack_grow(thread_t *thread, jword_t *args, uint32_t n,
+                                 uint32_t size)
+{
+    stack_segment_t *segment = thread->spare;
+    stack_frame_t *link;
+    jword_t *base;
+    size_t bytes;
+
+    /* Make room for the callee, the link frame and the two frames pushed by
+     * prepare_for_call() as a nested call may start a segment too */
+    bytes = sizeof(stack_segment_t) + (size * sizeof(jword_t))
+            + (3 * sizeof(stack_frame_t));
+    bytes = size_ceil(bytes, sizeof(stack_frame_t));
+
+    if (bytes < opts_get_stack_segment_size()) {
+        bytes = opts_get_stack_segment_size();
+    }
+
+    if ((segment != NULL) && (segment->size >= bytes)) {
+        bytes = segment->size;
+    } else {
+        segment = NULL;
+    }
+
+    if (thread->stack_used + bytes > opts_get_stack_size()) {
+        c_throw(JAVA_LANG_VIRTUALMACHINEERROR,
+                "Stack overflow, try using a larger stack with the --stack-size"
+                " parameter");
+    }
+
+    if (segment == NULL) {
+        gc_free(thread->spare);
+        segment = gc_malloc(bytes);
+    }
+
+    thread->spare = NULL;
+
+    segment->prev = thread->segment;
+    segment->sp = args;
+    segment->fp = thread->fp;
+    segment->size = bytes;
+
+    base = (jword_t *) (segment + 1);
+    memcpy(base, args, n * sizeof(jword_t));
+
+    link = (stack_frame_t *) ((char *) segment + bytes) - 1;
+    link->cl = NULL;
+    link->method = &segment_method;
+    link->pc = segment_method.code;
+    link->locals = base;
+
+    thread->segment = segment;
+    thread->stack_used += bytes;
+    thread->sp = base;
+    thread->fp = link;
+
+    return link;
+} // thread_stack_grow()
+
+/** Releases the current stack segment once the call which started it is over.
+ * The words found between the beginning of the segment and \a sp, i.e. the
+ * return value of the call if any, are moved back where the arguments were in
+ * the previous segment. On return the thread's stack pointer points right past
+ * them and its frame pointer to the caller's frame
+ * \param thread The calling thread
+ * \param sp The stack pointer within the current segment
+ * \returns A pointer to the caller's frame */
+
+stack_frame_t *thread_stack_shrink(thread_t *thread, jword_t *sp)
+{
+    stack_segment_t *segment = thread->segment;
+    jword_t *base = (jword_t *) (segment + 1);
+    size_t n = sp - base;
+
+    memcpy(segment->sp, base, n * sizeof(jword_t));
+
+    /* Leave the thread in a consistent state before releasing the segment as
+     * the collector may run in the meantime */
+    thread->sp = segment->sp + n;
+    thread->fp = segment->fp;
+#if JEL_PRECISE_GC
+    thread->pc = (thread->fp != thread_stack_end(thread)) ? thread->fp->pc
+                                                           : NULL;
+#endif // JEL_PRECISE_GC
+    thread->segment = segment->prev;
+    thread->stack_used -= segment->size;
+
+    /* Keep the largest segment around so that a call sitting on a segment
+     * boundary doesn't allocate and release one every time */
+    if (thread->spare == NULL) {
+        thread->spare = segment;
+    } else if (thread->spare->size < segment->size) {
+        gc_free(thread->spare);
+        thread->spare = segment;
+    } else {
+        gc_free(segment);
+    }
+
+    return thread->fp;
+} // thread_stack_shrink()
+
+#endif // JEL_SEGMENTED_STACKS
+
+/** Initializes all the thread-local structures required for normal operation
+ * of a thread including the thread's self reference
+ * \param thread A pointer to the thread's own structure */
+
+void thread_init(thread_t *thread)
+{
+    thread_setup(thread);
+    thread_set_self(thread);
 } // thread_init()
 
 /** Creates the main thread. This function doesn't return until the main thread
@@ -895,24 +1826,22 @@ void thread_init(thread_t *thread)
 uintptr_t thread_create_main(thread_t *thread, method_t *run, uintptr_t *args)
 {
     class_t *thread_cl = bcl_find_class("java/lang/Thread");
-    size_t stack_size = opts_get_stack_size();
+    uintptr_t name;
 
     /* Contrary to the startup of a 'regular' thread we do not initialize nor
      * register the thread as the main thread has already been initialized and
      * registered even though it is only partially initialized */
 
     // Build the stack
-    thread->stack = gc_malloc(stack_size);
-    thread->sp = thread->stack;
-    thread->fp = (stack_frame_t *) ((char *) thread->stack + stack_size);
+    thread_stack_create(thread);
 
     /* Create the first Java thread structure, since the first thread is not
      * created by VMThread.start() we have to do it by hand */
     thread->obj = gc_new(thread_cl);
     JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = (uintptr_t) thread;
     JAVA_LANG_THREAD_REF2PTR(thread->obj)->priority = 5;
-    JAVA_LANG_THREAD_REF2PTR(thread->obj)->name =
-        JAVA_LANG_STRING_PTR2REF(jstring_create_from_utf8("Thread-0"));
+    name = JAVA_LANG_STRING_PTR2REF(jstring_create_from_utf8("Thread-0"));
+    gc_ref_store(&JAVA_LANG_THREAD_REF2PTR(thread->obj)->name, name);
 
     // HACK: Push the arguments on top of the stack
     *((uintptr_t *) thread->sp) = *args;
@@ -923,12 +1852,15 @@ uintptr_t thread_create_main(thread_t *thread, method_t *run, uintptr_t *args)
     // Mark the thread as dead, none can join on it anymore after this point
     tm_lock();
     native_cond_broadcast(&thread->cond);
+#if JEL_GREEN_THREADS
+    green_wake_joiners(thread);
+#endif // JEL_GREEN_THREADS
     tm_unregister(thread);
     JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = JNULL;
     tm_unlock();
 
     gc_free(thread->roots.pointers);
-    gc_free(thread->stack);
+    thread_stack_dispose(thread);
 
     return thread->exception;
 } // thread_create_main()
@@ -940,17 +1872,35 @@ uintptr_t thread_create_main(thread_t *thread, method_t *run, uintptr_t *args)
 void thread_sleep(int64_t ms)
 {
     thread_t *self = thread_self();
+#if JEL_GREEN_THREADS
+    bool unmountable = green_take_restartable(self);
+#endif // JEL_GREEN_THREADS
 
     tm_lock();
 
+#if JEL_GREEN_THREADS
+    if (unmountable) {
+        if (self->green.phase == GREEN_SLEEPING) {
+            // The native method was re-invoked, the sleep is over
+            self->green.phase = GREEN_NONE;
+            self->parked = false;
+        } else if (!self->interrupted) {
+            // Park without holding on to the carrier
+            self->green.phase = GREEN_SLEEPING;
+            self->parked = true;
+            green_park(self, ms, 0, true);
+            return;
+        }
+    } else
+#endif // JEL_GREEN_THREADS
     if (!self->interrupted) {
         native_cond_t cond; // Dummy condition variable
 
         native_cond_create(&cond);
         self->cond_int = &cond;
-        thread_may_block();
+        thread_may_block_long();
         native_cond_timed_wait(&cond, &tm.lock, ms, 0);
-        thread_resumes();
+        thread_resumes_long();
         self->cond_int = NULL;
     }
 
@@ -964,28 +1914,139 @@ void thread_sleep(int64_t ms)
 
 #if !JEL_THREAD_NONE
 
+/** Links a thread to its java.lang.Thread object and registers it, must be
+ * called with the global lock held
+ * \param thread A pointer to the thread
+ * \param ref A reference to the java.lang.Thread object */
+
+static void thread_bind(thread_t *thread, uintptr_t ref)
+{
+    thread->obj = ref;
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = (uintptr_t) thread;
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->priority = 5;
+    tm_register(thread);
+} // thread_bind()
+
+/** Runs the code of a Java thread then marks it as dead. This function returns
+ * with the global lock held
+ * \param thread A pointer to the thread
+ * \param run The first method executed by the thread */
+
+static void thread_run(thread_t *thread, method_t *run)
+{
+    int exception;
+
+    // HACK: Push the 'this' pointer on top of the stack
+    *((uintptr_t *) thread->stack) = thread->obj;
+
+    c_try {
+        interpreter(run); // Run the new thread's code
+    } c_catch (exception) {
+        c_print_exception(exception);
+        c_clear_exception();
+        /* FIXME: The thread must shut down but the rest of the VM should be
+         * kept running and joining threads must be woken up. */
+        vm_fail();
+    }
+
+    // Mark the thread as dead, none can join on it anymore after this point
+    tm_lock();
+
+    native_cond_broadcast(&thread->cond);
+#if JEL_GREEN_THREADS
+    green_wake_joiners(thread);
+#endif // JEL_GREEN_THREADS
+    tm_unregister(thread);
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = JNULL;
+
+    if (thread->exception != JNULL) {
+        // TODO: Print the exception and stack trace
+        dbg_error("Uncaught exception");
+        vm_fail();
+    }
+} // thread_run()
+
+#if JEL_THREAD_POOL
+
+/** Puts a thread whose Java thread has terminated in the pool of idle threads
+ * and waits until thread_launch() hands it a new Java thread or the idle
+ * timeout expires. The thread keeps its stack and temporary roots area. This
+ * function must be called with the global lock held and returns with the lock
+ * still held
+ * \param thread A pointer to the thread
+ * \returns The first method of the new Java thread, the thread has already
+ * been registered by thread_launch(), or NULL if the thread timed out and left
+ * the pool */
+
+static method_t *thread_pool_wait(thread_t *thread)
+{
+    uint64_t deadline = get_time_usec()
+                        + (uint64_t) opts_get_thread_idle_timeout() * 1000;
+    uint64_t now;
+    thread_t **link;
+
+    // Clear the state left over by the previous Java thread
+    thread->obj = JNULL;
+    thread->exception = JNULL;
+    thread->interrupted = false;
+    thread->sp = thread->stack;
+    thread->fp = thread_stack_end(thread);
+    thread->pc = NULL;
+
+    thread->pool.run = NULL;
+    thread->pool.next = tm.pool;
+    tm.pool = thread;
+
+    /* The thread looks blocked to the collector from the moment it is handed a
+     * new Java thread until it wakes up */
+    thread_may_block();
+
+    while (thread->pool.run == NULL) {
+        now = get_time_usec();
+
+        if (now >= deadline) {
+            // Nobody needed this thread for too long, leave the pool
+            link = &tm.pool;
+
+            while (*link != thread) {
+                link = &(*link)->pool.next;
+            }
+
+            *link = thread->pool.next;
+            break;
+        }
+
+        native_cond_timed_wait(&thread->cond, &tm.lock, (deadline - now) / 1000,
+                               ((deadline - now) % 1000) * 1000);
+    }
+
+    thread_resumes();
+
+    return thread->pool.run;
+} // thread_pool_wait()
+
+#endif // JEL_THREAD_POOL
+
 /** Startup function used as the entry point of a new thread. Both the payload
  * passed in \a arg and the new thread structures (including the stack) will be
- * fred by this function upon ending execution
+ * fred by this function upon ending execution. With the thread pool enabled
+ * the thread runs the Java threads handed to it by thread_launch() until it
+ * stays idle for too long
  * \param arg A pointer to the thread payload structure
  * \returns Nothing important */
 
 static void *thread_start(void *arg)
 {
-    size_t stack_size = opts_get_stack_size();
     thread_payload_t *payload = (thread_payload_t *) arg;
     method_t *run = payload->run;
     uintptr_t *ref = payload->ref;
     thread_t thread;
-    int exception;
 
     // Initialize the new thread
     thread_init(&thread);
 
     // Build the stack
-    thread.stack = gc_malloc(stack_size);
-    thread.sp = thread.stack;
-    thread.fp = (stack_frame_t *) ((char *) thread.stack + stack_size);
+    thread_stack_create(&thread);
 
     // Create the temporary roots area
     thread.roots.capacity = THREAD_TMP_ROOTS;
@@ -994,64 +2055,73 @@ static void *thread_start(void *arg)
     tm_lock();
 
     // Link the java.lang.Thread object to the VM thread and register it
-    thread.obj = *ref;
-    JAVA_LANG_THREAD_REF2PTR(thread.obj)->vmThread = (uintptr_t) &thread;
-    JAVA_LANG_THREAD_REF2PTR(thread.obj)->priority = 5;
-    tm_register(&thread);
+    thread_bind(&thread, *ref);
 
     // Inform the parent thread that we're starting execution
     thread.native = payload->thread;
     native_cond_signal(&payload->cond);
     tm_unlock();
 
-    // HACK: Push the 'this' pointer on top of the stack
-    *((uintptr_t *) thread.stack) = thread.obj;
-
-    c_try {
-        interpreter(run); // Run the new thread's code
-    } c_catch (exception) {
-        c_print_exception(exception);
-        c_clear_exception();
-        /* FIXME: The thread must shut down but the rest of the VM should be
-         * kept running and joining threads must be woken up. */
-        vm_fail();
-    }
+#if JEL_THREAD_POOL
+    while (true) {
+        thread_run(&thread, run);
+        run = thread_pool_wait(&thread);
 
-    // Mark the thread as dead, none can join on it anymore after this point
-    tm_lock();
+        if (run == NULL) {
+            break;
+        }
 
-    native_cond_broadcast(&thread.cond);
-    tm_unregister(&thread);
-    JAVA_LANG_THREAD_REF2PTR(thread.obj)->vmThread = JNULL;
+        tm_unlock();
+    }
+#else
+    thread_run(&thread, run);
+#endif // JEL_THREAD_POOL
 
     /* We can safely release the stack and root pointers now that the thread
      * is not visible anymore to the garbage collector */
     gc_free(thread.roots.pointers);
-    gc_free(thread.stack);
+    thread_stack_dispose(&thread);
 
     tm_unlock();
 
     // Wait for the joining thread to wake up
     native_cond_dispose(&thread.cond);
-
-    if (thread.exception != JNULL) {
-        // TODO: Print the exception and stack trace
-        dbg_error("Uncaught exception");
-        vm_fail();
-    }
+    native_cond_dispose(&thread.park);
+    native_mutex_dispose(&thread.park_lock);
 
     native_thread_exit();
 
     return NULL;
 } // thread_start()
 
-/** Creates a new thread executing the provided method
+/** Creates a new thread executing the provided method. With the thread pool
+ * enabled the method is handed to an idle thread if there is one
  * \param ref The java.lang.Thread object associated with this thread
  * \param run The first method executed by this thread */
 
 void thread_launch(uintptr_t *ref, method_t *run)
 {
     thread_payload_t *payload;
+#if JEL_THREAD_POOL
+    thread_t *thread;
+
+    tm_lock();
+    thread = tm.pool;
+
+    if (thread != NULL) {
+        /* Register the idle thread right away, it still counts as blocked so a
+         * stop-the-world does not need to wait for it to wake up */
+        tm.pool = thread->pool.next;
+        thread->pool.next = NULL;
+        thread->pool.run = run;
+        thread_bind(thread, *ref);
+        native_cond_signal(&thread->cond);
+        tm_unlock();
+        return;
+    }
+
+    tm_unlock();
+#endif // JEL_THREAD_POOL
 
     // Prepare the thread payload
     payload = gc_malloc(sizeof(thread_payload_t));
@@ -1120,6 +2190,36 @@ void thread_resumes( void )
     }
 } // thread_resumes()
 
+/** Stops the calling thread if a stop-the-world has been requested. This is
+ * called by the interpreter at safepoints once it has noticed that the
+ * thread's stopped flag is set, the interpreter state must have been saved
+ * \returns true if the calling virtual thread must be unmounted from its
+ * carrier, the interpreter then returns to the carrier */
+
+bool thread_safepoint( void )
+{
+#if JEL_GREEN_THREADS
+    thread_t *self = thread_self();
+
+    if (self->green.preempt) {
+        self->green.preempt = false;
+
+        /* The time slice is over, give up the carrier if another virtual
+         * thread is waiting for one. The carrier stops this thread if a
+         * stop-the-world is pending */
+        if (thread_can_unmount(self) && green_has_work()) {
+            self->green.unmount = true;
+            self->green.park = false;
+            return true;
+        }
+    }
+#endif // JEL_GREEN_THREADS
+
+    thread_may_block();
+    thread_resumes();
+    return false;
+} // thread_safepoint()
+
 /** Interrupts a thread. This function is used for implementing the
  * java.lang.Thread.interrupt() method and can interrupt immediately the
  * java.lang.Object.wait() and java.lang.Thread.sleep() methods but only
@@ -1135,6 +2235,16 @@ void thread_interrupt(thread_t *thread)
         native_cond_signal(thread->cond_int);
     }
 
+    // Wake up the thread if it is in the wait set of a monitor
+    if (thread->parked) {
+        native_mutex_lock(&thread->park_lock);
+        native_cond_signal(&thread->park);
+#if JEL_GREEN_THREADS
+        green_wake(thread, true);
+#endif // JEL_GREEN_THREADS
+        native_mutex_unlock(&thread->park_lock);
+    }
+
     tm_unlock();
 } // thread_interrupt()
 
@@ -1143,6 +2253,15 @@ void thread_interrupt(thread_t *thread)
 
 void thread_yield( void )
 {
+#if JEL_GREEN_THREADS
+    thread_t *self = thread_self();
+
+    // A virtual thread gives up its carrier at the next safepoint
+    if ((self != NULL) && self->green.is_virtual) {
+        self->green.preempt = true;
+    }
+#endif // JEL_GREEN_THREADS
+
     native_thread_yield();
 } // thread_yield()
 
@@ -1155,17 +2274,55 @@ void thread_join(uintptr_t *thread)
 {
     thread_t *self = thread_self();
     thread_t *target;
+#if JEL_GREEN_THREADS
+    thread_t **link;
+    bool unmountable = green_take_restartable(self);
+#endif // JEL_GREEN_THREADS
 
     tm_lock();
 
+#if JEL_GREEN_THREADS
+    if (unmountable && (self->green.phase == GREEN_JOINING)) {
+        // The native method was re-invoked, the join is over
+        self->green.phase = GREEN_NONE;
+
+        if (self->parked) {
+            // We were interrupted, the target is still alive
+            link = &self->green.joined->green.joiners;
+
+            while (*link != self) {
+                link = &(*link)->park_next;
+            }
+
+            *link = self->park_next;
+            self->park_next = NULL;
+            self->parked = false;
+        }
+
+        self->green.joined = NULL;
+    } else
+#endif // JEL_GREEN_THREADS
     if (!self->interrupted) {
         target = (thread_t *) JAVA_LANG_THREAD_REF2PTR(*thread)->vmThread;
 
         if (target != NULL) {
+#if JEL_GREEN_THREADS
+            if (unmountable) {
+                // Park until the target dies without holding on to the carrier
+                self->green.phase = GREEN_JOINING;
+                self->green.joined = target;
+                self->park_next = target->green.joiners;
+                target->green.joiners = self;
+                self->parked = true;
+                green_park(self, 0, 0, true);
+                return;
+            }
+#endif // JEL_GREEN_THREADS
+
             self->cond_int = &target->cond;
-            thread_may_block();
+            thread_may_block_long();
             native_cond_wait(&target->cond, &tm.lock);
-            thread_resumes();
+            thread_resumes_long();
             self->cond_int = NULL;
         }
     }
@@ -1178,6 +2335,55 @@ void thread_join(uintptr_t *thread)
     tm_unlock();
 } // thread_join()
 
+#if JEL_GREEN_THREADS
+
+/** Completes a java.lang.Object.wait() call of a virtual thread which was
+ * unmounted while waiting, the native method invoking thread_wait() is run
+ * again once the thread has been resumed. The thread either owns the monitor
+ * again or it parks once more until it is handed over to it
+ * \param self The calling thread
+ * \param ref The object on which the thread was waiting
+ * \returns true */
+
+static bool thread_wait_resume(thread_t *self, uintptr_t ref)
+{
+    monitor_t *entry;
+
+    tm_lock();
+    entry = monitor_get(ref);
+
+    if ((self->green.phase == GREEN_WAITING) && self->parked) {
+        /* We timed out or were interrupted, leave the wait set or the entry
+         * queue and re-acquire the monitor */
+        monitor_unlink(entry, self);
+        self->parked = false;
+
+        if (entry->owner != NULL) {
+            monitor_enqueue(&entry->queue, self);
+            self->parked = true;
+            self->green.phase = GREEN_REENTERING;
+            green_park(self, 0, 0, false);
+            return true;
+        }
+
+        entry->owner = self;
+    }
+
+    // Restore the recursion count held before waiting
+    entry->count = self->green.count;
+    self->green.phase = GREEN_NONE;
+    tm_unlock();
+
+    if (self->interrupted) {
+        self->interrupted = false;
+        KNI_ThrowNew("java/lang/InterruptedException", NULL);
+    }
+
+    return true;
+} // thread_wait_resume()
+
+#endif // JEL_GREEN_THREADS
+
 /** Implements the functionality required by java.lang.Object.wait() and
  * friends, waiting on an object until it is notified by notify() or notifyAll()
  * or until a timeout occurs (if \a nanos or \a millis or both ar non-zero)
@@ -1192,7 +2398,23 @@ bool thread_wait(uintptr_t ref, uint64_t millis, uint32_t nanos)
 {
     thread_t *self = thread_self();
     monitor_t *entry;
-    size_t hash;
+    size_t hash, count;
+#if JEL_GREEN_THREADS
+    bool unmountable = green_take_restartable(self);
+
+    if (unmountable && (self->green.phase != GREEN_NONE)) {
+        return thread_wait_resume(self, ref);
+    }
+#endif // JEL_GREEN_THREADS
+
+#if JEL_THIN_LOCKS
+    // Waiting needs a condition variable so the thin lock must be inflated
+    if ((self->lock_id != 0)
+        && (header_lock_owner(*((header_t *) ref)) == self->lock_id))
+    {
+        monitor_inflate(self, ref);
+    }
+#endif // JEL_THIN_LOCKS
 
     tm_lock();
 
@@ -1204,43 +2426,56 @@ bool thread_wait(uintptr_t ref, uint64_t millis, uint32_t nanos)
         entry = entry->next;
     }
 
-    if (entry && !self->interrupted) {
-        if ((entry->owner == self) && (entry->count == 1)) {
-            // Release the lock and wait
-            entry->owner = NULL;
-            entry->count = 0;
-
-            if (entry->cond == NULL) {
-                entry->cond = gc_malloc(sizeof(native_cond_t));
-                native_cond_create(entry->cond);
-            }
-
-            self->cond_int = entry->cond;
-            thread_may_block();
+    if ((entry == NULL) || (entry->owner != self)) {
+        tm_unlock();
+        return false;
+    }
 
-            if ((millis == 0) && (nanos == 0)) {
-                native_cond_wait(entry->cond, &tm.lock);
-            } else {
-                native_cond_timed_wait(entry->cond, &tm.lock, millis, nanos);
-            }
+    if (!self->interrupted) {
+        /* Join the wait set and release the monitor, notify() moves this
+         * thread to the entry queue and the thread is woken up only once the
+         * monitor has been handed over to it */
+        count = entry->count;
+        monitor_enqueue(&entry->waiters, self);
+        self->parked = true;
+        monitor_release(entry);
+
+#if JEL_GREEN_THREADS
+        if (unmountable) {
+            // Park without holding on to the carrier
+            self->green.phase = GREEN_WAITING;
+            self->green.count = count;
+            green_park(self, millis, nanos, true);
+            return true;
+        }
+#endif // JEL_GREEN_THREADS
 
-            thread_resumes();
-            self->cond_int = NULL;
+        monitor_park(self, millis, nanos, true);
+        tm_lock();
 
-            // Re-acquire the monitor
+        if (self->parked) {
+            /* We timed out or were interrupted, leave the wait set or the
+             * entry queue and re-acquire the monitor */
+            monitor_unlink(monitor_get(ref), self);
+            self->parked = false;
             tm_unlock();
             monitor_enter(self, ref);
+            tm_lock();
         }
-    } else {
-        tm_unlock();
+
+        // Restore the recursion count held before waiting
+        entry = monitor_get(ref);
+        entry->count = count;
     }
 
+    tm_unlock();
+
     if (self->interrupted) {
         self->interrupted = false;
         KNI_ThrowNew("java/lang/InterruptedException", NULL);
     }
 
-    return entry ? true : false;
+    return true;
 } // thread_wait()
 
 /** Implements the functionliaty required by java.lang.Object.notify()
@@ -1254,10 +2489,22 @@ bool thread_wait(uintptr_t ref, uint64_t millis, uint32_t nanos)
 bool thread_notify(uintptr_t ref, bool broadcast)
 {
     thread_t *self = thread_self();
+    thread_t *waiter;
     monitor_t *entry;
     size_t hash;
     bool res = false;
 
+#if JEL_THIN_LOCKS
+    header_t value = *((header_t *) ref);
+    uint32_t owner = header_lock_owner(value);
+
+    // Nobody can be waiting on a lock which was never inflated
+    if (owner != HEADER_LOCK_INFLATED) {
+        return (owner != 0) && (owner == self->lock_id)
+               && (header_lock_holds(value) != 0);
+    }
+#endif // JEL_THIN_LOCKS
+
     tm_lock();
 
     // Look for the monitor
@@ -1270,12 +2517,14 @@ bool thread_notify(uintptr_t ref, bool broadcast)
 
     if (entry) {
         if (entry->owner == self) {
-            // Notify the waiting thread
-            if (entry->cond != NULL) {
-                if (broadcast) {
-                    native_cond_broadcast(entry->cond);
-                } else {
-                    native_cond_signal(entry->cond);
+            /* Move the notified threads to the entry queue, they stay parked
+             * until the monitor is handed over to them */
+            while ((waiter = entry->waiters) != NULL) {
+                entry->waiters = waiter->park_next;
+                monitor_enqueue(&entry->queue, waiter);
+
+                if (!broadcast) {
+                    break;
                 }
             }
 
@@ -1287,5 +2536,776 @@ bool thread_notify(uintptr_t ref, bool broadcast)
     return res;
 } // thread_notify()
 
+#if JEL_GREEN_THREADS
+
+/******************************************************************************
+ * Virtual threads                                                            *
+ ******************************************************************************/
+
+/* Virtual threads are Java threads which do not own a native thread, they are
+ * run by a small pool of native carrier threads instead. A virtual thread is
+ * unmounted from its carrier by returning from the interpreter with its state
+ * saved in its thread structure, this happens at safepoints when its time
+ * slice is over and when it parks. It is resumed later by calling
+ * interpreter() again on any carrier.
+ *
+ * Every carrier has its own queue of ready threads which holds the threads
+ * woken up by the virtual threads it runs, other threads go in a global queue.
+ * A carrier runs the threads in its own queue first, then those in the global
+ * queue and finally steals half of the queue of another carrier.
+ *
+ * Only a thread whose interpreter is not nested within a native function or
+ * the VM itself can be unmounted, other threads are pinned to their carrier
+ * for as long as they are nested. Blocking native methods which cannot be
+ * unmounted use thread_may_block_long() and thread_resumes_long() so that
+ * another carrier can stand in for theirs while they are blocked. */
+
+/** Initializes the virtual thread scheduler */
+
+static void green_init( void )
+{
+    size_t n = opts_get_carriers();
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (n == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif // _SC_NPROCESSORS_ONLN
+
+    memset(&gs, 0, sizeof(green_scheduler_t));
+    gs.target = (n == 0) ? 1 : size_min(n, GREEN_MAX_CARRIERS);
+    native_mutex_create(&gs.lock);
+    native_cond_create(&gs.cond);
+    native_cond_create(&gs.tick);
+
+    for (size_t i = 0; i < GREEN_MAX_CARRIERS; i++) {
+        native_mutex_create(&gs.carrier[i].lock);
+    }
+} // green_init()
+
+/** Cancels the carriers and the ticker thread, the caller must hold the VM
+ * lock and must have stopped the world */
+
+static void green_teardown( void )
+{
+    native_mutex_lock(&gs.lock);
+
+    for (size_t i = 0; i < GREEN_MAX_CARRIERS; i++) {
+        if (gs.carrier[i].used) {
+            pthread_cancel(gs.carrier[i].native);
+        }
+    }
+
+    if (gs.started) {
+        pthread_cancel(gs.ticker);
+    }
+
+    native_mutex_unlock(&gs.lock);
+} // green_teardown()
+
+/** Consumes the flag set by thread_may_unmount() before a restartable
+ * operation
+ * \param thread The calling thread
+ * \returns true if the operation may unmount the thread */
+
+static bool green_take_restartable(thread_t *thread)
+{
+    bool restartable = thread->green.restartable;
+
+    thread->green.restartable = false;
+    return restartable && thread_can_unmount(thread);
+} // green_take_restartable()
+
+/** Starts a new carrier if a slot is available, the caller must hold the
+ * scheduler lock */
+
+static void green_spawn( void )
+{
+    green_carrier_t *carrier;
+
+    for (size_t i = 0; i < GREEN_MAX_CARRIERS; i++) {
+        carrier = gs.carrier + i;
+
+        if (!carrier->used) {
+            carrier->used = true;
+            carrier->current = NULL;
+            gs.carriers++;
+            native_thread_create(&carrier->native, green_carrier, carrier);
+            return;
+        }
+    }
+} // green_spawn()
+
+/** Checks if any virtual thread is waiting for a carrier, this does not
+ * take any lock and is only a hint
+ * \returns true if a ready queue is not empty */
+
+static bool green_has_work( void )
+{
+    if (*((thread_t * volatile *) &gs.ready) != NULL) {
+        return true;
+    }
+
+    for (size_t i = 0; i < GREEN_MAX_CARRIERS; i++) {
+        if (*((volatile size_t *) &gs.carrier[i].length) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+} // green_has_work()
+
+/** Makes sure that a carrier will pick up the ready virtual threads, waking
+ * up an idle one or starting a new one if fewer than the target number of
+ * carriers are running. The caller must hold the scheduler lock */
+
+static void green_balance( void )
+{
+    if (!green_has_work()) {
+        return;
+    }
+
+    if (gs.idle != 0) {
+        native_cond_signal(&gs.cond);
+    } else if (gs.carriers - gs.blocked < gs.target) {
+        green_spawn();
+    }
+} // green_balance()
+
+/** Returns the carrier the calling thread is running on
+ * \returns A pointer to the carrier or NULL if the calling thread is not a
+ * mounted virtual thread */
+
+static green_carrier_t *green_carrier_self( void )
+{
+    thread_t *self = thread_self();
+
+    return (self != NULL) ? self->green.carrier : NULL;
+} // green_carrier_self()
+
+/** Appends a virtual thread to a ready queue and makes sure a carrier will
+ * run it. Threads made ready by a carrier go in its local queue, the others
+ * in the global one
+ * \param carrier The carrier whose local queue is used, NULL for the global
+ * queue
+ * \param thread A pointer to an unmounted virtual thread */
+
+static void green_ready(green_carrier_t *carrier, thread_t *thread)
+{
+    thread->green.state = GREEN_READY;
+    thread->green.ready_next = NULL;
+
+    if (carrier != NULL) {
+        native_mutex_lock(&carrier->lock);
+
+        if (carrier->tail != NULL) {
+            carrier->tail->green.ready_next = thread;
+        } else {
+            carrier->head = thread;
+        }
+
+        carrier->tail = thread;
+        carrier->length++;
+        native_mutex_unlock(&carrier->lock);
+    } else {
+        native_mutex_lock(&gs.lock);
+
+        if (gs.ready_tail != NULL) {
+            gs.ready_tail->green.ready_next = thread;
+        } else {
+            gs.ready = thread;
+        }
+
+        gs.ready_tail = thread;
+        native_mutex_unlock(&gs.lock);
+    }
+
+    /* Pairs with the barrier of an idle carrier, either the carrier sees the
+     * new thread or we see the carrier */
+    memory_barrier();
+
+    if ((*((volatile size_t *) &gs.idle) != 0)
+        || (*((volatile size_t *) &gs.carriers)
+            - *((volatile size_t *) &gs.blocked) < gs.target))
+    {
+        native_mutex_lock(&gs.lock);
+        green_balance();
+        native_mutex_unlock(&gs.lock);
+    }
+} // green_ready()
+
+/** Removes the first virtual thread from the global ready queue
+ * \returns A pointer to a thread or NULL if the queue is empty */
+
+static thread_t *green_pop_global( void )
+{
+    thread_t *thread;
+
+    if (*((thread_t * volatile *) &gs.ready) == NULL) {
+        return NULL;
+    }
+
+    native_mutex_lock(&gs.lock);
+    thread = gs.ready;
+
+    if (thread != NULL) {
+        gs.ready = thread->green.ready_next;
+
+        if (gs.ready == NULL) {
+            gs.ready_tail = NULL;
+        }
+    }
+
+    native_mutex_unlock(&gs.lock);
+    return thread;
+} // green_pop_global()
+
+/** Removes the first virtual thread from the local queue of a carrier
+ * \param carrier A pointer to the carrier
+ * \returns A pointer to a thread or NULL if the queue is empty */
+
+static thread_t *green_pop_local(green_carrier_t *carrier)
+{
+    thread_t *thread;
+
+    native_mutex_lock(&carrier->lock);
+    thread = carrier->head;
+
+    if (thread != NULL) {
+        carrier->head = thread->green.ready_next;
+        carrier->length--;
+
+        if (carrier->head == NULL) {
+            carrier->tail = NULL;
+        }
+    }
+
+    native_mutex_unlock(&carrier->lock);
+    return thread;
+} // green_pop_local()
+
+/** Steals the last half of the local queue of another carrier, the first
+ * stolen thread is returned and the others are moved to the local queue of
+ * the calling carrier
+ * \param carrier A pointer to the calling carrier
+ * \returns A pointer to a thread or NULL if there was nothing to steal */
+
+static thread_t *green_steal(green_carrier_t *carrier)
+{
+    size_t index = carrier - gs.carrier;
+    green_carrier_t *victim;
+    thread_t *first, *last, *tail;
+    size_t n;
+
+    for (size_t i = 1; i < GREEN_MAX_CARRIERS; i++) {
+        victim = gs.carrier + (index + i) % GREEN_MAX_CARRIERS;
+
+        if (*((volatile size_t *) &victim->length) == 0) {
+            continue;
+        }
+
+        native_mutex_lock(&victim->lock);
+        n = victim->length - victim->length / 2;
+
+        if (n == 0) {
+            native_mutex_unlock(&victim->lock);
+            continue;
+        }
+
+        tail = victim->tail;
+
+        if (n == victim->length) {
+            first = victim->head;
+            victim->head = NULL;
+            victim->tail = NULL;
+        } else {
+            last = victim->head;
+
+            for (size_t j = 1; j < victim->length - n; j++) {
+                last = last->green.ready_next;
+            }
+
+            first = last->green.ready_next;
+            last->green.ready_next = NULL;
+            victim->tail = last;
+        }
+
+        victim->length -= n;
+        native_mutex_unlock(&victim->lock);
+
+        if (n > 1) {
+            native_mutex_lock(&carrier->lock);
+
+            if (carrier->tail != NULL) {
+                carrier->tail->green.ready_next = first->green.ready_next;
+            } else {
+                carrier->head = first->green.ready_next;
+            }
+
+            carrier->tail = tail;
+            carrier->length += n - 1;
+            native_mutex_unlock(&carrier->lock);
+        }
+
+        first->green.ready_next = NULL;
+        return first;
+    }
+
+    return NULL;
+} // green_steal()
+
+/** Picks the next virtual thread to be run by a carrier, looking in its local
+ * queue, then in the global one and finally in the queues of other carriers
+ * \param carrier A pointer to the calling carrier
+ * \returns A pointer to a thread or NULL if none is ready */
+
+static thread_t *green_next(green_carrier_t *carrier)
+{
+    thread_t *thread = NULL;
+
+    // Look at the global queue first once in a while so it is not starved
+    if ((++carrier->ticks % GREEN_GLOBAL_INTERVAL) == 0) {
+        thread = green_pop_global();
+    }
+
+    if (thread == NULL) {
+        thread = green_pop_local(carrier);
+    }
+
+    if (thread == NULL) {
+        thread = green_pop_global();
+    }
+
+    if (thread == NULL) {
+        thread = green_steal(carrier);
+    }
+
+    return thread;
+} // green_next()
+
+/** Parks the calling virtual thread by unmounting it from its carrier. The
+ * caller must hold the VM lock exactly once and must have set the parked flag
+ * of the thread, the VM lock is released. The interpreter unmounts the thread
+ * once this function has returned, the operation which parked the thread is
+ * then run again when the thread is resumed
+ * \param thread The calling thread
+ * \param millis Number of milliseconds before a timeout occurs
+ * \param nanos Number of nanoseconds before a timeout occurs
+ * \param interruptible If true resume the thread also when it is interrupted */
+
+static void green_park(thread_t *thread, uint64_t millis, uint32_t nanos,
+                       bool interruptible)
+{
+    thread->green.unmountable = false;
+    thread->green.unmount = true;
+    thread->green.park = true;
+    thread->green.interruptible = interruptible;
+
+    if ((millis == 0) && (nanos == 0)) {
+        thread->green.deadline = 0;
+    } else {
+        thread->green.deadline = get_time_usec() + millis * 1000
+                                 + (nanos + 999) / 1000;
+    }
+
+    tm_unlock();
+} // green_park()
+
+/** Makes a parked virtual thread ready, the caller must hold the park lock of
+ * the thread
+ * \param thread A pointer to a thread
+ * \param interrupt True if the thread is being interrupted */
+
+static void green_wake(thread_t *thread, bool interrupt)
+{
+    native_mutex_lock(&gs.lock);
+
+    if ((thread->green.state == GREEN_PARKED)
+        && (!interrupt || thread->green.interruptible))
+    {
+        green_ready(green_carrier_self(), thread);
+    }
+
+    native_mutex_unlock(&gs.lock);
+} // green_wake()
+
+/** Wakes up the virtual threads joining on a dying thread, the caller must
+ * hold the VM lock
+ * \param thread A pointer to the dying thread */
+
+static void green_wake_joiners(thread_t *thread)
+{
+    thread_t *joiner;
+
+    while ((joiner = thread->green.joiners) != NULL) {
+        thread->green.joiners = joiner->park_next;
+        joiner->park_next = NULL;
+        monitor_unpark(joiner);
+    }
+} // green_wake_joiners()
+
+/** Called by a carrier once it has unmounted a virtual thread, the thread is
+ * either parked or put back in a ready queue. A thread which used up its time
+ * slice goes in the global queue so that the threads already waiting there
+ * run first
+ * \param carrier A pointer to the calling carrier
+ * \param thread A pointer to the unmounted thread */
+
+static void green_unmounted(green_carrier_t *carrier, thread_t *thread)
+{
+    bool ready;
+
+    if (!thread->green.park) {
+        green_ready(NULL, thread);
+        return;
+    }
+
+    native_mutex_lock(&thread->park_lock);
+    native_mutex_lock(&gs.lock);
+
+    ready = !thread->parked
+            || (thread->green.interruptible && thread->interrupted)
+            || ((thread->green.deadline != 0)
+                && (thread->green.deadline <= get_time_usec()));
+
+    if (ready) {
+        green_ready(carrier, thread);
+    } else {
+        thread->green.state = GREEN_PARKED;
+
+        if ((thread->green.deadline != 0) && !thread->green.in_timer) {
+            thread->green.timer_next = gs.timers;
+            thread->green.in_timer = true;
+            gs.timers = thread;
+        }
+    }
+
+    native_mutex_unlock(&gs.lock);
+    native_mutex_unlock(&thread->park_lock);
+} // green_unmounted()
+
+/** Tears down a virtual thread which has finished executing, this mirrors the
+ * end of thread_start(). The thread structure is released too
+ * \param thread A pointer to the thread */
+
+static void green_exit(thread_t *thread)
+{
+    thread_t **link;
+    bool uncaught;
+
+    // The ticker must not see the thread anymore
+    native_mutex_lock(&gs.lock);
+
+    if (thread->green.in_timer) {
+        link = &gs.timers;
+
+        while (*link != thread) {
+            link = &(*link)->green.timer_next;
+        }
+
+        *link = thread->green.timer_next;
+    }
+
+    native_mutex_unlock(&gs.lock);
+
+    // Mark the thread as dead, none can join on it anymore after this point
+    tm_lock();
+
+    native_cond_broadcast(&thread->cond);
+    green_wake_joiners(thread);
+    tm_unregister(thread);
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = JNULL;
+
+    /* We can safely release the stack and root pointers now that the thread
+     * is not visible anymore to the garbage collector */
+    gc_free(thread->roots.pointers);
+    thread_stack_dispose(thread);
+
+    tm_unlock();
+
+    native_cond_dispose(&thread->cond);
+    native_cond_dispose(&thread->park);
+    native_mutex_dispose(&thread->park_lock);
+
+    uncaught = (thread->exception != JNULL);
+    gc_free(thread);
+
+    if (uncaught) {
+        // TODO: Print the exception and stack trace
+        dbg_error("Uncaught exception");
+        vm_fail();
+    }
+} // green_exit()
+
+/** Mounts a virtual thread on the calling carrier and runs it until it is
+ * unmounted or it terminates
+ * \param carrier A pointer to the calling carrier
+ * \param thread A pointer to a ready virtual thread */
+
+static void green_run(green_carrier_t *carrier, thread_t *thread)
+{
+    method_t *run = thread->green.run;
+    int exception;
+
+    thread_set_self(thread);
+    thread_resumes();
+    thread->green.run = NULL;
+
+    c_try {
+        // A NULL method resumes the thread where it was unmounted
+        interpreter(run);
+    } c_catch (exception) {
+        c_print_exception(exception);
+        c_clear_exception();
+        vm_fail();
+    }
+
+    // The ticker must not see the thread anymore
+    native_mutex_lock(&carrier->lock);
+    carrier->current = NULL;
+    thread->green.carrier = NULL;
+    native_mutex_unlock(&carrier->lock);
+
+    if (thread->green.unmount) {
+        thread->green.unmount = false;
+        thread_may_block();
+        green_unmounted(carrier, thread);
+    } else {
+        green_exit(thread);
+    }
+
+    thread_set_self(NULL);
+} // green_run()
+
+/** Checks if more carriers than needed are running, this is only a hint
+ * unless the caller holds the scheduler lock
+ * \returns true if a carrier should exit */
+
+static bool green_surplus( void )
+{
+    return *((volatile size_t *) &gs.carriers)
+           - *((volatile size_t *) &gs.blocked) > gs.target;
+} // green_surplus()
+
+/** Entry point of a carrier, runs ready virtual threads until more carriers
+ * than needed are running
+ * \param arg A pointer to the carrier's slot
+ * \returns Nothing important */
+
+static void *green_carrier(void *arg)
+{
+    green_carrier_t *carrier = (green_carrier_t *) arg;
+    thread_t *thread;
+
+    while (true) {
+        if (green_surplus()) {
+            native_mutex_lock(&gs.lock);
+
+            if (green_surplus()) {
+                break; // A blocked carrier came back, this one is not needed
+            }
+
+            native_mutex_unlock(&gs.lock);
+        }
+
+        thread = green_next(carrier);
+
+        if (thread == NULL) {
+            native_mutex_lock(&gs.lock);
+
+            if (!green_surplus()) {
+                /* Pairs with the barrier in green_ready(), either we see the
+                 * new thread or its producer sees us idling */
+                gs.idle++;
+                memory_barrier();
+
+                if (!green_has_work()) {
+                    native_cond_wait(&gs.cond, &gs.lock);
+                }
+
+                gs.idle--;
+            }
+
+            native_mutex_unlock(&gs.lock);
+            continue;
+        }
+
+        native_mutex_lock(&carrier->lock);
+        thread->green.ready_next = NULL;
+        thread->green.state = GREEN_RUNNING;
+        thread->green.preempt = false;
+        thread->green.carrier = carrier;
+        carrier->current = thread;
+        native_mutex_unlock(&carrier->lock);
+
+        green_run(carrier, thread);
+    }
+
+    // Hand the local queue over to the other carriers
+    native_mutex_lock(&carrier->lock);
+
+    if (carrier->head != NULL) {
+        if (gs.ready_tail != NULL) {
+            gs.ready_tail->green.ready_next = carrier->head;
+        } else {
+            gs.ready = carrier->head;
+        }
+
+        gs.ready_tail = carrier->tail;
+        carrier->head = NULL;
+        carrier->tail = NULL;
+        carrier->length = 0;
+    }
+
+    native_mutex_unlock(&carrier->lock);
+
+    carrier->used = false;
+    gs.carriers--;
+    green_balance();
+    native_mutex_unlock(&gs.lock);
+
+    native_thread_exit();
+
+    return NULL;
+} // green_carrier()
+
+/** Entry point of the ticker thread. Once per time slice it expires the
+ * timeouts of parked virtual threads and asks the running ones to give up
+ * their carrier if other virtual threads are ready
+ * \param arg Unused
+ * \returns Nothing important */
+
+static void *green_ticker(void *arg)
+{
+    green_carrier_t *carrier;
+    thread_t **link;
+    thread_t *thread;
+    uint64_t now;
+
+    native_mutex_lock(&gs.lock);
+
+    while (true) {
+        native_cond_timed_wait(&gs.tick, &gs.lock, GREEN_TIMESLICE, 0);
+        now = get_time_usec();
+        link = &gs.timers;
+
+        while ((thread = *link) != NULL) {
+            if ((thread->green.state == GREEN_PARKED)
+                && (thread->green.deadline > now))
+            {
+                link = &thread->green.timer_next;
+                continue;
+            }
+
+            // The timeout expired or the thread is not parked anymore
+            *link = thread->green.timer_next;
+            thread->green.timer_next = NULL;
+            thread->green.in_timer = false;
+
+            if (thread->green.state == GREEN_PARKED) {
+                green_ready(NULL, thread);
+            }
+        }
+
+        if (green_has_work()) {
+            for (size_t i = 0; i < GREEN_MAX_CARRIERS; i++) {
+                carrier = gs.carrier + i;
+                native_mutex_lock(&carrier->lock);
+
+                if (carrier->current != NULL) {
+                    carrier->current->green.preempt = true;
+                }
+
+                native_mutex_unlock(&carrier->lock);
+            }
+        }
+    }
+
+    return NULL;
+} // green_ticker()
+
+/** Creates a new virtual thread executing the provided method, the thread is
+ * put in the ready queue and runs on the first available carrier
+ * \param ref The java.lang.Thread object associated with this thread
+ * \param run The first method executed by this thread */
+
+void thread_launch_virtual(uintptr_t *ref, method_t *run)
+{
+    thread_t *thread = gc_malloc(sizeof(thread_t));
+
+    thread_setup(thread);
+
+    // Build the stack
+    thread_stack_create(thread);
+
+    // Create the temporary roots area
+    thread->roots.capacity = THREAD_TMP_ROOTS;
+    thread->roots.pointers = gc_malloc(THREAD_TMP_ROOTS
+                                       * sizeof(uintptr_t *));
+
+    // The thread counts as blocked for as long as it is not mounted
+    thread->blocked = true;
+    thread->green.is_virtual = true;
+    thread->green.run = run;
+
+    tm_lock();
+
+    // Link the java.lang.Thread object to the VM thread and register it
+    thread->obj = *ref;
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->vmThread = (uintptr_t) thread;
+    JAVA_LANG_THREAD_REF2PTR(thread->obj)->priority = 5;
+    tm_register(thread);
+
+    // HACK: Push the 'this' pointer on top of the stack
+    *((uintptr_t *) thread->stack) = thread->obj;
+
+    native_mutex_lock(&gs.lock);
+
+    if (!gs.started) {
+        gs.started = true;
+        native_thread_create(&gs.ticker, green_ticker, NULL);
+    }
+
+    native_mutex_unlock(&gs.lock);
+    green_ready(green_carrier_self(), thread);
+    tm_unlock();
+} // thread_launch_virtual()
+
+/** Flags the calling thread as blocked for a potentially long time, a virtual
+ * thread which blocks its carrier lets another carrier stand in for it. Must
+ * be coupled with a later call to thread_resumes_long() */
+
+void thread_may_block_long( void )
+{
+    thread_t *self = thread_self();
+
+    thread_may_block();
+
+    if (self->green.is_virtual) {
+        native_mutex_lock(&gs.lock);
+        gs.blocked++;
+        green_balance();
+        native_mutex_unlock(&gs.lock);
+    }
+} // thread_may_block_long()
+
+/** Restores a thread to its steady state after a blocking operation started
+ * with thread_may_block_long() */
+
+void thread_resumes_long( void )
+{
+    thread_t *self = thread_self();
+
+    if (self->green.is_virtual) {
+        native_mutex_lock(&gs.lock);
+        gs.blocked--;
+        native_mutex_unlock(&gs.lock);
+    }
+
+    thread_resumes();
+} // thread_resumes_long()
+
+#endif // JEL_GREEN_THREADS
+
 #endif // JEL_THREAD_POSIX || JEL_THREAD_PTH
 
@@ -136,9 +136,58 @@ struct stack_frame_t {
 /** Typedef for struct stack_frame_t */
 typedef struct stack_frame_t stack_frame_t;
 
+#if JEL_SEGMENTED_STACKS
+
+/** Header of a stack segment. A segment is allocated when a call does not fit
+ * in the current one, its frames grow downwards from a link frame placed at its
+ * very end which returns to the caller living in the previous segment. The
+ * arguments of the call are moved right after the header */
+
+struct stack_segment_t {
+    struct stack_segment_t *prev; ///< Previous segment, NULL for the first
+    jword_t *sp; ///< Position of the arguments in the previous segment
+    stack_frame_t *fp; ///< Frame of the caller in the previous segment
+    size_t size; ///< Size of the segment in bytes, including this header
+};
+
+/** Typedef for struct stack_segment_t */
+typedef struct stack_segment_t stack_segment_t;
+
+#endif // JEL_SEGMENTED_STACKS
+
 /** Defines the initial number of temporary root pointers available */
 #define THREAD_TMP_ROOTS (2)
 
+#if JEL_GREEN_THREADS
+
+/** Scheduling state of a virtual thread */
+
+enum green_state_t {
+    GREEN_RUNNING = 0, ///< Mounted on a carrier or unmounting from it
+    GREEN_READY = 1, ///< Waiting in the ready queue for a free carrier
+    GREEN_PARKED = 2 ///< Unmounted until it is unparked or times out
+};
+
+/** Typedef for enum green_state_t */
+typedef enum green_state_t green_state_t;
+
+/** Blocking operation interrupted by unmounting a virtual thread, the native
+ * method which started it is invoked again when the thread is resumed and
+ * completes the operation instead of starting a new one */
+
+enum green_phase_t {
+    GREEN_NONE = 0, ///< No operation in progress
+    GREEN_SLEEPING = 1, ///< Thread.sleep()
+    GREEN_JOINING = 2, ///< Thread.join()
+    GREEN_WAITING = 3, ///< Object.wait(), in the wait set
+    GREEN_REENTERING = 4 ///< Object.wait(), re-acquiring the monitor
+};
+
+/** Typedef for enum green_phase_t */
+typedef enum green_phase_t green_phase_t;
+
+#endif // JEL_GREEN_THREADS
+
 /** Virtual machine thread */
 
 struct thread_t {
@@ -152,6 +201,11 @@ struct thread_t {
     jword_t *sp; ///< Stack pointer
     stack_frame_t *fp; ///< Frame pointer
     const uint8_t *pc; ///< Saved program counter
+#if JEL_SEGMENTED_STACKS
+    stack_segment_t *segment; ///< Current stack segment, NULL for the first
+    stack_segment_t *spare; ///< Last released segment, kept for reuse
+    size_t stack_used; ///< Size in bytes of the segments in use
+#endif // JEL_SEGMENTED_STACKS
 
     uintptr_t exception; ///< Java exception
 
@@ -174,7 +228,48 @@ struct thread_t {
     native_thread_t native;  ///< Embedded native thread
     native_cond_t cond; ///< Embedded native condition variable
     native_cond_t *cond_int; ///< Condition on which this thread is waiting
+    native_mutex_t park_lock; ///< Protects the parked flag
+    native_cond_t park; ///< Condition on which this thread parks
+    bool parked; ///< True while this thread is parked on a monitor
+    struct thread_t *park_next; ///< Next thread in a monitor queue or wait set
     bool interrupted; ///< True if this thread was interrupted
+#if JEL_THIN_LOCKS
+    uint32_t lock_id; ///< Identifier stored in thin locks, 0 if none is free
+#endif // JEL_THIN_LOCKS
+#if JEL_CONCURRENT_GC
+    struct satb_buffer_t *satb; ///< References overwritten while marking
+#endif // JEL_CONCURRENT_GC
+
+#if JEL_GREEN_THREADS
+    struct {
+        bool is_virtual; ///< True if multiplexed on the carrier threads
+        bool preempt; ///< Set to unmount the thread at the next safepoint
+        bool restartable; ///< The calling native may be invoked again
+        bool unmountable; ///< The current blocking operation may unmount
+        bool unmount; ///< Set when the interpreter must return to the carrier
+        bool park; ///< Unmounting parks the thread instead of yielding
+        bool interruptible; ///< The park ends when the thread is interrupted
+        bool in_timer; ///< The thread is in the timed parks list
+        green_state_t state; ///< Scheduling state
+        green_phase_t phase; ///< Blocking operation being restarted
+        uint32_t depth; ///< Nesting depth of the interpreter
+        uint64_t deadline; ///< End of a timed park in microseconds, 0 if none
+        size_t count; ///< Recursion count of a monitor released by wait()
+        method_t *run; ///< First method executed, NULL once started
+        struct green_carrier_t *carrier; ///< Carrier running the thread
+        struct thread_t *ready_next; ///< Next thread in the ready queue
+        struct thread_t *timer_next; ///< Next thread in the timed parks list
+        struct thread_t *joiners; ///< Virtual threads joining on this one
+        struct thread_t *joined; ///< Thread this one is joining on
+    } green; ///< Virtual thread state
+#endif // JEL_GREEN_THREADS
+
+#if JEL_THREAD_POOL
+    struct {
+        struct thread_t *next; ///< Next idle thread in the pool
+        method_t *run; ///< Method handed over by thread_launch()
+    } pool; ///< Thread pool state
+#endif // JEL_THREAD_POOL
 
 #if JEL_PRINT
     size_t call_depth; ///< Depth of the current function call
@@ -199,7 +294,7 @@ extern void tm_teardown( void );
 extern void tm_register(thread_t *);
 extern void tm_unregister(thread_t *);
 extern uint32_t tm_active( void );
-extern void tm_mark( void );
+extern void tm_mark(size_t, size_t);
 extern void tm_purge( void );
 
 #if !JEL_THREAD_NONE
@@ -213,6 +308,19 @@ static inline void *tm_get_lock( void ) { return NULL; }
 static inline void tm_stop_the_world( void ) {}
 #endif // !JEL_THREAD_NONE
 
+#if JEL_PRINT
+#   if !JEL_THREAD_NONE
+extern uint64_t tm_take_ttsp( void );
+#   else
+static inline uint64_t tm_take_ttsp( void ) { return 0; }
+#   endif // !JEL_THREAD_NONE
+#endif // JEL_PRINT
+
+#if JEL_CONCURRENT_GC
+extern void tm_gc_wait( void );
+extern void tm_gc_signal( void );
+#endif // JEL_CONCURRENT_GC
+
 /******************************************************************************
  * Monitor interface                                                          *
  ******************************************************************************/
@@ -228,6 +336,12 @@ extern bool monitor_exit(thread_t *, uintptr_t);
 extern void thread_push_root(uintptr_t *);
 extern void thread_pop_root( void );
 extern void thread_init(thread_t *);
+extern stack_frame_t *thread_stack_end(thread_t *);
+#if JEL_SEGMENTED_STACKS
+extern stack_frame_t *thread_stack_grow(thread_t *, jword_t *, uint32_t,
+                                        uint32_t);
+extern stack_frame_t *thread_stack_shrink(thread_t *, jword_t *);
+#endif // JEL_SEGMENTED_STACKS
 extern uintptr_t thread_create_main(thread_t *, method_t *, uintptr_t *);
 extern void thread_sleep(int64_t);
 
@@ -236,6 +350,7 @@ extern void thread_sleep(int64_t);
 extern void thread_launch(uintptr_t *, method_t *);
 extern void thread_may_block( void );
 extern void thread_resumes( void );
+extern bool thread_safepoint( void );
 extern void thread_interrupt(thread_t *);
 extern void thread_yield( void );
 extern void thread_join(uintptr_t *);
@@ -251,6 +366,7 @@ static inline void thread_launch(uintptr_t ref, method_t *run)
 
 static inline void thread_may_block( void ) {}
 static inline void thread_resumes( void ) {}
+static inline bool thread_safepoint( void ) { return false; }
 
 static inline void thread_yield( void ) {}
 static inline void thread_join(uintptr_t *thread) {}
@@ -267,6 +383,31 @@ static inline bool thread_notify(uintptr_t ref, bool broadcast)
 
 #endif
 
+#if JEL_GREEN_THREADS
+
+extern void thread_launch_virtual(uintptr_t *, method_t *);
+extern void thread_may_block_long( void );
+extern void thread_resumes_long( void );
+
+#else
+
+/** Flags the calling thread as blocked for an unbounded amount of time, see
+ * thread_may_block() */
+
+static inline void thread_may_block_long( void )
+{
+    thread_may_block();
+} // thread_may_block_long()
+
+/** Restores a thread after a call to thread_may_block_long() */
+
+static inline void thread_resumes_long( void )
+{
+    thread_resumes();
+} // thread_resumes_long()
+
+#endif // JEL_GREEN_THREADS
+
 /******************************************************************************
  * Thread inlined functions                                                   *
  ******************************************************************************/
@@ -279,4 +420,47 @@ static inline thread_t *thread_self( void )
     return native_key_get(self);
 } // thread_self()
 
+/** Checks if a stop-the-world has been requested, the flag is read again on
+ * every call as it is set by other threads
+ * \param thread A pointer to the calling thread
+ * \returns true if the thread must stop at the next safepoint */
+
+static inline bool thread_must_stop(thread_t *thread)
+{
+#if JEL_GREEN_THREADS
+    return *((volatile bool *) &thread->stopped)
+           || *((volatile bool *) &thread->green.preempt);
+#else
+    return *((volatile bool *) &thread->stopped);
+#endif // JEL_GREEN_THREADS
+} // thread_must_stop()
+
+#if JEL_GREEN_THREADS
+
+/** Checks if a thread can be unmounted from its carrier, i.e. if it is a
+ * virtual thread and the interpreter is not nested within C code
+ * \param thread A pointer to the thread
+ * \returns true if the thread can be unmounted */
+
+static inline bool thread_can_unmount(thread_t *thread)
+{
+    return thread->green.is_virtual && (thread->green.depth == 1);
+} // thread_can_unmount()
+
+/** Allows the next blocking operation of the calling native method to unmount
+ * the thread instead of blocking its carrier. The native method is invoked
+ * again once the thread has been resumed so it must not have any side effect
+ * before the blocking operation */
+
+static inline void thread_may_unmount( void )
+{
+    thread_self()->green.restartable = true;
+} // thread_may_unmount()
+
+#else
+
+static inline void thread_may_unmount( void ) {}
+
+#endif // JEL_GREEN_THREADS
+
 #endif // JELATINE_THREAD_H
@@ -76,6 +76,7 @@ static string_manager_t sm;
  ******************************************************************************/
 
 static void string_manager_rehash(size_t);
+static utf8_string_t *string_manager_lookup(const char *, uint32_t);
 static uint32_t utf8_hash(const char *, size_t);
 
 /******************************************************************************
@@ -131,11 +132,43 @@ static void string_manager_rehash(size_t capacity)
         }
     }
 
-    gc_free(sm.buckets);
+    /* The table only grows so lock-free readers are safe as long as the new
+     * buckets array is published before the new capacity. The old array might
+     * still be in use and is released at the next collection */
+    memory_barrier();
+    gc_retire(sm.buckets);
     sm.buckets = buckets;
+    memory_barrier();
     sm.capacity = capacity;
 } // string_manager_rehash()
 
+/** Looks up an interned string, this function can be called without holding
+ * the VM lock
+ * \param src A pointer to the string to be looked up
+ * \param hash The unmasked hash of the string
+ * \returns A pointer to the interned string or NULL if none was found */
+
+static utf8_string_t *string_manager_lookup(const char *src, uint32_t hash)
+{
+    utf8_string_t *str;
+    size_t capacity;
+
+    // Read the capacity first, the buckets array is published before it
+    capacity = ((volatile string_manager_t *) &sm)->capacity;
+    memory_barrier();
+    str = ((utf8_string_t *volatile *) sm.buckets)[hash & (capacity - 1)];
+
+    while (str != NULL) {
+        if (strcmp(str->data, src) == 0) {
+            return str;
+        }
+
+        str = ((volatile utf8_string_t *) str)->next;
+    }
+
+    return NULL;
+} // string_manager_lookup()
+
 /** Checks if a string in the Java class file modified UTF8 format is valid,
  * i.e. checks if the length of the string matches the given one and that the
  * string doesn't contain invalid characters
@@ -208,25 +241,29 @@ char *utf8_intern(const char *src, size_t len)
         src = empty;
     }
 
-    tm_lock(); // Only one thread at a time can intern an UTF-8 string
+    hash = utf8_hash(src, len);
 
-    // Mask the hash to save the bits that fit the current table capacity
-    hash = utf8_hash(src, len) & (sm.capacity - 1);
-    str = sm.buckets[hash];
+    /* Interned strings are permanent so look for a match without holding the
+     * VM lock first, the lookup may fail spuriously if it races with a rehash
+     * but it will be repeated with the lock held */
+    str = string_manager_lookup(src, hash);
 
-    while (str != NULL) {
-        if (strcmp(str->data, src) == 0) {
-            break;
-        } else {
-            str = str->next;
-        }
+    if (str != NULL) {
+        return str->data;
     }
 
+    tm_lock(); // Only one thread at a time can intern an UTF-8 string
+
+    str = string_manager_lookup(src, hash);
+
     if (str == NULL) {
+        // Mask the hash to save the bits that fit the current table capacity
+        hash &= sm.capacity - 1;
         str = gc_palloc(sizeof(utf8_string_t) + len + 1);
         memcpy(str->data, src, len);
         // No zero termination as the memory has already been cleared
         str->next = sm.buckets[hash];
+        memory_barrier(); // Publish the string only once it is fully linked
         sm.buckets[hash] = str;
         sm.entries++;
 
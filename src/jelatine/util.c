@@ -334,3 +334,29 @@ struct timespec get_time_with_offset(uint64_t ms, uint32_t nanos)
     return res;
 } // get_time_with_offset()
 
+/** Returns the current value of a monotonic clock if available, falls back to
+ * the wall-clock time otherwise. Used for measuring time intervals
+ * \returns The current time in microseconds */
+
+uint64_t get_time_usec( void )
+{
+#if HAVE_CLOCK_GETTIME
+    struct timespec now;
+
+#   ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#   else
+    clock_gettime(CLOCK_REALTIME, &now);
+#   endif // CLOCK_MONOTONIC
+
+    return ((uint64_t) now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+#elif HAVE_GETTIMEOFDAY
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return ((uint64_t) now.tv_sec * 1000000) + now.tv_usec;
+#else
+#   error "get_time_usec() doesn't have an appropriate fallback."
+#endif
+} // get_time_usec()
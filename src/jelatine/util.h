@@ -135,6 +135,16 @@ static inline size_t size_max(size_t x, size_t y)
     return (x > y) ? x : y;
 } // size_max()
 
+/** Returns the minimum value between \a x and \a y
+ * \param x The first value
+ * \param y The second value
+ * \returns The minimum value between \a x and \a y */
+
+static inline size_t size_min(size_t x, size_t y)
+{
+    return (x < y) ? x : y;
+} // size_min()
+
 /** Loads a 16-bit integer from a potentially unaligned location
  * \param src A potentially unaligned pointer to a 16-bit integer
  * \returns A 16-bit integer */
@@ -281,5 +291,6 @@ extern void c_print_exception(int);
  ******************************************************************************/
 
 extern struct timespec get_time_with_offset(uint64_t ms, uint32_t nanos);
+extern uint64_t get_time_usec( void );
 
 #endif // !JELATINE_UTIL_H
@@ -67,11 +67,36 @@ options_t options = {
     ".", // classpath
     JEL_CLASSPATH_DIR, // boot_classpath
     128 * 1024, // heap_size
+#if JEL_SEGMENTED_STACKS
+    256 * 1024, // stack_size
+    1024, // stack_segment_size
+#else
     4096, // stack_size
+#endif // JEL_SEGMENTED_STACKS
     NULL, // main_class
     NULL, // jargs
     0, // jargs_n
 
+#if HAVE_MADVISE
+    false, // huge_pages
+#endif // HAVE_MADVISE
+
+#if JEL_INCREMENTAL_GC
+    1024, // gc_pause_target
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_PARALLEL_GC
+    0, // gc_threads
+#endif // JEL_PARALLEL_GC
+
+#if JEL_GREEN_THREADS
+    0, // carriers
+#endif // JEL_GREEN_THREADS
+
+#if JEL_THREAD_POOL
+    30000, // thread_idle_timeout
+#endif // JEL_THREAD_POOL
+
 #if JEL_TRACE
     false, // trace_methods
     false, // trace_opcodes
@@ -112,7 +137,7 @@ void vm_run( void )
     class_t *cl, *thread_cl;
     method_t *method;
     uintptr_t args, ref;
-    uintptr_t *args_data;
+    jref_t *args_data;
     int exception;
 
     // The main thread is initialized early because we need it for exceptions
@@ -174,6 +199,19 @@ void vm_run( void )
         thread_pop_root();
 #endif // JEL_FINALIZER
 
+#if JEL_CONCURRENT_GC
+        // Create the collector thread in the same way as the finalizer
+        cl = bcl_resolve_class(NULL, "jelatine/VMCollector");
+        method = mm_get(cl->method_manager, "run", "()V");
+        assert(method != NULL);
+
+        ref = gc_new(thread_cl);
+        JAVA_LANG_THREAD_REF2PTR(ref)->priority = 5;
+        thread_push_root(&ref);
+        thread_launch(&ref, method);
+        thread_pop_root();
+#endif // JEL_CONCURRENT_GC
+
         cl = bcl_resolve_class(NULL, main_class);
         // Find the main() method
         method = mm_get(cl->method_manager, "main", "([Ljava/lang/String;)V");
@@ -199,8 +237,8 @@ void vm_run( void )
         thread_push_root(&args);
 
         for (int i = 0; i < jargc; i++) {
-            args_data[-i] =
-                JAVA_LANG_STRING_PTR2REF(jstring_create_literal(jargv[i]));
+            gc_ref_store(args_data - i,
+                JAVA_LANG_STRING_PTR2REF(jstring_create_literal(jargv[i])));
         }
 
         // Launch the main thread
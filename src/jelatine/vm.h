@@ -72,10 +72,33 @@ struct options_t {
     char *boot_classpath; ///< Default classpath for system classes
     size_t heap_size; ///< Heap size
     size_t stack_size; ///< Size of a thread's stack
+#if JEL_SEGMENTED_STACKS
+    size_t stack_segment_size; ///< Size of a thread's stack segments
+#endif // JEL_SEGMENTED_STACKS
     char *main_class; ///< Name of the class holding the main() method
     char **jargs; ///< Arguments of the Java application
     int jargs_n; ///< Number of arguments
 
+#if HAVE_MADVISE
+    bool huge_pages; ///< True if the heap should use transparent huge pages
+#endif // HAVE_MADVISE
+
+#if JEL_INCREMENTAL_GC
+    size_t gc_pause_target; ///< Work budget of an incremental marking step
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_PARALLEL_GC
+    size_t gc_threads; ///< Number of marking threads, 0 for one per processor
+#endif // JEL_PARALLEL_GC
+
+#if JEL_GREEN_THREADS
+    size_t carriers; ///< Number of carrier threads, 0 for one per processor
+#endif // JEL_GREEN_THREADS
+
+#if JEL_THREAD_POOL
+    size_t thread_idle_timeout; ///< Time in ms a pooled thread waits for work
+#endif // JEL_THREAD_POOL
+
 #if JEL_TRACE
     bool trace_methods; ///< True if method tracing is enabled
     bool trace_opcodes; ///< True if opcode tracing is enabled
@@ -166,6 +189,26 @@ static inline size_t opts_get_stack_size( void )
     return options.stack_size;
 } // opts_get_stack_size()
 
+#if JEL_SEGMENTED_STACKS
+
+/** Sets the global option 'stack segment size'
+ * \param size The default size of a thread's stack segments */
+
+static inline void opts_set_stack_segment_size(size_t size)
+{
+    options.stack_segment_size = size;
+} // opts_set_stack_segment_size()
+
+/** Gets the global option 'stack segment size'
+ * \returns size The default size of a thread's stack segments */
+
+static inline size_t opts_get_stack_segment_size( void )
+{
+    return options.stack_segment_size;
+} // opts_get_stack_segment_size()
+
+#endif // JEL_SEGMENTED_STACKS
+
 /** Sets the global option 'main class'
  * \param class_name A string holding the name of the class which main method
  * should be called by the virtual machine */
@@ -217,6 +260,111 @@ static inline int opts_get_jargs_n( void )
     return options.jargs_n;
 } // opts_set_jargs_n()
 
+#if HAVE_MADVISE
+
+/** Sets the global option 'huge pages'
+ * \param enable true if the heap should be backed by transparent huge pages */
+
+static inline void opts_set_huge_pages(bool enable)
+{
+    options.huge_pages = enable;
+} // opts_set_huge_pages()
+
+/** Gets the global option 'huge pages'
+ * \returns true if the heap should be backed by transparent huge pages */
+
+static inline bool opts_get_huge_pages( void )
+{
+    return options.huge_pages;
+} // opts_get_huge_pages()
+
+#endif // HAVE_MADVISE
+
+#if JEL_INCREMENTAL_GC
+
+/** Sets the global option 'gc pause target'
+ * \param target The maximum number of references traced by an incremental
+ * marking step, 0 disables incremental marking */
+
+static inline void opts_set_gc_pause_target(size_t target)
+{
+    options.gc_pause_target = target;
+} // opts_set_gc_pause_target()
+
+/** Gets the global option 'gc pause target'
+ * \returns The maximum number of references traced by an incremental marking
+ * step */
+
+static inline size_t opts_get_gc_pause_target( void )
+{
+    return options.gc_pause_target;
+} // opts_get_gc_pause_target()
+
+#endif // JEL_INCREMENTAL_GC
+
+#if JEL_PARALLEL_GC
+
+/** Sets the global option 'gc threads'
+ * \param threads The number of threads used for marking, 0 to use one thread
+ * per online processor */
+
+static inline void opts_set_gc_threads(size_t threads)
+{
+    options.gc_threads = threads;
+} // opts_set_gc_threads()
+
+/** Gets the global option 'gc threads'
+ * \returns The number of threads used for marking */
+
+static inline size_t opts_get_gc_threads( void )
+{
+    return options.gc_threads;
+} // opts_get_gc_threads()
+
+#endif // JEL_PARALLEL_GC
+
+#if JEL_GREEN_THREADS
+
+/** Sets the global option 'carriers'
+ * \param carriers The number of carrier threads running virtual threads, 0 to
+ * use one carrier per online processor */
+
+static inline void opts_set_carriers(size_t carriers)
+{
+    options.carriers = carriers;
+} // opts_set_carriers()
+
+/** Gets the global option 'carriers'
+ * \returns The number of carrier threads running virtual threads */
+
+static inline size_t opts_get_carriers( void )
+{
+    return options.carriers;
+} // opts_get_carriers()
+
+#endif // JEL_GREEN_THREADS
+
+#if JEL_THREAD_POOL
+
+/** Sets the global option 'thread idle timeout'
+ * \param timeout The time in milliseconds an idle pooled thread waits for a new
+ * Java thread to run before terminating */
+
+static inline void opts_set_thread_idle_timeout(size_t timeout)
+{
+    options.thread_idle_timeout = timeout;
+} // opts_set_thread_idle_timeout()
+
+/** Gets the global option 'thread idle timeout'
+ * \returns The time in milliseconds an idle pooled thread waits for work */
+
+static inline size_t opts_get_thread_idle_timeout( void )
+{
+    return options.thread_idle_timeout;
+} // opts_get_thread_idle_timeout()
+
+#endif // JEL_THREAD_POOL
+
 #if JEL_TRACE
 
 /** Sets the global option 'trace methods'
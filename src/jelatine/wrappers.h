@@ -111,10 +111,34 @@ typedef intptr_t ptrdiff_t;
 
 #if SIZEOF_LONG == 8
 typedef uint64_t jword_t;
+/** Size in bytes of a jword_t */
+#   define SIZEOF_JWORD_T (8)
 #else
 typedef uint32_t jword_t;
+/** Size in bytes of a jword_t */
+#   define SIZEOF_JWORD_T (4)
 #endif // SIZEOF_LONG == 8
 
+/** \typedef jref_t
+ * Represents a reference stored inside a Java object or array. This is a plain
+ * pointer unless compressed references are enabled, in which case it holds
+ * the distance in jwords of the referenced object from the base of the heap,
+ * see gc_ref_load() and gc_ref_store() */
+
+#if JEL_COMPRESSED_REFS == 32
+typedef uint32_t jref_t;
+/** Size in bytes of a jref_t */
+#   define SIZEOF_JREF_T (4)
+#elif JEL_COMPRESSED_REFS == 16
+typedef uint16_t jref_t;
+/** Size in bytes of a jref_t */
+#   define SIZEOF_JREF_T (2)
+#else
+typedef uintptr_t jref_t;
+/** Size in bytes of a jref_t */
+#   define SIZEOF_JREF_T SIZEOF_VOID_P
+#endif // JEL_COMPRESSED_REFS
+
 /** \cond */
 
 // Adapt WORDS_BIGENDIAN and FLOAT_WORDS_BIGENDIAN
@@ -130,6 +154,18 @@ typedef uint32_t jword_t;
 /** Java nil reference */
 #define JNULL ((uintptr_t) NULL)
 
+/** \def memory_barrier()
+ * Orders the memory accesses done before the barrier with respect to those
+ * done after it. Used when publishing data structures which other threads read
+ * without holding the VM lock, without atomic builtins only the compiler is
+ * prevented from reordering the accesses */
+
+#if HAVE_SYNC_BUILTINS
+#   define memory_barrier() __sync_synchronize()
+#else
+#   define memory_barrier() __asm__ __volatile__("" : : : "memory")
+#endif // HAVE_SYNC_BUILTINS
+
 // Floating point support
 
 #if JEL_FP_SUPPORT